@@ -0,0 +1,165 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "EEPROMWritePlan.h"
+#include "GD.h"
+
+#include <cmath>
+
+namespace HMWired
+{
+
+bool EEPROMWritePlan::addParameter(const std::string& id, double index, double size, std::vector<uint8_t> binaryValue)
+{
+	try
+	{
+		if(size < 0 || index < 0)
+		{
+			GD::out.printError("Error: Can't set configuration parameter " + id + ". Index or size is negative.");
+			return false;
+		}
+		std::vector<EEPROMByteEdit> edits;
+		if(size > 0.8 && size < 1.0) size = 1.0;
+		double byteIndex = std::floor(index);
+		int32_t address = byteIndex;
+		if(byteIndex != index || size <= 1.0) //0.8 == 8 Bits
+		{
+			if(size > 1.0)
+			{
+				GD::out.printError("Error: Can't set configuration parameter " + id + ". Partial byte index > 1.");
+				return false;
+			}
+			if(binaryValue.empty()) binaryValue.push_back(0);
+			//The round is necessary, because for example (uint32_t)(0.2 * 10) is 1
+			uint32_t bitSize = std::lround(size * 10);
+			if(bitSize > 8) bitSize = 8;
+			uint32_t indexBits = std::lround(index * 10) % 10;
+			uint32_t value = binaryValue.back() & _bitmask[bitSize];
+			if(indexBits + bitSize > 8) //Spread over two bytes
+			{
+				uint32_t missingBits = (indexBits + bitSize) - 8;
+				if(missingBits > 8)
+				{
+					GD::out.printError("Error: Can't set configuration parameter " + id + ". missingBits is out of bounds.");
+					return false;
+				}
+				addEdit(edits, address, (_bitmask[bitSize] << indexBits) & 0xFF, (value << indexBits) & 0xFF);
+				addEdit(edits, address + 1, _bitmask[missingBits], (value >> (bitSize - missingBits)) & _bitmask[missingBits]);
+			}
+			else addEdit(edits, address, (_bitmask[bitSize] << indexBits) & 0xFF, (value << indexBits) & 0xFF);
+		}
+		else
+		{
+			if(binaryValue.empty()) return true;
+			uint32_t bytes = (uint32_t)std::ceil(size);
+			uint32_t bitSize = std::lround(size * 10) % 10;
+			if(bitSize > 8) bitSize = 8;
+			if(bytes == 0) bytes = 1; //size is 0 - assume 1
+			if(bytes <= binaryValue.size())
+			{
+				addEdit(edits, address, _bitmask[bitSize], binaryValue.at(0) & _bitmask[bitSize]);
+				for(uint32_t i = 1; i < bytes; i++) addEdit(edits, address + i, 0xFF, binaryValue.at(i));
+			}
+			else
+			{
+				//Pad missing leading bytes with zeros
+				uint32_t missingBytes = bytes - binaryValue.size();
+				addEdit(edits, address, _bitmask[bitSize], 0);
+				for(uint32_t i = 1; i < missingBytes; i++) addEdit(edits, address + i, 0xFF, 0);
+				for(uint32_t i = 0; i < binaryValue.size(); i++) addEdit(edits, address + missingBytes + i, 0xFF, binaryValue.at(i));
+			}
+		}
+		if(edits.empty()) return true;
+		std::set<int32_t> parameterBlocks;
+		for(std::vector<EEPROMByteEdit>::iterator i = edits.begin(); i != edits.end(); ++i)
+		{
+			int32_t blockIndex = (i->address / 0x10) * 0x10;
+			parameterBlocks.insert(blockIndex);
+			_edits[blockIndex].push_back(*i);
+		}
+		_sequentialBlockWrites += parameterBlocks.size();
+		_parameters.push_back(id);
+		return true;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return false;
+}
+
+void EEPROMWritePlan::addEdit(std::vector<EEPROMByteEdit>& edits, int32_t address, uint8_t clearMask, uint8_t value)
+{
+	EEPROMByteEdit edit;
+	edit.address = address;
+	edit.clearMask = clearMask;
+	edit.value = value & clearMask;
+	edits.push_back(edit);
+}
+
+std::set<int32_t> EEPROMWritePlan::blocks()
+{
+	std::set<int32_t> blocks;
+	for(std::map<int32_t, std::vector<EEPROMByteEdit>>::iterator i = _edits.begin(); i != _edits.end(); ++i)
+	{
+		blocks.insert(i->first);
+	}
+	return blocks;
+}
+
+bool EEPROMWritePlan::apply(int32_t blockIndex, std::vector<uint8_t>& data)
+{
+	try
+	{
+		if(data.size() != 0x10) return false;
+		std::map<int32_t, std::vector<EEPROMByteEdit>>::iterator blockIterator = _edits.find(blockIndex);
+		if(blockIterator == _edits.end()) return true;
+		for(std::vector<EEPROMByteEdit>::iterator i = blockIterator->second.begin(); i != blockIterator->second.end(); ++i)
+		{
+			uint8_t& currentByte = data.at(i->address - blockIndex);
+			currentByte = (currentByte & ~i->clearMask) | i->value;
+		}
+		return true;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return false;
+}
+
+}
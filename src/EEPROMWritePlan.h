@@ -0,0 +1,113 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef EEPROMWRITEPLAN_H_
+#define EEPROMWRITEPLAN_H_
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace HMWired
+{
+
+/**
+ * A masked write into a single byte of the EEPROM: data = (data & ~clearMask) | value.
+ */
+class EEPROMByteEdit
+{
+public:
+	int32_t address = 0;
+	uint8_t clearMask = 0;
+	uint8_t value = 0;
+};
+
+/**
+ * Collects the EEPROM edits of several parameters before anything is read from or written to the device. The "byte.bit" encoded
+ * indexes and sizes of the device description are resolved to absolute byte addresses once, so the plan knows all blocks it
+ * touches up front. Those blocks can then be fetched in one pass, edited in memory and persisted and written exactly once.
+ */
+class EEPROMWritePlan
+{
+public:
+	EEPROMWritePlan() {}
+	virtual ~EEPROMWritePlan() {}
+
+	/**
+	 * Adds the edits needed to store a parameter to the plan.
+	 *
+	 * @param id The parameter's ID. Only used for logging and "explain".
+	 * @param index The parameter's EEPROM index in "byte.bit" notation.
+	 * @param size The parameter's size in "byte.bit" notation.
+	 * @param binaryValue The value in packet format.
+	 * @return Returns false, when the parameter can't be mapped to the EEPROM.
+	 */
+	bool addParameter(const std::string& id, double index, double size, std::vector<uint8_t> binaryValue);
+
+	bool empty() { return _edits.empty(); }
+	uint32_t parameterCount() { return _parameters.size(); }
+	const std::vector<std::string>& parameters() { return _parameters; }
+
+	/**
+	 * Returns the number of block writes needed when the parameters are stored one after another.
+	 */
+	uint32_t sequentialBlockWrites() { return _sequentialBlockWrites; }
+
+	/**
+	 * Returns the start addresses of all 16 byte blocks touched by the plan in ascending order.
+	 */
+	std::set<int32_t> blocks();
+
+	/**
+	 * Applies all edits of the plan to one block.
+	 *
+	 * @param blockIndex The start address of the block.
+	 * @param data The block's data. Must be 16 bytes long.
+	 * @return Returns false, when "data" has the wrong size.
+	 */
+	bool apply(int32_t blockIndex, std::vector<uint8_t>& data);
+protected:
+	uint32_t _bitmask[9] = {0xFF, 0x01, 0x03, 0x07, 0x0F, 0x1F, 0x3F, 0x7F, 0xFF};
+
+	std::vector<std::string> _parameters;
+	uint32_t _sequentialBlockWrites = 0;
+
+	/**
+	 * The edits sorted by block start address.
+	 */
+	std::map<int32_t, std::vector<EEPROMByteEdit>> _edits;
+
+	void addEdit(std::vector<EEPROMByteEdit>& edits, int32_t address, uint8_t clearMask, uint8_t value);
+};
+
+}
+
+#endif /* EEPROMWRITEPLAN_H_ */
@@ -0,0 +1,316 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "EventCoalescer.h"
+#include "HMWiredPeer.h"
+#include "GD.h"
+
+namespace HMWired
+{
+
+EventCoalescer::EventCoalescer()
+{
+	try
+	{
+		_disposing = false;
+		_stopWorkerThread = false;
+		GD::bl->threadManager.start(_workerThread, false, &EventCoalescer::worker, this);
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+EventCoalescer::~EventCoalescer()
+{
+	if(!_disposing) dispose();
+	GD::bl->threadManager.join(_workerThread);
+}
+
+void EventCoalescer::dispose()
+{
+	try
+	{
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			if(_disposing) return;
+			_disposing = true;
+			_stopWorkerThread = true;
+		}
+		_workerConditionVariable.notify_all();
+		GD::bl->threadManager.join(_workerThread);
+		raiseDue(0);
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+uint64_t EventCoalescer::merge(Channel& channel, std::shared_ptr<std::vector<std::string>>& valueKeys, std::shared_ptr<std::vector<BaseLib::PVariable>>& values)
+{
+	if(!channel.valueKeys || !channel.values)
+	{
+		channel.valueKeys = valueKeys;
+		channel.values = values;
+		return 0;
+	}
+	uint64_t replaced = 0;
+	for(uint32_t i = 0; i < valueKeys->size() && i < values->size(); i++)
+	{
+		std::vector<std::string>::iterator keyIterator = std::find(channel.valueKeys->begin(), channel.valueKeys->end(), valueKeys->at(i));
+		if(keyIterator == channel.valueKeys->end())
+		{
+			channel.valueKeys->push_back(valueKeys->at(i));
+			channel.values->push_back(values->at(i));
+		}
+		else
+		{
+			channel.values->at(std::distance(channel.valueKeys->begin(), keyIterator)) = values->at(i);
+			replaced++;
+		}
+	}
+	return replaced;
+}
+
+bool EventCoalescer::add(std::shared_ptr<HMWiredPeer> peer, uint32_t channel, Mode mode, int32_t window, std::shared_ptr<std::vector<std::string>>& valueKeys, std::shared_ptr<std::vector<BaseLib::PVariable>>& values)
+{
+	try
+	{
+		if(!peer || !valueKeys || !values) return true;
+		int64_t time = BaseLib::HelperFunctions::getTime();
+		bool raiseNow = false;
+		uint64_t replaced = 0;
+		uint32_t pending = 0;
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			if(_disposing || mode == Mode::none || window <= 0) raiseNow = true;
+			else
+			{
+				Channel& pendingChannel = _channels[std::make_pair(peer->getID(), channel)];
+				pendingChannel.peer = peer;
+				if(mode == Mode::minInterval && pendingChannel.due == 0 && time - pendingChannel.lastRaised >= window)
+				{
+					pendingChannel.lastRaised = time;
+					raiseNow = true;
+				}
+				else
+				{
+					replaced = merge(pendingChannel, valueKeys, values);
+					if(pendingChannel.due == 0) _pending++;
+					if(mode == Mode::lastValue) pendingChannel.due = time + window;
+					else if(pendingChannel.due == 0) pendingChannel.due = pendingChannel.lastRaised + window;
+				}
+			}
+			pending = _pending;
+			if(!raiseNow) _workerConditionVariable.notify_one();
+		}
+
+		std::lock_guard<std::mutex> statsGuard(_statsMutex);
+		_stats.received++;
+		if(raiseNow) _stats.raisedDirectly++;
+		_stats.replacedValues += replaced;
+		if(pending > _stats.maxPending) _stats.maxPending = pending;
+		return raiseNow;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return true;
+}
+
+void EventCoalescer::takePending(uint64_t peerId, uint32_t channel, std::shared_ptr<std::vector<std::string>>& valueKeys, std::shared_ptr<std::vector<BaseLib::PVariable>>& values)
+{
+	try
+	{
+		if(!valueKeys || !values) return;
+		uint64_t replaced = 0;
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			std::map<std::pair<uint64_t, uint32_t>, Channel>::iterator channelIterator = _channels.find(std::make_pair(peerId, channel));
+			if(channelIterator == _channels.end()) return;
+			Channel& pendingChannel = channelIterator->second;
+			pendingChannel.lastRaised = BaseLib::HelperFunctions::getTime();
+			if(pendingChannel.due == 0) return;
+			replaced = merge(pendingChannel, valueKeys, values);
+			valueKeys = pendingChannel.valueKeys;
+			values = pendingChannel.values;
+			pendingChannel.valueKeys.reset();
+			pendingChannel.values.reset();
+			pendingChannel.due = 0;
+			_pending--;
+		}
+
+		std::lock_guard<std::mutex> statsGuard(_statsMutex);
+		_stats.replacedValues += replaced;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void EventCoalescer::discard(uint64_t peerId)
+{
+	try
+	{
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		std::map<std::pair<uint64_t, uint32_t>, Channel>::iterator i = _channels.lower_bound(std::make_pair(peerId, (uint32_t)0));
+		while(i != _channels.end() && i->first.first == peerId)
+		{
+			if(i->second.due != 0) _pending--;
+			i = _channels.erase(i);
+		}
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+uint32_t EventCoalescer::size()
+{
+	std::lock_guard<std::mutex> queueGuard(_queueMutex);
+	return _pending;
+}
+
+EventCoalescerStats EventCoalescer::getStats()
+{
+	std::lock_guard<std::mutex> statsGuard(_statsMutex);
+	return _stats;
+}
+
+void EventCoalescer::raiseDue(int64_t time)
+{
+	try
+	{
+		std::vector<std::pair<uint32_t, Channel>> dueChannels;
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			if(_pending == 0) return;
+			int64_t now = BaseLib::HelperFunctions::getTime();
+			for(std::map<std::pair<uint64_t, uint32_t>, Channel>::iterator i = _channels.begin(); i != _channels.end(); ++i)
+			{
+				if(i->second.due == 0) continue;
+				if(time == 0 || i->second.due <= time)
+				{
+					dueChannels.push_back(std::make_pair(i->first.second, i->second));
+					i->second.valueKeys.reset();
+					i->second.values.reset();
+					i->second.due = 0;
+					i->second.lastRaised = now;
+					_pending--;
+				}
+			}
+		}
+
+		uint64_t raised = 0;
+		for(std::vector<std::pair<uint32_t, Channel>>::iterator i = dueChannels.begin(); i != dueChannels.end(); ++i)
+		{
+			std::shared_ptr<HMWiredPeer> peer = i->second.peer.lock();
+			if(!peer || peer->deleting) continue;
+			peer->raiseCoalescedEvent(i->first, i->second.valueKeys, i->second.values);
+			raised++;
+		}
+
+		if(raised > 0)
+		{
+			std::lock_guard<std::mutex> statsGuard(_statsMutex);
+			_stats.raisedDelayed += raised;
+		}
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void EventCoalescer::worker()
+{
+	try
+	{
+		while(!_stopWorkerThread)
+		{
+			{
+				std::unique_lock<std::mutex> queueGuard(_queueMutex);
+				int64_t nextDue = 0;
+				for(std::map<std::pair<uint64_t, uint32_t>, Channel>::iterator i = _channels.begin(); i != _channels.end(); ++i)
+				{
+					if(i->second.due != 0 && (nextDue == 0 || i->second.due < nextDue)) nextDue = i->second.due;
+				}
+				if(_stopWorkerThread) return;
+				//add() notifies while holding the queue mutex, so no event queued after the check above gets lost
+				if(nextDue == 0) _workerConditionVariable.wait(queueGuard);
+				else
+				{
+					int64_t waitingTime = nextDue - BaseLib::HelperFunctions::getTime();
+					if(waitingTime > 0) _workerConditionVariable.wait_for(queueGuard, std::chrono::milliseconds(waitingTime));
+				}
+			}
+			if(_stopWorkerThread) return;
+			raiseDue(BaseLib::HelperFunctions::getTime());
+		}
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+}
@@ -0,0 +1,165 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef EVENTCOALESCER_H_
+#define EVENTCOALESCER_H_
+
+#include <homegear-base/BaseLib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace HMWired
+{
+class HMWiredPeer;
+
+class EventCoalescerStats
+{
+public:
+	/**
+	 * Events passed to the coalescer by the peers.
+	 */
+	uint64_t received = 0;
+
+	/**
+	 * Events raised right away.
+	 */
+	uint64_t raisedDirectly = 0;
+
+	/**
+	 * Events raised by the background thread after their window ended.
+	 */
+	uint64_t raisedDelayed = 0;
+
+	/**
+	 * Values replaced by a newer value of the same parameter before they were raised.
+	 */
+	uint64_t replacedValues = 0;
+	uint64_t maxPending = 0;
+};
+
+/**
+ * Coalesces the events of chatty input channels. The mode and window are set per channel with the configuration parameters
+ * EVENT_COALESCE_MODE and EVENT_COALESCE_WINDOW. With MIN_INTERVAL the first event is raised right away and later events are
+ * held back until the window since the last event ended. With LAST_VALUE every event restarts the window and the values are
+ * raised once the channel was quiet for the whole window. In both modes only the last value of a parameter is raised.
+ */
+class EventCoalescer
+{
+public:
+	enum class Mode : int32_t
+	{
+		none = 0,
+		minInterval = 1,
+		lastValue = 2
+	};
+
+	EventCoalescer();
+	virtual ~EventCoalescer();
+
+	/**
+	 * Stops the background thread and raises all pending events.
+	 */
+	void dispose();
+
+	/**
+	 * Passes the event of a channel to the coalescer.
+	 *
+	 * @param window The coalescing window in milliseconds.
+	 * @return Returns true, when the caller needs to raise the event right away. Otherwise the values were queued.
+	 */
+	bool add(std::shared_ptr<HMWiredPeer> peer, uint32_t channel, Mode mode, int32_t window, std::shared_ptr<std::vector<std::string>>& valueKeys, std::shared_ptr<std::vector<BaseLib::PVariable>>& values);
+
+	/**
+	 * Merges an event, which needs to be raised right away (e. g. because it contains an action), with the pending values of the
+	 * channel. The pending values are dropped from the queue.
+	 *
+	 * @param valueKeys Set to the merged keys.
+	 * @param values Set to the merged values.
+	 */
+	void takePending(uint64_t peerId, uint32_t channel, std::shared_ptr<std::vector<std::string>>& valueKeys, std::shared_ptr<std::vector<BaseLib::PVariable>>& values);
+
+	/**
+	 * Drops the pending events of a peer.
+	 */
+	void discard(uint64_t peerId);
+
+	uint32_t size();
+	EventCoalescerStats getStats();
+protected:
+	class Channel
+	{
+	public:
+		std::weak_ptr<HMWiredPeer> peer;
+		int64_t lastRaised = 0;
+
+		/**
+		 * The time the pending values are due or 0, when there are none.
+		 */
+		int64_t due = 0;
+		std::shared_ptr<std::vector<std::string>> valueKeys;
+		std::shared_ptr<std::vector<BaseLib::PVariable>> values;
+	};
+
+	std::atomic_bool _disposing;
+	std::atomic_bool _stopWorkerThread;
+	std::thread _workerThread;
+	std::condition_variable _workerConditionVariable;
+
+	std::mutex _queueMutex;
+	std::map<std::pair<uint64_t, uint32_t>, Channel> _channels;
+	uint32_t _pending = 0;
+
+	std::mutex _statsMutex;
+	EventCoalescerStats _stats;
+
+	/**
+	 * Merges values into the pending values of a channel. Newer values of a parameter replace the older ones.
+	 *
+	 * @return Returns the number of replaced values.
+	 */
+	uint64_t merge(Channel& channel, std::shared_ptr<std::vector<std::string>>& valueKeys, std::shared_ptr<std::vector<BaseLib::PVariable>>& values);
+
+	/**
+	 * Raises the pending events due at "time". Raises all pending events when "time" is 0.
+	 */
+	void raiseDue(int64_t time);
+	void worker();
+};
+
+}
+
+#endif /* EVENTCOALESCER_H_ */
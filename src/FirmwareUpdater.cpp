@@ -0,0 +1,342 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "FirmwareUpdater.h"
+#include "HMWiredCentral.h"
+#include "GD.h"
+
+#include <fstream>
+
+namespace HMWired
+{
+
+void FirmwareCheckpoint::serialize(BaseLib::SharedObjects* bl, std::vector<uint8_t>& encodedData)
+{
+	BaseLib::BinaryEncoder encoder(bl);
+	encoder.encodeInteger(encodedData, firmwareVersion);
+	encoder.encodeInteger(encodedData, (int32_t)imageHash);
+	encoder.encodeInteger(encodedData, blockSize);
+	encoder.encodeInteger(encodedData, address);
+}
+
+void FirmwareCheckpoint::unserialize(BaseLib::SharedObjects* bl, std::shared_ptr<std::vector<char>> serializedData)
+{
+	address = -1;
+	if(!serializedData || serializedData->size() < 16) return;
+	BaseLib::BinaryDecoder decoder(bl);
+	uint32_t position = 0;
+	firmwareVersion = decoder.decodeInteger(*serializedData, position);
+	imageHash = (uint32_t)decoder.decodeInteger(*serializedData, position);
+	blockSize = decoder.decodeInteger(*serializedData, position);
+	address = decoder.decodeInteger(*serializedData, position);
+}
+
+std::string FirmwareUpdateStats::toString()
+{
+	std::string result = std::to_string(blocks) + " blocks in " + std::to_string(duration) + " ms";
+	if(duration > 0) result += " (" + std::to_string(blocks * 1000 / duration) + " blocks/s)";
+	result += ", " + std::to_string(retransmissions) + " retransmissions";
+	if(resumedAt > -1) result += ", resumed at 0x" + BaseLib::HelperFunctions::getHexString(resumedAt, 4);
+	return result;
+}
+
+FirmwareUpdater::FirmwareUpdater(HMWiredCentral* central, std::shared_ptr<HMWiredPeer> peer) : _central(central), _peer(peer)
+{
+}
+
+static int32_t getHexNibble(char c)
+{
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+int32_t FirmwareUpdater::loadImage(const std::string& filename, std::vector<uint8_t>& image, std::string& error)
+{
+	try
+	{
+		image.clear();
+		std::ifstream file(filename);
+		if(!file.is_open())
+		{
+			error = "Could not open firmware file.";
+			return 4;
+		}
+		std::string line;
+		std::vector<uint8_t> record;
+		record.reserve(64);
+		int32_t currentAddress = 0;
+		while(std::getline(file, line))
+		{
+			if(!line.empty() && line.back() == '\r') line.pop_back();
+			if(line.empty()) continue;
+			if(line.at(0) != ':' || line.size() < 11 || (line.size() & 1) == 0)
+			{
+				error = "Wrong format (no colon at position 0 or wrong line length).";
+				return 5;
+			}
+			//Decode the whole record (byte count, address, record type, data and check sum) in one pass
+			record.clear();
+			uint8_t checkSum = 0;
+			for(uint32_t i = 1; i + 1 < line.size(); i += 2)
+			{
+				int32_t high = getHexNibble(line[i]);
+				int32_t low = getHexNibble(line[i + 1]);
+				if(high < 0 || low < 0)
+				{
+					error = "Wrong format (invalid character).";
+					return 5;
+				}
+				record.push_back((uint8_t)((high << 4) | low));
+				checkSum += record.back();
+			}
+			int32_t bytes = record.at(0);
+			if((signed)record.size() != bytes + 5)
+			{
+				error = "Wrong format (byte count does not match).";
+				return 5;
+			}
+			if(checkSum != 0)
+			{
+				error = "Wrong format (check sum failed).";
+				return 5;
+			}
+			int32_t recordType = record.at(3);
+			if(recordType == 1) return 0; //End of file
+			if(recordType != 0)
+			{
+				error = "Wrong format (wrong record type).";
+				return 5;
+			}
+			int32_t address = (record.at(1) << 8) | record.at(2);
+			if(address != currentAddress)
+			{
+				error = "Wrong format (address does not match).";
+				return 5;
+			}
+			currentAddress += bytes;
+			image.insert(image.end(), record.begin() + 4, record.begin() + 4 + bytes);
+		}
+		return 0;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    error = "Unknown error.";
+    return 4;
+}
+
+uint32_t FirmwareUpdater::getImageHash(const std::vector<uint8_t>& image)
+{
+	uint32_t hash = 2166136261;
+	for(std::vector<uint8_t>::const_iterator i = image.begin(); i != image.end(); ++i) hash = (hash ^ *i) * 16777619;
+	return hash;
+}
+
+std::shared_ptr<HMWiredPacket> FirmwareUpdater::sendBootloaderPacket(std::vector<uint8_t>& payload)
+{
+	try
+	{
+		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, 0, _peer->getAddress(), false, _messageCounter++, 0, 0, payload));
+		for(int32_t i = 0; i < _retries; i++)
+		{
+			if(i > 0) _stats.retransmissions++;
+			std::shared_ptr<HMWiredPacket> response = _central->getBootloaderResponse(packet, _responseTimeout);
+			if(response) return response;
+		}
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return std::shared_ptr<HMWiredPacket>();
+}
+
+bool FirmwareUpdater::enterBootloader()
+{
+	try
+	{
+		std::shared_ptr<HMWiredPacket> response = _central->getResponse(0x75, _peer->getAddress(), true);
+		if(!response || response->type() != HMWiredPacketType::ackMessage) return false;
+
+		//Wait for the device to enter bootloader
+		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+int32_t FirmwareUpdater::getBlockSize()
+{
+	try
+	{
+		std::vector<uint8_t> payload{ 0x75 };
+		std::shared_ptr<HMWiredPacket> response = sendBootloaderPacket(payload);
+		if(!response || response->type() != HMWiredPacketType::system) return 0;
+
+		payload.at(0) = 0x70;
+		response = sendBootloaderPacket(payload);
+		if(!response || response->type() != HMWiredPacketType::system || response->payload().size() != 2) return 0;
+		int32_t blockSize = (response->payload().at(0) << 8) + response->payload().at(1);
+		return (blockSize > 128) ? 0 : blockSize;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return 0;
+}
+
+int32_t FirmwareUpdater::update(const std::vector<uint8_t>& image, int32_t firmwareVersion, std::string& message)
+{
+	FirmwareCheckpoint checkpoint;
+	try
+	{
+		_stats = FirmwareUpdateStats();
+		_messageCounter = _central->getMessageCounter(_peer->getAddress());
+		uint32_t imageHash = getImageHash(image);
+		int32_t blockSize = 0;
+		int32_t startAddress = 0;
+
+		FirmwareCheckpoint savedCheckpoint = _peer->getFirmwareCheckpoint();
+		if(!savedCheckpoint.empty() && savedCheckpoint.firmwareVersion == firmwareVersion && savedCheckpoint.imageHash == imageHash && savedCheckpoint.address < (signed)image.size())
+		{
+			//A device whose update was interrupted is still waiting in its bootloader
+			blockSize = getBlockSize();
+			if(blockSize == savedCheckpoint.blockSize)
+			{
+				startAddress = savedCheckpoint.address;
+				_stats.resumedAt = startAddress;
+				GD::out.printInfo("Info: Resuming firmware update of peer " + std::to_string(_peer->getID()) + " at address 0x" + BaseLib::HelperFunctions::getHexString(startAddress, 4) + ".");
+			}
+			else blockSize = 0;
+		}
+		if(blockSize == 0)
+		{
+			if(!enterBootloader())
+			{
+				message = "Device did not respond to enter-bootloader packet.";
+				return 6;
+			}
+			blockSize = getBlockSize();
+			if(blockSize == 0)
+			{
+				message = "Too many communication errors (block size request failed).";
+				return 8;
+			}
+		}
+
+		checkpoint.firmwareVersion = firmwareVersion;
+		checkpoint.imageHash = imageHash;
+		checkpoint.blockSize = blockSize;
+		checkpoint.address = _stats.resumedAt;
+
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::vector<uint8_t> data;
+		data.reserve(blockSize + 4);
+		uint32_t blocksSinceCheckpoint = 0;
+		for(int32_t i = startAddress; i < (signed)image.size(); i += blockSize)
+		{
+			_central->setUpdateProgress(_peer->getPhysicalInterfaceId(), _peer->getID(), (i * 100) / image.size());
+			int32_t currentBlockSize = (i + blockSize < (signed)image.size()) ? blockSize : image.size() - i;
+			data.clear();
+			data.push_back(0x77); //Type
+			data.push_back(i >> 8); //Address
+			data.push_back(i & 0xFF); //Address
+			data.push_back(currentBlockSize); //Length
+			data.insert(data.end(), image.begin() + i, image.begin() + i + currentBlockSize);
+
+			std::shared_ptr<HMWiredPacket> response = sendBootloaderPacket(data);
+			int32_t receivedBytes = -1;
+			if(response && response->type() == HMWiredPacketType::system && response->payload().size() == 2) receivedBytes = (response->payload().at(0) << 8) + response->payload().at(1);
+			if(receivedBytes != currentBlockSize)
+			{
+				_stats.duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+				if(!checkpoint.empty()) _peer->setFirmwareCheckpoint(checkpoint);
+				message = receivedBytes == -1 ? "Too many communication errors." : "Too many communication errors (device received wrong number of bytes).";
+				return 8;
+			}
+			_stats.blocks++;
+			checkpoint.address = i;
+			if(++blocksSinceCheckpoint >= _checkpointInterval)
+			{
+				blocksSinceCheckpoint = 0;
+				_peer->setFirmwareCheckpoint(checkpoint);
+			}
+		}
+		_stats.duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+		std::vector<uint8_t> payload{ 0x67 };
+		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, 0, _peer->getAddress(), false, _messageCounter++, 0, 0, payload));
+		for(int32_t i = 0; i < 3; i++)
+		{
+			_central->sendPacket(packet, false);
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		}
+		_peer->setFirmwareCheckpoint(FirmwareCheckpoint());
+
+		message = "Update successful.";
+		return 0;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    if(!checkpoint.empty()) _peer->setFirmwareCheckpoint(checkpoint);
+    message = "Unknown error.";
+    return 1;
+}
+
+}
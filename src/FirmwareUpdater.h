@@ -0,0 +1,177 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef FIRMWAREUPDATER_H_
+#define FIRMWAREUPDATER_H_
+
+#include <homegear-base/BaseLib.h>
+#include "HMWiredPacket.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace HMWired
+{
+class HMWiredCentral;
+class HMWiredPeer;
+
+/**
+ * Progress of an interrupted firmware update. Stored as peer variable, so the update can be resumed after a restart.
+ */
+class FirmwareCheckpoint
+{
+public:
+	int32_t firmwareVersion = 0;
+	uint32_t imageHash = 0;
+	int32_t blockSize = 0;
+
+	/**
+	 * Address of the last block acknowledged by the bootloader or -1.
+	 */
+	int32_t address = -1;
+
+	bool empty() { return address < 0; }
+	void serialize(BaseLib::SharedObjects* bl, std::vector<uint8_t>& encodedData);
+	void unserialize(BaseLib::SharedObjects* bl, std::shared_ptr<std::vector<char>> serializedData);
+};
+
+/**
+ * A parsed firmware file.
+ */
+class FirmwareImage
+{
+public:
+	/**
+	 * The result code of FirmwareUpdater::loadImage().
+	 */
+	int32_t result = 0;
+	std::string error;
+	std::vector<uint8_t> data;
+};
+
+/**
+ * Parsed firmware files by device type and firmware version. Used to parse every file only once when updating many peers.
+ */
+typedef std::map<std::pair<uint32_t, int32_t>, std::shared_ptr<FirmwareImage>> FirmwareImages;
+
+class FirmwareUpdateStats
+{
+public:
+	uint32_t blocks = 0;
+	uint32_t retransmissions = 0;
+
+	/**
+	 * Address the update was resumed at or -1.
+	 */
+	int32_t resumedAt = -1;
+
+	/**
+	 * Time spent sending the blocks in milliseconds.
+	 */
+	int64_t duration = 0;
+
+	std::string toString();
+};
+
+/**
+ * Transfers a firmware image to the bootloader of a peer. The bus needs to be locked by the caller.
+ *
+ * The bootloader acknowledges every block, so blocks are still sent one by one. But instead of going through
+ * HMWiredCentral::sendPacket() with its bus arbitration, every block is sent as soon as the interface's response delay allows
+ * and the response is polled every millisecond. Every 16 blocks and on errors the address of the last acknowledged block is
+ * saved, so an update of a device still waiting in its bootloader continues there instead of at address 0.
+ */
+class FirmwareUpdater
+{
+public:
+	FirmwareUpdater(HMWiredCentral* central, std::shared_ptr<HMWiredPeer> peer);
+	virtual ~FirmwareUpdater() {}
+
+	/**
+	 * Reads and validates an Intel HEX file.
+	 *
+	 * @param filename The file to read.
+	 * @param image Set to the binary image.
+	 * @param error Set to the reason when the file couldn't be read.
+	 * @return Returns the result code for BaseLib's deviceUpdateInfo: 0 on success, 4 when the file couldn't be opened and 5 when it has a wrong format.
+	 */
+	static int32_t loadImage(const std::string& filename, std::vector<uint8_t>& image, std::string& error);
+
+	/**
+	 * Returns the FNV-1a hash of an image. Used to check that a checkpoint belongs to the image.
+	 */
+	static uint32_t getImageHash(const std::vector<uint8_t>& image);
+
+	/**
+	 * Writes the image and starts the new firmware.
+	 *
+	 * @param message Set to the result message.
+	 * @return Returns the result code for BaseLib's deviceUpdateInfo: 0 on success, 6 when the device didn't enter the bootloader and 8 on communication errors.
+	 */
+	int32_t update(const std::vector<uint8_t>& image, int32_t firmwareVersion, std::string& message);
+
+	FirmwareUpdateStats& getStats() { return _stats; }
+protected:
+	HMWiredCentral* _central = nullptr;
+	std::shared_ptr<HMWiredPeer> _peer;
+	uint8_t _messageCounter = 0;
+	FirmwareUpdateStats _stats;
+
+	/**
+	 * Number of blocks after which the checkpoint is saved.
+	 */
+	const uint32_t _checkpointInterval = 16;
+
+	/**
+	 * Time to wait for the bootloader's response in milliseconds.
+	 */
+	const int32_t _responseTimeout = 100;
+	const int32_t _retries = 5;
+
+	/**
+	 * Sends a packet to the bootloader and retries it until it is answered.
+	 *
+	 * @return Returns the response or nullptr.
+	 */
+	std::shared_ptr<HMWiredPacket> sendBootloaderPacket(std::vector<uint8_t>& payload);
+	bool enterBootloader();
+
+	/**
+	 * Checks that the bootloader is running and requests its block size.
+	 *
+	 * @return Returns the block size or 0 on errors.
+	 */
+	int32_t getBlockSize();
+};
+
+}
+
+#endif /* FIRMWAREUPDATER_H_ */
@@ -0,0 +1,530 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "FrameDecoder.h"
+#include "HMWiredPeer.h"
+#include "GD.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace HMWired
+{
+
+std::mutex FrameDecoder::_decodersMutex;
+std::map<HomegearDevice*, std::weak_ptr<FrameDecoder>> FrameDecoder::_decoders;
+
+FrameDecoder::FrameDecoder(PHomegearDevice rpcDevice)
+{
+	_rpcDevice = rpcDevice;
+	_decodedFrames = 0;
+	_decodeTime = 0;
+	compile();
+}
+
+std::shared_ptr<FrameDecoder> FrameDecoder::get(PHomegearDevice rpcDevice)
+{
+	try
+	{
+		if(!rpcDevice) return std::shared_ptr<FrameDecoder>();
+		std::lock_guard<std::mutex> decodersGuard(_decodersMutex);
+		std::map<HomegearDevice*, std::weak_ptr<FrameDecoder>>::iterator decoderIterator = _decoders.find(rpcDevice.get());
+		if(decoderIterator != _decoders.end())
+		{
+			std::shared_ptr<FrameDecoder> decoder = decoderIterator->second.lock();
+			if(decoder && decoder->getRpcDevice() == rpcDevice) return decoder;
+		}
+
+		//Remove the entries of decoders no peer uses anymore, e.g. after the device descriptions were reloaded
+		for(std::map<HomegearDevice*, std::weak_ptr<FrameDecoder>>::iterator i = _decoders.begin(); i != _decoders.end();)
+		{
+			if(i->second.expired()) i = _decoders.erase(i);
+			else ++i;
+		}
+		std::shared_ptr<FrameDecoder> decoder(new FrameDecoder(rpcDevice));
+		_decoders[rpcDevice.get()] = decoder;
+		return decoder;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return std::shared_ptr<FrameDecoder>();
+}
+
+std::vector<std::shared_ptr<FrameDecoder>> FrameDecoder::getAll()
+{
+	std::vector<std::shared_ptr<FrameDecoder>> decoders;
+	try
+	{
+		std::lock_guard<std::mutex> decodersGuard(_decodersMutex);
+		for(std::map<HomegearDevice*, std::weak_ptr<FrameDecoder>>::iterator i = _decoders.begin(); i != _decoders.end(); ++i)
+		{
+			std::shared_ptr<FrameDecoder> decoder = i->second.lock();
+			if(decoder) decoders.push_back(decoder);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return decoders;
+}
+
+void FrameDecoder::compile()
+{
+	try
+	{
+		if(!_rpcDevice || _rpcDevice->functions.empty()) return;
+		_maxChannel = _rpcDevice->functions.rbegin()->first;
+		_selectorChannels.resize(_maxChannel + 1, false);
+		for(Functions::iterator i = _rpcDevice->functions.begin(); i != _rpcDevice->functions.end(); ++i)
+		{
+			if(i->second->parameterGroupSelector && !i->second->alternativeFunctions.empty())
+			{
+				_selectorChannels[i->first] = true;
+				_hasSelectors = true;
+			}
+			addSlots(i->second->getParameterGroup(ParameterGroup::Type::Enum::variables));
+			for(std::vector<PFunction>::iterator j = i->second->alternativeFunctions.begin(); j != i->second->alternativeFunctions.end(); ++j)
+			{
+				addSlots((*j)->getParameterGroup(ParameterGroup::Type::Enum::variables));
+			}
+		}
+
+		for(PacketsByMessageType::iterator i = _rpcDevice->packetsByMessageType.begin(); i != _rpcDevice->packetsByMessageType.end(); ++i)
+		{
+			PPacket frame(i->second);
+			if(!frame || i->first == 0) continue;
+			FrameDecoderEntry entry;
+			entry.frame = frame;
+			entry.direction = frame->direction;
+			if(frame->subtype > -1 && frame->subtypeIndex >= 9)
+			{
+				entry.subtypePayloadIndex = frame->subtypeIndex - 9;
+				entry.subtype = frame->subtype;
+			}
+			if(frame->channelIndex >= 9)
+			{
+				entry.channelPayloadIndex = frame->channelIndex - 9;
+				entry.channelIndexOffset = frame->channelIndexOffset;
+				if(frame->channelSize < 1.0) entry.channelMask = 0xFF >> (8 - std::lround(frame->channelSize * 10) % 10);
+			}
+			entry.fixedChannel = frame->channel;
+
+			//Parameters with the same ID share one value. IDs are numbered in alphabetical order to keep the order of the raised events.
+			std::map<std::string, uint32_t> valueIndexes;
+			for(std::vector<PParameter>::iterator j = frame->associatedVariables.begin(); j != frame->associatedVariables.end(); ++j)
+			{
+				valueIndexes[(*j)->id] = 0;
+			}
+			for(std::map<std::string, uint32_t>::iterator j = valueIndexes.begin(); j != valueIndexes.end(); ++j)
+			{
+				j->second = entry.valueCount++;
+			}
+
+			for(BinaryPayloads::iterator j = frame->binaryPayloads.begin(); j != frame->binaryPayloads.end(); ++j)
+			{
+				FrameDecoderPayload payload;
+				compilePayload(frame, *j, payload);
+				for(std::vector<PParameter>::iterator k = frame->associatedVariables.begin(); k != frame->associatedVariables.end(); ++k)
+				{
+					if((*k)->physical->groupId != (*j)->parameterId) continue;
+					FrameDecoderParameter parameter;
+					parameter.parameter = *k;
+					parameter.parameterSetType = (*k)->parent()->type();
+					parameter.valueIndex = valueIndexes[(*k)->id];
+					if(parameter.parameterSetType == ParameterGroup::Type::Enum::variables) parameter.slot = getSlot((*k)->id);
+					parameter.channels.resize(_maxChannel + 1, false);
+					for(Functions::iterator l = _rpcDevice->functions.begin(); l != _rpcDevice->functions.end(); ++l)
+					{
+						if(_selectorChannels[l->first]) continue;
+						PParameterGroup parameterGroup = l->second->getParameterGroup(parameter.parameterSetType);
+						if(parameterGroup && parameterGroup->getParameter((*k)->id)) parameter.channels[l->first] = true;
+					}
+					payload.parameters.push_back(parameter);
+				}
+				entry.payloads.push_back(payload);
+			}
+			_entries[i->first].push_back(entry);
+			_entryCount++;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void FrameDecoder::addSlots(PParameterGroup parameterGroup)
+{
+	try
+	{
+		if(!parameterGroup) return;
+		for(Parameters::iterator i = parameterGroup->parameters.begin(); i != parameterGroup->parameters.end(); ++i)
+		{
+			if(_slots.find(i->first) != _slots.end()) continue;
+			uint32_t slot = _slots.size();
+			_slots[i->first] = slot;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void FrameDecoder::compilePayload(PPacket frame, PBinaryPayload binaryPayload, FrameDecoderPayload& payload)
+{
+	try
+	{
+		payload.index = binaryPayload->index;
+		payload.size = binaryPayload->size;
+		if(binaryPayload->size > 0 && binaryPayload->index > 0)
+		{
+			if(binaryPayload->constValueInteger > -1)
+			{
+				payload.checkConst = true;
+				payload.constValue = binaryPayload->constValueInteger;
+			}
+			if(binaryPayload->index < 9)
+			{
+				payload.header = true;
+				return;
+			}
+			//Same calculations as in HMWiredPacket::getPosition()
+			double index = binaryPayload->index - 9;
+			double byteIndex = std::floor(index);
+			payload.payloadIndex = byteIndex;
+			if(byteIndex != index || binaryPayload->size < 0.8) //0.8 == 8 Bits
+			{
+				payload.bitLevel = true;
+				if(binaryPayload->size > 1)
+				{
+					GD::out.printError("Error: Partial byte index > 1 requested in frame " + frame->id + ".");
+					payload.shift = 0;
+					payload.mask = 0;
+					return;
+				}
+				uint32_t bitSize = std::lround(binaryPayload->size * 10);
+				if(bitSize > 8) bitSize = 8;
+				payload.shift = std::lround(index * 10) % 10;
+				payload.mask = bitSize == 0 ? 0xFF : (uint8_t)(0xFF >> (8 - bitSize));
+			}
+			else
+			{
+				payload.bytes = (uint32_t)std::ceil(binaryPayload->size);
+				uint32_t bitSize = std::lround(binaryPayload->size * 10) % 10;
+				if(bitSize > 8) bitSize = 8;
+				if(payload.bytes == 0) payload.bytes = 1; //size is 0 - assume 1
+				payload.mask = bitSize == 0 ? 0xFF : (uint8_t)(0xFF >> (8 - bitSize));
+			}
+		}
+		else if(binaryPayload->constValueInteger > -1)
+		{
+			payload.isConst = true;
+			GD::bl->hf.memcpyBigEndian(payload.constData, binaryPayload->constValueInteger);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void FrameDecoder::getValue(FrameDecoderPayload& payload, std::shared_ptr<HMWiredPacket>& packet, std::vector<uint8_t>& data)
+{
+	if(payload.header)
+	{
+		data = packet->getPosition(payload.index, payload.size, -1);
+		return;
+	}
+	std::vector<uint8_t>& packetPayload = packet->payload();
+	data.clear();
+	if(payload.payloadIndex >= (signed)packetPayload.size())
+	{
+		data.push_back(0);
+		return;
+	}
+	if(payload.bitLevel)
+	{
+		data.push_back((packetPayload[payload.payloadIndex] >> payload.shift) & payload.mask);
+		return;
+	}
+	data.reserve(payload.bytes);
+	data.push_back(packetPayload[payload.payloadIndex] & payload.mask);
+	for(uint32_t i = 1; i < payload.bytes; i++)
+	{
+		if(payload.payloadIndex + i >= packetPayload.size()) data.push_back(0);
+		else data.push_back(packetPayload[payload.payloadIndex + i]);
+	}
+}
+
+bool FrameDecoder::hasParameter(HMWiredPeer* peer, FrameDecoderParameter& parameter, int32_t channel)
+{
+	if(channel < 0 || channel > _maxChannel) return false;
+	if(!_selectorChannels[channel]) return parameter.channels[channel];
+	return peer && peer->channelHasParameter(channel, parameter.parameterSetType, parameter.parameter->id);
+}
+
+void FrameDecoder::decode(HMWiredPeer* peer, int32_t address, std::shared_ptr<HMWiredPacket>& packet, std::vector<FrameValues>& frameValues)
+{
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	decodeFrames(peer, address, packet, frameValues);
+	_decodeTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+	_decodedFrames++;
+}
+
+void FrameDecoder::decodeFrames(HMWiredPeer* peer, int32_t address, std::shared_ptr<HMWiredPacket>& packet, std::vector<FrameValues>& frameValues)
+{
+	try
+	{
+		if(!packet || packet->payload().empty() || packet->messageType() == 0) return;
+		std::unordered_map<uint32_t, std::vector<FrameDecoderEntry>>::iterator entriesIterator = _entries.find(packet->messageType());
+		if(entriesIterator == _entries.end()) return;
+		std::vector<uint8_t>& packetPayload = packet->payload();
+		std::vector<uint8_t> data;
+		for(std::vector<FrameDecoderEntry>::iterator i = entriesIterator->second.begin(); i != entriesIterator->second.end(); ++i)
+		{
+			if(i->direction == Packet::Direction::Enum::toCentral && packet->senderAddress() != address) continue;
+			if(i->direction == Packet::Direction::Enum::fromCentral && packet->destinationAddress() != address) continue;
+			if(i->subtypePayloadIndex > -1 && (signed)packetPayload.size() > i->subtypePayloadIndex && packetPayload[i->subtypePayloadIndex] != i->subtype) continue;
+			int32_t channel = -1;
+			if(i->channelPayloadIndex > -1 && (signed)packetPayload.size() > i->channelPayloadIndex) channel = packetPayload[i->channelPayloadIndex] - i->channelIndexOffset;
+			if(channel > -1 && i->channelMask > -1) channel &= i->channelMask;
+			if(i->fixedChannel > -1) channel = i->fixedChannel;
+
+			FrameValues currentFrameValues;
+			currentFrameValues.frame = i->frame;
+			currentFrameValues.values.resize(i->valueCount);
+			bool hasValues = false;
+			for(std::vector<FrameDecoderPayload>::iterator j = i->payloads.begin(); j != i->payloads.end(); ++j)
+			{
+				if(j->isConst) data = j->constData;
+				else if(j->header || j->payloadIndex > -1)
+				{
+					if(j->payloadIndex >= (signed)packetPayload.size()) continue;
+					getValue(*j, packet, data);
+					if(j->checkConst)
+					{
+						int32_t intValue = 0;
+						for(std::vector<uint8_t>::iterator k = data.begin(); k != data.end(); ++k)
+						{
+							intValue = (intValue << 8) | *k;
+						}
+						if(intValue != j->constValue) break; else continue;
+					}
+				}
+				else continue;
+
+				for(std::vector<FrameDecoderParameter>::iterator k = j->parameters.begin(); k != j->parameters.end(); ++k)
+				{
+					currentFrameValues.parameterSetType = k->parameterSetType;
+					FrameValue& value = currentFrameValues.values[k->valueIndex];
+					bool setValues = false;
+					if(currentFrameValues.paramsetChannels.empty()) //Fill paramsetChannels
+					{
+						int32_t startChannel = (channel < 0) ? 0 : channel;
+						int32_t endChannel;
+						//When fixedChannel is -2 (means '*') cycle through all channels
+						if(i->fixedChannel == -2)
+						{
+							startChannel = 0;
+							endChannel = _maxChannel;
+						}
+						else endChannel = startChannel;
+						for(int32_t l = startChannel; l <= endChannel; l++)
+						{
+							if(!hasParameter(peer, *k, l)) continue;
+							currentFrameValues.paramsetChannels.push_back(l);
+							value.channels.push_back(l);
+							setValues = true;
+						}
+					}
+					else //Use paramsetChannels
+					{
+						for(std::vector<uint32_t>::iterator l = currentFrameValues.paramsetChannels.begin(); l != currentFrameValues.paramsetChannels.end(); ++l)
+						{
+							if(!hasParameter(peer, *k, *l)) continue;
+							value.channels.push_back(*l);
+							setValues = true;
+						}
+					}
+					if(setValues)
+					{
+						value.parameter = k->parameter;
+						value.slot = k->slot;
+						value.value = data;
+						hasValues = true;
+					}
+				}
+			}
+			if(!hasValues) continue;
+			//Remove the values of parameters not set by this packet
+			std::vector<FrameValue>::iterator end = std::remove_if(currentFrameValues.values.begin(), currentFrameValues.values.end(), [](const FrameValue& value) { return !value.parameter; });
+			currentFrameValues.values.erase(end, currentFrameValues.values.end());
+			frameValues.push_back(std::move(currentFrameValues));
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+std::shared_ptr<HMWiredPacket> FrameDecoder::buildPacket(HMWiredPeer* peer, int32_t address, uint32_t messageType, FrameDecoderEntry& entry)
+{
+	std::vector<uint8_t> payload(1, (uint8_t)messageType);
+	if(entry.frame->length > 9) payload.resize(entry.frame->length - 9, 0);
+	if(entry.subtypePayloadIndex > -1)
+	{
+		if(entry.subtypePayloadIndex >= (signed)payload.size()) payload.resize(entry.subtypePayloadIndex + 1, 0);
+		payload.at(entry.subtypePayloadIndex) = entry.subtype;
+	}
+	if(entry.channelPayloadIndex > -1)
+	{
+		//Use the first channel having one of the frame's parameters, so the packet is decoded like a real one
+		int32_t channel = 0;
+		bool channelFound = false;
+		for(int32_t i = 0; i <= _maxChannel && !channelFound; i++)
+		{
+			for(std::vector<FrameDecoderPayload>::iterator j = entry.payloads.begin(); j != entry.payloads.end() && !channelFound; ++j)
+			{
+				for(std::vector<FrameDecoderParameter>::iterator k = j->parameters.begin(); k != j->parameters.end(); ++k)
+				{
+					if(!hasParameter(peer, *k, i)) continue;
+					channel = i;
+					channelFound = true;
+					break;
+				}
+			}
+		}
+		if(entry.channelPayloadIndex >= (signed)payload.size()) payload.resize(entry.channelPayloadIndex + 1, 0);
+		payload.at(entry.channelPayloadIndex) = (uint8_t)(channel + entry.channelIndexOffset);
+	}
+	for(std::vector<FrameDecoderPayload>::iterator i = entry.payloads.begin(); i != entry.payloads.end(); ++i)
+	{
+		if(i->header || i->payloadIndex < 0) continue;
+		if(i->payloadIndex + i->bytes > payload.size()) payload.resize(i->payloadIndex + i->bytes, 0);
+		//Constant payloads get their constant, all others the default value of their parameter
+		std::vector<uint8_t> data;
+		if(i->checkConst) GD::bl->hf.memcpyBigEndian(data, i->constValue);
+		else if(!i->parameters.empty())
+		{
+			PParameter parameter = i->parameters.front().parameter;
+			parameter->convertToPacket(parameter->logical->getDefaultValue(), Role(), data);
+		}
+		if(data.empty()) continue;
+		if(i->bitLevel)
+		{
+			payload.at(i->payloadIndex) &= ~(uint8_t)(i->mask << i->shift);
+			payload.at(i->payloadIndex) |= (data.back() & i->mask) << i->shift;
+			continue;
+		}
+		//Right align the value like HMWiredPacket::setPosition()
+		for(uint32_t l = 0; l < i->bytes && l < data.size(); l++)
+		{
+			payload.at(i->payloadIndex + i->bytes - l - 1) = data.at(data.size() - l - 1);
+		}
+	}
+	return std::shared_ptr<HMWiredPacket>(new HMWiredPacket(HMWiredPacketType::iMessage, address, 1, false, 0, 0, 0, payload));
+}
+
+int64_t FrameDecoder::benchmark(HMWiredPeer* peer, uint32_t iterations, uint64_t& frameCount, uint64_t& valueCount)
+{
+	frameCount = 0;
+	valueCount = 0;
+	try
+	{
+		if(!peer) return 0;
+		int32_t address = peer->getAddress();
+		std::vector<std::shared_ptr<HMWiredPacket>> packets;
+		for(std::unordered_map<uint32_t, std::vector<FrameDecoderEntry>>::iterator i = _entries.begin(); i != _entries.end(); ++i)
+		{
+			for(std::vector<FrameDecoderEntry>::iterator j = i->second.begin(); j != i->second.end(); ++j)
+			{
+				if(j->direction != Packet::Direction::Enum::toCentral) continue;
+				packets.push_back(buildPacket(peer, address, i->first, *j));
+			}
+		}
+		if(packets.empty()) return 0;
+
+		std::vector<FrameValues> frameValues;
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < iterations; i++)
+		{
+			for(std::vector<std::shared_ptr<HMWiredPacket>>::iterator j = packets.begin(); j != packets.end(); ++j)
+			{
+				frameValues.clear();
+				decodeFrames(peer, address, *j, frameValues);
+				frameCount++;
+				for(std::vector<FrameValues>::iterator k = frameValues.begin(); k != frameValues.end(); ++k)
+				{
+					valueCount += k->values.size();
+				}
+			}
+		}
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return 0;
+}
+
+}
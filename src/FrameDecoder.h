@@ -0,0 +1,221 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef FRAMEDECODER_H_
+#define FRAMEDECODER_H_
+
+#include <homegear-base/BaseLib.h>
+#include "HMWiredPacket.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace BaseLib::DeviceDescription;
+
+namespace HMWired
+{
+class HMWiredPeer;
+
+class FrameValue
+{
+public:
+	PParameter parameter;
+
+	//The parameter's value slot or -1 when the parameter is not a variable
+	int32_t slot = -1;
+	std::vector<uint32_t> channels;
+	std::vector<uint8_t> value;
+};
+
+class FrameValues
+{
+public:
+	PPacket frame;
+	std::vector<uint32_t> paramsetChannels;
+	ParameterGroup::Type::Enum parameterSetType = ParameterGroup::Type::Enum::none;
+	std::vector<FrameValue> values;
+};
+
+/**
+ * A parameter filled by a binary payload of a frame.
+ */
+class FrameDecoderParameter
+{
+public:
+	PParameter parameter;
+	ParameterGroup::Type::Enum parameterSetType = ParameterGroup::Type::Enum::none;
+
+	//Index into FrameValues::values. Parameters with the same ID share one value.
+	uint32_t valueIndex = 0;
+
+	//The parameter's value slot or -1 when the parameter is not a variable
+	int32_t slot = -1;
+
+	/**
+	 * Indexed by channel. True when the channel's parameter group contains the parameter. Only valid for channels without parameter group selector.
+	 */
+	std::vector<bool> channels;
+};
+
+/**
+ * A binary payload of a frame with its "byte.bit" index and size resolved to a byte position, shift and mask.
+ */
+class FrameDecoderPayload
+{
+public:
+	//Payload positions below 9 address the packet header and are read with HMWiredPacket::getPosition()
+	bool header = false;
+	double index = 0;
+	double size = 0;
+
+	int32_t payloadIndex = -1;
+	bool bitLevel = false;
+	uint32_t shift = 0;
+	uint8_t mask = 0xFF;
+	uint32_t bytes = 1;
+
+	//Set, when the frame only matches, when this payload equals constValue
+	bool checkConst = false;
+	int32_t constValue = -1;
+
+	//Set, when the payload has no position and always has the value constData
+	bool isConst = false;
+	std::vector<uint8_t> constData;
+
+	std::vector<FrameDecoderParameter> parameters;
+};
+
+class FrameDecoderEntry
+{
+public:
+	PPacket frame;
+	Packet::Direction::Enum direction = Packet::Direction::Enum::none;
+	int32_t subtypePayloadIndex = -1;
+	uint8_t subtype = 0;
+	int32_t channelPayloadIndex = -1;
+	int32_t channelIndexOffset = 0;
+	int32_t channelMask = -1;
+	int32_t fixedChannel = -1;
+	std::vector<FrameDecoderPayload> payloads;
+
+	//Number of distinct parameter IDs filled by this frame
+	uint32_t valueCount = 0;
+};
+
+/**
+ * Decode table of one device description. The frames of the description are compiled once into one table per message type, so
+ * decoding a received packet is a single pass over a small array without parsing "byte.bit" positions or looking up parameters by name.
+ */
+class FrameDecoder
+{
+public:
+	FrameDecoder(PHomegearDevice rpcDevice);
+	virtual ~FrameDecoder() {}
+
+	/**
+	 * Returns the decoder of a device description. Decoders are compiled on first use and shared by all peers of the same type. The
+	 * caller needs to keep the returned pointer as long as it uses the decoder.
+	 */
+	static std::shared_ptr<FrameDecoder> get(PHomegearDevice rpcDevice);
+	static std::vector<std::shared_ptr<FrameDecoder>> getAll();
+
+	PHomegearDevice getRpcDevice() { return _rpcDevice; }
+	uint32_t entryCount() { return _entryCount; }
+	uint64_t decodedFrames() { return _decodedFrames; }
+	uint64_t decodeTime() { return _decodeTime; }
+
+	/**
+	 * Returns true, when the parameter group of the channel depends on a parameter group selector.
+	 */
+	bool hasSelector(int32_t channel) { return channel >= 0 && channel < (signed)_selectorChannels.size() && _selectorChannels[channel]; }
+	bool hasSelectors() { return _hasSelectors; }
+
+	/**
+	 * Returns the slot of a variable. All IDs of the variables of the device description are numbered when the decoder is compiled.
+	 *
+	 * @param id The ID of the variable.
+	 * @return Returns the slot or -1 when the ID is unknown.
+	 */
+	int32_t getSlot(const std::string& id) { std::unordered_map<std::string, uint32_t>::iterator slotIterator = _slots.find(id); return slotIterator == _slots.end() ? -1 : slotIterator->second; }
+	uint32_t slotCount() { return _slots.size(); }
+
+	/**
+	 * Decodes a packet.
+	 *
+	 * @param peer The peer the packet belongs to. Used to resolve the parameter groups of channels with a parameter group selector.
+	 * @param address The peer's address.
+	 * @param packet The packet to decode.
+	 * @param frameValues The values of all matching frames are appended to this vector.
+	 */
+	void decode(HMWiredPeer* peer, int32_t address, std::shared_ptr<HMWiredPacket>& packet, std::vector<FrameValues>& frameValues);
+
+	/**
+	 * Builds one packet per frame sent to the central from the device description and decodes all of them repeatedly. The packets
+	 * address a channel having the frame's parameters and contain the parameters' default values.
+	 *
+	 * @param peer A peer using this decoder.
+	 * @param iterations How often to decode all packets.
+	 * @param frameCount Set to the number of decoded packets.
+	 * @param valueCount Set to the number of decoded values.
+	 * @return Returns the time needed in microseconds.
+	 */
+	int64_t benchmark(HMWiredPeer* peer, uint32_t iterations, uint64_t& frameCount, uint64_t& valueCount);
+protected:
+	static std::mutex _decodersMutex;
+	/**
+	 * The decoders are owned by the peers using them, so a decoder is freed with the last peer of its device description. A decoder
+	 * keeps its device description alive, so the address of a device description can't be reused while its entry is valid.
+	 */
+	static std::map<HomegearDevice*, std::weak_ptr<FrameDecoder>> _decoders;
+
+	PHomegearDevice _rpcDevice;
+	std::unordered_map<uint32_t, std::vector<FrameDecoderEntry>> _entries;
+	std::vector<bool> _selectorChannels;
+	bool _hasSelectors = false;
+	std::unordered_map<std::string, uint32_t> _slots;
+	int32_t _maxChannel = -1;
+	uint32_t _entryCount = 0;
+	std::atomic<uint64_t> _decodedFrames;
+	std::atomic<uint64_t> _decodeTime;
+
+	void compile();
+	void addSlots(PParameterGroup parameterGroup);
+	void decodeFrames(HMWiredPeer* peer, int32_t address, std::shared_ptr<HMWiredPacket>& packet, std::vector<FrameValues>& frameValues);
+	void compilePayload(PPacket frame, PBinaryPayload binaryPayload, FrameDecoderPayload& payload);
+	void getValue(FrameDecoderPayload& payload, std::shared_ptr<HMWiredPacket>& packet, std::vector<uint8_t>& data);
+	bool hasParameter(HMWiredPeer* peer, FrameDecoderParameter& parameter, int32_t channel);
+	std::shared_ptr<HMWiredPacket> buildPacket(HMWiredPeer* peer, int32_t address, uint32_t messageType, FrameDecoderEntry& entry);
+};
+
+}
+
+#endif /* FRAMEDECODER_H_ */
@@ -34,5 +34,7 @@ namespace HMWired
 	BaseLib::SharedObjects* GD::bl = nullptr;
 	HMWired* GD::family = nullptr;
 	std::shared_ptr<IHMWiredInterface> GD::physicalInterface;
+	std::map<std::string, std::shared_ptr<IHMWiredInterface>> GD::physicalInterfaces;
+	std::shared_ptr<PersistenceQueue> GD::persistenceQueue;
 	BaseLib::Output GD::out;
 }
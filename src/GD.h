@@ -36,6 +36,7 @@
 #include <homegear-base/BaseLib.h>
 #include "HMWired.h"
 #include "PhysicalInterfaces/IHMWiredInterface.h"
+#include "PersistenceQueue.h"
 
 namespace HMWired
 {
@@ -47,7 +48,17 @@ public:
 
 	static BaseLib::SharedObjects* bl;
 	static HMWired* family;
+
+	/**
+	 * The default interface. Used for peers, which are not bound to an interface.
+	 */
 	static std::shared_ptr<IHMWiredInterface> physicalInterface;
+
+	/**
+	 * All interfaces mapped by their ID.
+	 */
+	static std::map<std::string, std::shared_ptr<IHMWiredInterface>> physicalInterfaces;
+	static std::shared_ptr<PersistenceQueue> persistenceQueue;
 	static BaseLib::Output out;
 private:
 	GD();
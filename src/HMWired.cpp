@@ -45,6 +45,8 @@ HMWired::HMWired(BaseLib::SharedObjects* bl, BaseLib::Systems::IFamilyEventSink*
 	GD::out.setPrefix("Module HomeMatic Wired: ");
 	GD::out.printDebug("Debug: Loading module...");
 	_physicalInterfaces.reset(new Interfaces(bl, _settings->getPhysicalInterfaceSettings()));
+	loadSettings();
+	createPersistenceQueue();
 }
 
 HMWired::~HMWired()
@@ -55,9 +57,92 @@ HMWired::~HMWired()
 void HMWired::dispose()
 {
 	if(_disposed) return;
+	//Write all queued values before the peers are disposed. Values saved afterwards are written directly.
+	std::shared_ptr<HMWiredCentral> central = std::dynamic_pointer_cast<HMWiredCentral>(_central);
+	if(central) central->savePeerMessageCounters();
+	if(GD::persistenceQueue)
+	{
+		GD::persistenceQueue->dispose();
+		GD::persistenceQueue.reset();
+	}
 	DeviceFamily::dispose();
 
 	GD::physicalInterface.reset();
+	GD::physicalInterfaces.clear();
+}
+
+void HMWired::loadSettings()
+{
+	try
+	{
+		std::string changeFilter = _settings->getString("changefilter");
+		BaseLib::HelperFunctions::toLower(BaseLib::HelperFunctions::trim(changeFilter));
+		if(!changeFilter.empty()) _changeFilter = (changeFilter == "true");
+
+		//Actions like PRESS_SHORT carry no state, so they are always raised. Additional parameters can be added here.
+		std::string alwaysEmit = _settings->getString("alwaysemit");
+		std::vector<std::string> parameterIds = BaseLib::HelperFunctions::splitAll(alwaysEmit, ',');
+		for(std::vector<std::string>::iterator i = parameterIds.begin(); i != parameterIds.end(); ++i)
+		{
+			BaseLib::HelperFunctions::toUpper(BaseLib::HelperFunctions::trim(*i));
+			if(!i->empty()) _alwaysEmit.insert(*i);
+		}
+		GD::out.printDebug("Debug: Change filter is " + std::string(_changeFilter ? "enabled" : "disabled") + ". " + std::to_string(_alwaysEmit.size()) + " additional parameters are always raised.");
+
+		std::string duplicateWindow = _settings->getString("duplicatewindow");
+		if(!duplicateWindow.empty()) _duplicateWindow = BaseLib::Math::getNumber(duplicateWindow);
+		if(_duplicateWindow < 0) _duplicateWindow = 0;
+
+		std::string livenessProbe = _settings->getString("livenessprobe");
+		BaseLib::HelperFunctions::toLower(BaseLib::HelperFunctions::trim(livenessProbe));
+		if(!livenessProbe.empty()) _lightweightLiveness = (livenessProbe != "values");
+		std::string livenessInterval = _settings->getString("livenessinterval");
+		if(!livenessInterval.empty()) _livenessInterval = (int64_t)BaseLib::Math::getNumber(livenessInterval) * 1000;
+		if(_livenessInterval < 60000) _livenessInterval = 60000;
+
+		std::string maintenanceConcurrency = _settings->getString("maintenanceconcurrency");
+		if(!maintenanceConcurrency.empty()) _maintenanceConcurrency = BaseLib::Math::getNumber(maintenanceConcurrency);
+		if(_maintenanceConcurrency < 1) _maintenanceConcurrency = 1;
+		std::string maintenanceShare = _settings->getString("maintenanceshare");
+		if(!maintenanceShare.empty()) _maintenanceShare = BaseLib::Math::getNumber(maintenanceShare);
+		if(_maintenanceShare < 1) _maintenanceShare = 1;
+		else if(_maintenanceShare > 100) _maintenanceShare = 100;
+
+		std::string valueMaxAge = _settings->getString("valuemaxage");
+		if(!valueMaxAge.empty()) _valueMaxAge = BaseLib::Math::getNumber(valueMaxAge);
+		if(_valueMaxAge < 0) _valueMaxAge = 0;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void HMWired::createPersistenceQueue()
+{
+	try
+	{
+		std::string setting = _settings->getString("persistencewindow");
+		int32_t window = setting.empty() ? 1000 : BaseLib::Math::getNumber(setting);
+		if(window <= 0)
+		{
+			GD::out.printInfo("Info: Persistence queue is disabled. Values are written to the database directly.");
+			return;
+		}
+		GD::persistenceQueue.reset(new PersistenceQueue(window));
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
 }
 
 std::shared_ptr<BaseLib::Systems::ICentral> HMWired::initializeCentral(uint32_t deviceId, int32_t address, std::string serialNumber)
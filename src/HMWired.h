@@ -32,6 +32,8 @@
 
 #include <homegear-base/BaseLib.h>
 
+#include <unordered_set>
+
 using namespace BaseLib;
 
 namespace HMWired
@@ -46,7 +48,63 @@ public:
 	virtual void dispose();
 
 	virtual PVariable getPairingInfo();
+
+	/**
+	 * Returns true, when received values equal to the stored ones are neither persisted nor raised as events.
+	 */
+	bool changeFilterEnabled() { return _changeFilter; }
+
+	/**
+	 * Returns true, when a parameter needs to be raised as event even if its value didn't change.
+	 */
+	bool alwaysEmit(const std::string& parameterId) { return _alwaysEmit.find(parameterId) != _alwaysEmit.end(); }
+
+	/**
+	 * Returns the time in milliseconds within which a packet equal to the last packet of a peer is treated as retransmission. 0 disables the check.
+	 */
+	int32_t duplicateWindow() { return _duplicateWindow; }
+
+	/**
+	 * Returns true, when the reachability of a peer is checked with a single firmware version request instead of requesting all of
+	 * its values.
+	 */
+	bool lightweightLiveness() { return _lightweightLiveness; }
+
+	/**
+	 * Returns the time in milliseconds between two reachability checks of an unreachable peer.
+	 */
+	int64_t livenessInterval() { return _livenessInterval; }
+
+	/**
+	 * Returns the maximum number of reachability checks and value polls running on one bus at the same time.
+	 */
+	int32_t maintenanceConcurrency() { return _maintenanceConcurrency; }
+
+	/**
+	 * Returns the maximum share of the bus time in percent used by reachability checks and value polls.
+	 */
+	int32_t maintenanceShare() { return _maintenanceShare; }
+
+	/**
+	 * Returns the maximum age in milliseconds of a value received from a device to be returned instead of requesting it again. 0
+	 * disables the cache.
+	 */
+	int64_t valueMaxAge() { return _valueMaxAge; }
 protected:
+	bool _changeFilter = false;
+	std::unordered_set<std::string> _alwaysEmit;
+	int32_t _duplicateWindow = 1000;
+	bool _lightweightLiveness = true;
+	int64_t _livenessInterval = 600000;
+	int32_t _maintenanceConcurrency = 1;
+	int32_t _maintenanceShare = 10;
+	int64_t _valueMaxAge = 0;
+
+	/**
+	 * Reads the family settings from homematicwired.conf. Settings, which aren't set, keep their defaults.
+	 */
+	void loadSettings();
+	void createPersistenceQueue();
 	virtual void createCentral();
 	virtual std::shared_ptr<BaseLib::Systems::ICentral> initializeCentral(uint32_t deviceId, int32_t address, std::string serialNumber);
 };
@@ -29,6 +29,7 @@
 
 #include "HMWiredCentral.h"
 #include "GD.h"
+#include "PhysicalInterfaces/DiscoverySearch.h"
 
 #include <iomanip>
 
@@ -51,9 +52,6 @@ HMWiredCentral::~HMWiredCentral()
 	_updateFirmwareThreadMutex.lock();
 	_bl->threadManager.join(_updateFirmwareThread);
 	_updateFirmwareThreadMutex.unlock();
-	_announceThreadMutex.lock();
-	_bl->threadManager.join(_announceThread);
-	_announceThreadMutex.unlock();
 }
 
 void HMWiredCentral::dispose(bool wait)
@@ -63,10 +61,18 @@ void HMWiredCentral::dispose(bool wait)
 		if(_disposing) return;
 		_disposing = true;
 		GD::out.printDebug("Removing device " + std::to_string(_deviceId) + " from physical device's event queue...");
-		if(GD::physicalInterface) GD::physicalInterface->removeEventHandler(_physicalInterfaceEventhandlers[GD::physicalInterface->getID()]);
+		for(std::map<std::string, std::shared_ptr<BusState>>::iterator i = _buses.begin(); i != _buses.end(); ++i)
+		{
+			i->second->physicalInterface->removeEventHandler(_physicalInterfaceEventhandlers[i->first]);
+		}
+		if(_packetDispatcher) _packetDispatcher->dispose();
+		if(_pairingQueue) _pairingQueue->dispose();
+		if(_maintenanceScheduler) _maintenanceScheduler->dispose();
+		if(_eventCoalescer) _eventCoalescer->dispose();
 		_stopWorkerThread = true;
 		GD::out.printDebug("Debug: Waiting for worker thread of device " + std::to_string(_deviceId) + "...");
 		_bl->threadManager.join(_workerThread);
+		savePeerMessageCounters();
 	}
     catch(const std::exception& ex)
     {
@@ -85,13 +91,38 @@ void HMWiredCentral::init()
 		if(_initialized) return; //Prevent running init two times
 		_initialized = true;
 
-		if(GD::physicalInterface) _physicalInterfaceEventhandlers[GD::physicalInterface->getID()] = GD::physicalInterface->addEventHandler((BaseLib::Systems::IPhysicalInterface::IPhysicalInterfaceEventSink*)this);
+		std::map<std::string, std::shared_ptr<IHMWiredInterface>> physicalInterfaces = GD::physicalInterfaces;
+		if(GD::physicalInterface) physicalInterfaces[GD::physicalInterface->getID()] = GD::physicalInterface;
+		for(std::map<std::string, std::shared_ptr<IHMWiredInterface>>::iterator i = physicalInterfaces.begin(); i != physicalInterfaces.end(); ++i)
+		{
+			std::shared_ptr<BusState> bus = std::make_shared<BusState>();
+			bus->physicalInterface = i->second;
+			_buses[i->first] = bus;
+			if(i->second == GD::physicalInterface) _defaultBus = bus;
+			_physicalInterfaceEventhandlers[i->first] = i->second->addEventHandler((BaseLib::Systems::IPhysicalInterface::IPhysicalInterfaceEventSink*)this);
+		}
+
+		//Called with invokeFamilyMethod(), so link tools can create all their links with one call
+		_localRpcMethods.emplace("addLinks", [this](const BaseLib::PRpcClientInfo& clientInfo, const BaseLib::PArray& parameters)
+		{
+			if(parameters->size() != 1) return Variable::createError(-1, "Wrong parameter count.");
+			return addLinks(clientInfo, parameters->at(0));
+		});
 
 		_messageCounter[0] = 0; //Broadcast message counter
 		_stopWorkerThread = false;
 		_pairing = false;
 		_updateMode = false;
 
+		_packetDispatcher.reset(new PacketDispatcher(this));
+		std::vector<std::string> interfaceIds;
+		for(std::map<std::string, std::shared_ptr<BusState>>::iterator i = _buses.begin(); i != _buses.end(); ++i)
+		{
+			interfaceIds.push_back(i->first);
+		}
+		_pairingQueue.reset(new PairingQueue(this, interfaceIds));
+		_maintenanceScheduler.reset(new MaintenanceScheduler(this, interfaceIds, GD::family->maintenanceConcurrency(), GD::family->maintenanceShare()));
+		_eventCoalescer.reset(new EventCoalescer());
 		_bl->threadManager.start(_workerThread, true, _bl->settings.workerThreadPriority(), _bl->settings.workerThreadPolicy(), &HMWiredCentral::worker, this);
 	}
 	catch(const std::exception& ex)
@@ -191,6 +222,8 @@ void HMWiredCentral::loadPeers()
 			if(!peer->getSerialNumber().empty()) _peersBySerial[peer->getSerialNumber()] = peer;
 			_peersById[peerID] = peer;
 			_peersMutex.unlock();
+			//Only frames of registered peers are cached
+			getAckFrames(address);
 		}
 	}
 	catch(const std::exception& ex)
@@ -336,15 +369,58 @@ bool HMWiredCentral::onPacketReceived(std::string& senderID, std::shared_ptr<Bas
 		std::shared_ptr<HMWiredPacket> hmWiredPacket(std::dynamic_pointer_cast<HMWiredPacket>(packet));
 		if(!hmWiredPacket) return false;
 		if(GD::bl->debugLevel >= 4) std::cout << BaseLib::HelperFunctions::getTimeString(hmWiredPacket->getTimeReceived()) << " HomeMatic Wired packet received: " + hmWiredPacket->hexString() << std::endl;
-		_receivedPackets.set(hmWiredPacket->senderAddress(), hmWiredPacket, hmWiredPacket->getTimeReceived());
+		std::shared_ptr<BusState> bus = getBus(senderID);
 		std::shared_ptr<HMWiredPeer> peer(getPeer(hmWiredPacket->senderAddress()));
-		if(peer) peer->packetReceived(hmWiredPacket);
-		else if(hmWiredPacket->messageType() == 0x41 && !_pairing)
+		if(peer)
+		{
+			//Bind the peer to the interface it was last heard from before acknowledging, so the ACK is sent on the same bus
+			if(peer->getPhysicalInterface() != bus->physicalInterface)
+			{
+				GD::out.printInfo("Info: Peer " + std::to_string(peer->getID()) + " is now connected to interface \"" + senderID + "\".");
+				peer->setPhysicalInterfaceId(senderID);
+			}
+			if(peer->ignorePackets || hmWiredPacket->type() != HMWiredPacketType::iMessage || !peer->getRpcDevice())
+			{
+				bus->receivedPackets.set(hmWiredPacket->senderAddress(), hmWiredPacket, hmWiredPacket->getTimeReceived());
+				return false;
+			}
+			if(peer->isDuplicate(hmWiredPacket))
+			{
+				//Our ACK got lost or was too late. Acknowledge again, but don't process the packet twice.
+				_duplicates++;
+				if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Ignoring retransmitted packet of peer " + std::to_string(peer->getID()) + ".");
+				bus->receivedPackets.set(hmWiredPacket->senderAddress(), hmWiredPacket, hmWiredPacket->getTimeReceived());
+				if(hmWiredPacket->destinationAddress() == _address) sendOK(hmWiredPacket->senderMessageCounter(), hmWiredPacket->senderAddress(), hmWiredPacket->getTimeReceived());
+				return false;
+			}
+			//Send the ACK from the receiving thread, so it isn't delayed by the processing of earlier packets
+			bool acknowledged = hmWiredPacket->destinationAddress() == _address;
+			//Responses to pending requests are picked up by sendPacket() directly. The packet is queued before it is stored for
+			//sendPacket(), so sendPacket() can wait until its values are processed. Queueing never waits, so the ACK isn't delayed.
+			//Packets are never processed here while the dispatcher runs, because they would overtake older queued packets.
+			if(_packetDispatcher && !_packetDispatcher->push(hmWiredPacket, acknowledged))
+			{
+				//Queue full or disposing. The packet isn't acknowledged, so the device sends it again. The retransmission must not be
+				//taken for a duplicate then.
+				peer->forgetLastPacket();
+				return false;
+			}
+			bus->receivedPackets.set(hmWiredPacket->senderAddress(), hmWiredPacket, hmWiredPacket->getTimeReceived());
+			if(acknowledged) sendOK(hmWiredPacket->senderMessageCounter(), hmWiredPacket->senderAddress(), hmWiredPacket->getTimeReceived());
+			if(!_packetDispatcher) peer->packetReceived(hmWiredPacket, acknowledged);
+			return false;
+		}
+
+		bus->receivedPackets.set(hmWiredPacket->senderAddress(), hmWiredPacket, hmWiredPacket->getTimeReceived());
+		if(hmWiredPacket->senderAddress() != 0)
 		{
-			_announceThreadMutex.lock();
-			_bl->threadManager.join(_announceThread);
-			_bl->threadManager.start(_announceThread, false, &HMWiredCentral::handleAnnounce, this, hmWiredPacket);
-			_announceThreadMutex.unlock();
+			{
+				std::lock_guard<std::mutex> addressInterfacesGuard(_addressInterfacesMutex);
+				_addressInterfaces[hmWiredPacket->senderAddress()] = senderID;
+			}
+			//Announces are queued during a search, too. The search reserves the addresses it pairs with beginPeerInit(), so
+			//handleAnnounce() skips them.
+			if(hmWiredPacket->messageType() == 0x41 && _pairingQueue) _pairingQueue->push(senderID, hmWiredPacket);
 		}
 	}
 	catch(const std::exception& ex)
@@ -358,6 +434,24 @@ bool HMWiredCentral::onPacketReceived(std::string& senderID, std::shared_ptr<Bas
     return false;
 }
 
+void HMWiredCentral::dispatchPacket(std::shared_ptr<HMWiredPacket> packet, bool acknowledged)
+{
+	try
+	{
+		//Also called while disposing, so packets acknowledged before aren't lost
+		std::shared_ptr<HMWiredPeer> peer(getPeer(packet->senderAddress()));
+		if(peer) peer->packetReceived(packet, acknowledged);
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
 void HMWiredCentral::deletePeer(uint64_t id)
 {
 	try
@@ -399,6 +493,12 @@ void HMWiredCentral::deletePeer(uint64_t id)
         }
         if(i == 600) GD::out.printError("Error: Peer deletion took too long.");
 
+		if(GD::persistenceQueue) GD::persistenceQueue->discard(id);
+		if(_eventCoalescer) _eventCoalescer->discard(id);
+		{
+			std::lock_guard<std::mutex> ackFramesGuard(_ackFramesMutex);
+			_ackFrames.erase(peer->getAddress());
+		}
 		peer->deleteFromDatabase();
 
 		GD::out.printMessage("Removed HomeMatic Wired peer " + std::to_string(peer->getID()));
@@ -413,34 +513,69 @@ void HMWiredCentral::deletePeer(uint64_t id)
     }
 }
 
+std::shared_ptr<BusState> HMWiredCentral::getBus(const std::string& interfaceId)
+{
+	std::map<std::string, std::shared_ptr<BusState>>::iterator busIterator = _buses.find(interfaceId);
+	if(busIterator != _buses.end()) return busIterator->second;
+	return _defaultBus;
+}
+
+std::shared_ptr<BusState> HMWiredCentral::getBus(int32_t address)
+{
+	try
+	{
+		std::shared_ptr<HMWiredPeer> peer = getPeer(address);
+		if(peer) return getBus(peer->getPhysicalInterfaceId());
+		std::lock_guard<std::mutex> addressInterfacesGuard(_addressInterfacesMutex);
+		std::unordered_map<int32_t, std::string>::iterator addressIterator = _addressInterfaces.find(address);
+		if(addressIterator != _addressInterfaces.end()) return getBus(addressIterator->second);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return _defaultBus;
+}
+
 std::shared_ptr<HMWiredPacket> HMWiredCentral::sendPacket(std::shared_ptr<HMWiredPacket> packet, bool resend, bool systemResponse)
+{
+	return sendPacket(getBus(packet->destinationAddress()), packet, resend, systemResponse);
+}
+
+std::shared_ptr<HMWiredPacket> HMWiredCentral::sendPacket(std::shared_ptr<BusState> bus, std::shared_ptr<HMWiredPacket> packet, bool resend, bool systemResponse)
 {
 	try
 	{
+		if(!bus) return std::shared_ptr<HMWiredPacket>();
+		std::shared_ptr<IHMWiredInterface> physicalInterface = bus->physicalInterface;
 		//First check if communication is in progress
 		int64_t time = BaseLib::HelperFunctions::getTime();
-		uint32_t busWaitingTime = GD::physicalInterface->getBusWaitingTime();
+		uint32_t busWaitingTime = physicalInterface->getBusWaitingTime();
 		std::shared_ptr<HMWiredPacketInfo> rxPacketInfo;
-		std::shared_ptr<HMWiredPacketInfo> txPacketInfo = _sentPackets.getInfo(packet->destinationAddress());
+		std::shared_ptr<HMWiredPacketInfo> txPacketInfo = bus->sentPackets.getInfo(packet->destinationAddress());
 		int64_t timeDifference = 0;
 		if(txPacketInfo) timeDifference = time - txPacketInfo->time;
 		//ACKs should always be sent immediately
-		if(packet->type() != HMWiredPacketType::ackMessage && !GD::physicalInterface->autoResend() && (!txPacketInfo || timeDifference > 210))
+		if(packet->type() != HMWiredPacketType::ackMessage && !physicalInterface->autoResend() && (!txPacketInfo || timeDifference > 210))
 		{
-			rxPacketInfo = _receivedPackets.getInfo(packet->destinationAddress());
+			rxPacketInfo = bus->receivedPackets.getInfo(packet->destinationAddress());
 			int64_t rxTimeDifference = 0;
 			if(rxPacketInfo) rxTimeDifference = time - rxPacketInfo->time;
 			if(!rxPacketInfo || rxTimeDifference > 50)
 			{
 				//Communication might be in progress. Wait a little
-				if(_bl->debugLevel > 4 && (time - GD::physicalInterface->lastPacketSent() < 210 || time - GD::physicalInterface->lastPacketReceived() < 210)) GD::out.printDebug("Debug: HomeMatic Wired Device 0x" + BaseLib::HelperFunctions::getHexString(_deviceId) + ": Waiting for RS485 bus to become free... (Packet: " + packet->hexString() + ")");
-				if(GD::physicalInterface->getFastSending())
+				if(_bl->debugLevel > 4 && (time - physicalInterface->lastPacketSent() < 210 || time - physicalInterface->lastPacketReceived() < 210)) GD::out.printDebug("Debug: HomeMatic Wired Device 0x" + BaseLib::HelperFunctions::getHexString(_deviceId) + ": Waiting for RS485 bus to become free... (Packet: " + packet->hexString() + ")");
+				if(physicalInterface->getFastSending())
 				{
-					while(time - GD::physicalInterface->lastPacketSent() < busWaitingTime || time - GD::physicalInterface->lastPacketReceived() < busWaitingTime)
+					while(time - physicalInterface->lastPacketSent() < busWaitingTime || time - physicalInterface->lastPacketReceived() < busWaitingTime)
 					{
 						std::this_thread::sleep_for(std::chrono::milliseconds(20));
 						time = BaseLib::HelperFunctions::getTime();
-						if(time - GD::physicalInterface->lastPacketSent() >= busWaitingTime && time - GD::physicalInterface->lastPacketReceived() >= busWaitingTime)
+						if(time - physicalInterface->lastPacketSent() >= busWaitingTime && time - physicalInterface->lastPacketReceived() >= busWaitingTime)
 						{
 							int32_t sleepingTime = BaseLib::HelperFunctions::getRandomNumber(0, busWaitingTime / 2);
 							if(_bl->debugLevel > 4) GD::out.printDebug("Debug: HomeMatic Wired Device 0x" + BaseLib::HelperFunctions::getHexString(_deviceId) + ": RS485 bus is free now. Waiting randomly for " + std::to_string(sleepingTime) + "ms... (Packet: " + packet->hexString() + ")");
@@ -452,11 +587,11 @@ std::shared_ptr<HMWiredPacket> HMWiredCentral::sendPacket(std::shared_ptr<HMWire
 				}
 				else
 				{
-					while(time - GD::physicalInterface->lastPacketSent() < 210 || time - GD::physicalInterface->lastPacketReceived() < 210)
+					while(time - physicalInterface->lastPacketSent() < 210 || time - physicalInterface->lastPacketReceived() < 210)
 					{
 						std::this_thread::sleep_for(std::chrono::milliseconds(50));
 						time = BaseLib::HelperFunctions::getTime();
-						if(time - GD::physicalInterface->lastPacketSent() >= 210 && time - GD::physicalInterface->lastPacketReceived() >= 210)
+						if(time - physicalInterface->lastPacketSent() >= 210 && time - physicalInterface->lastPacketReceived() >= 210)
 						{
 							int32_t sleepingTime = BaseLib::HelperFunctions::getRandomNumber(0, 100);
 							if(_bl->debugLevel > 4) GD::out.printDebug("Debug: HomeMatic Wired Device 0x" + BaseLib::HelperFunctions::getHexString(_deviceId) + ": RS485 bus is free now. Waiting randomly for " + std::to_string(sleepingTime) + "ms... (Packet: " + packet->hexString() + ")");
@@ -470,8 +605,16 @@ std::shared_ptr<HMWiredPacket> HMWiredCentral::sendPacket(std::shared_ptr<HMWire
 			}
 		}
 		//RS485 bus should be free
-		uint32_t responseDelay = GD::physicalInterface->responseDelay();
-		_sentPackets.set(packet->destinationAddress(), packet);
+		uint32_t responseDelay = physicalInterface->responseDelay();
+		std::shared_ptr<HMWiredPeer> peer;
+		//Bootloader packets (sender address 0 or system responses) must be sent unchanged
+		if(packet->type() == HMWiredPacketType::iMessage && !systemResponse && packet->senderAddress() != 0)
+		{
+			//Message counters are saved lazily, so resynchronize instead of relying on the stored counter
+			peer = getPeer(packet->destinationAddress());
+			if(peer && peer->messageCounterUnsynchronized()) packet->setSynchronizationBit(true);
+		}
+		bus->sentPackets.set(packet->destinationAddress(), packet);
 		if(txPacketInfo)
 		{
 			timeDifference = time - txPacketInfo->time;
@@ -482,7 +625,7 @@ std::shared_ptr<HMWiredPacket> HMWiredCentral::sendPacket(std::shared_ptr<HMWire
 				time = BaseLib::HelperFunctions::getTime();
 			}
 		}
-		rxPacketInfo = _receivedPackets.getInfo(packet->destinationAddress());
+		rxPacketInfo = bus->receivedPackets.getInfo(packet->destinationAddress());
 		if(rxPacketInfo)
 		{
 			int64_t timeDifference = time - rxPacketInfo->time;
@@ -500,23 +643,25 @@ std::shared_ptr<HMWiredPacket> HMWiredCentral::sendPacket(std::shared_ptr<HMWire
 		else if(_bl->debugLevel > 4) GD::out.printDebug("Debug: Sending HomeMatic Wired packet " + packet->hexString() + " immediately, because it seems it is no response (no packet information found).", 7);
 
 		std::shared_ptr<HMWiredPacket> receivedPacket;
-		if(!GD::physicalInterface->autoResend() && resend)
+		if(!physicalInterface->autoResend() && resend)
 		{
-			if(GD::physicalInterface->getFastSending())
+			if(physicalInterface->getFastSending())
 			{
 				for(int32_t retries = 0; retries < 3; retries++)
 				{
 					int64_t time = BaseLib::HelperFunctions::getTime();
 					std::chrono::milliseconds sleepingTime(5);
-					if(retries > 0) _sentPackets.keepAlive(packet->destinationAddress());
-					GD::physicalInterface->sendPacket(packet);
+					if(retries > 0) bus->sentPackets.keepAlive(packet->destinationAddress());
+					physicalInterface->sendPacket(packet);
 					if(packet->type() == HMWiredPacketType::ackMessage) return std::shared_ptr<HMWiredPacket>();
 					for(int32_t i = 0; i < ((signed)busWaitingTime - 20) / 5; i++)
 					{
 						std::this_thread::sleep_for(sleepingTime);
-						receivedPacket = systemResponse ? _receivedPackets.get(0) : _receivedPackets.get(packet->destinationAddress());
+						receivedPacket = systemResponse ? bus->receivedPackets.get(0) : bus->receivedPackets.get(packet->destinationAddress());
 						if(receivedPacket && receivedPacket->getTimeReceived() >= time && receivedPacket->receiverMessageCounter() == packet->senderMessageCounter())
 						{
+							if(peer && packet->synchronizationBit()) peer->messageCounterSynchronized();
+							if(_packetDispatcher && !systemResponse) _packetDispatcher->waitForDispatch();
 							return receivedPacket;
 						}
 					}
@@ -528,37 +673,41 @@ std::shared_ptr<HMWiredPacket> HMWiredCentral::sendPacket(std::shared_ptr<HMWire
 				{
 					int64_t time = BaseLib::HelperFunctions::getTime();
 					std::chrono::milliseconds sleepingTime(5);
-					if(retries > 0) _sentPackets.keepAlive(packet->destinationAddress());
-					GD::physicalInterface->sendPacket(packet);
+					if(retries > 0) bus->sentPackets.keepAlive(packet->destinationAddress());
+					physicalInterface->sendPacket(packet);
 					if(packet->type() == HMWiredPacketType::ackMessage) return std::shared_ptr<HMWiredPacket>();
 					for(int32_t i = 0; i < 8; i++)
 					{
 						if(i == 5) sleepingTime = std::chrono::milliseconds(25);
 						std::this_thread::sleep_for(sleepingTime);
-						receivedPacket = systemResponse ? _receivedPackets.get(0) : _receivedPackets.get(packet->destinationAddress());
+						receivedPacket = systemResponse ? bus->receivedPackets.get(0) : bus->receivedPackets.get(packet->destinationAddress());
 						if(receivedPacket && receivedPacket->getTimeReceived() >= time && receivedPacket->receiverMessageCounter() == packet->senderMessageCounter())
 						{
+							if(peer && packet->synchronizationBit()) peer->messageCounterSynchronized();
+							if(_packetDispatcher && !systemResponse) _packetDispatcher->waitForDispatch();
 							return receivedPacket;
 						}
 					}
 				}
 			}
-			std::shared_ptr<HMWiredPeer> peer = getPeer(packet->destinationAddress());
+			if(!peer) peer = getPeer(packet->destinationAddress());
 			if(peer) peer->serviceMessages->setUnreach(true, false);
 		}
 		else
 		{
 			int64_t time = BaseLib::HelperFunctions::getTime();
 			std::chrono::milliseconds sleepingTime(5);
-			GD::physicalInterface->sendPacket(packet);
+			physicalInterface->sendPacket(packet);
 			if(packet->type() == HMWiredPacketType::ackMessage) return std::shared_ptr<HMWiredPacket>();
 			for(int32_t i = 0; i < 12; i++)
 			{
 				if(i == 5) sleepingTime = std::chrono::milliseconds(25);
 				std::this_thread::sleep_for(sleepingTime);
-				receivedPacket = systemResponse ? _receivedPackets.get(0) : _receivedPackets.get(packet->destinationAddress());
+				receivedPacket = systemResponse ? bus->receivedPackets.get(0) : bus->receivedPackets.get(packet->destinationAddress());
 				if(receivedPacket && receivedPacket->getTimeReceived() >= time && receivedPacket->receiverMessageCounter() == packet->senderMessageCounter())
 				{
+					if(peer && packet->synchronizationBit()) peer->messageCounterSynchronized();
+					if(_packetDispatcher && !systemResponse) _packetDispatcher->waitForDispatch();
 					return receivedPacket;
 				}
 			}
@@ -575,16 +724,17 @@ std::shared_ptr<HMWiredPacket> HMWiredCentral::sendPacket(std::shared_ptr<HMWire
     return std::shared_ptr<HMWiredPacket>();
 }
 
-void HMWiredCentral::lockBus()
+void HMWiredCentral::lockBus(const std::string& interfaceId)
 {
 	try
 	{
+		std::shared_ptr<BusState> bus = getBus(interfaceId);
 		std::vector<uint8_t> payload = { 0x7A };
-		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, _address, 0xFFFFFFFF, true, _messageCounter[0]++, 0, 0, payload));
-		sendPacket(packet, false);
+		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, _address, 0xFFFFFFFF, true, getMessageCounter(0), 0, 0, payload));
+		sendPacket(bus, packet, false, false);
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
-		packet.reset(new HMWiredPacket(HMWiredPacketType::iMessage, _address, 0xFFFFFFFF, true, _messageCounter[0]++, 0, 0, payload));
-		sendPacket(packet, false);
+		packet.reset(new HMWiredPacket(HMWiredPacketType::iMessage, _address, 0xFFFFFFFF, true, getMessageCounter(0), 0, 0, payload));
+		sendPacket(bus, packet, false, false);
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
 	}
 	catch(const std::exception& ex)
@@ -597,17 +747,18 @@ void HMWiredCentral::lockBus()
     }
 }
 
-void HMWiredCentral::unlockBus()
+void HMWiredCentral::unlockBus(const std::string& interfaceId)
 {
 	try
 	{
+		std::shared_ptr<BusState> bus = getBus(interfaceId);
 		std::vector<uint8_t> payload = { 0x5A };
 		std::this_thread::sleep_for(std::chrono::milliseconds(30));
-		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, _address, 0xFFFFFFFF, true, _messageCounter[0]++, 0, 0, payload));
-		sendPacket(packet, false);
+		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, _address, 0xFFFFFFFF, true, getMessageCounter(0), 0, 0, payload));
+		sendPacket(bus, packet, false, false);
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
-		packet.reset(new HMWiredPacket(HMWiredPacketType::iMessage, _address, 0xFFFFFFFF, true, _messageCounter[0]++, 0, 0, payload));
-		sendPacket(packet, false);
+		packet.reset(new HMWiredPacket(HMWiredPacketType::iMessage, _address, 0xFFFFFFFF, true, getMessageCounter(0), 0, 0, payload));
+		sendPacket(bus, packet, false, false);
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
 	}
 	catch(const std::exception& ex)
@@ -620,18 +771,53 @@ void HMWiredCentral::unlockBus()
     }
 }
 
+std::shared_ptr<HMWiredPacket> HMWiredCentral::getBootloaderResponse(std::shared_ptr<HMWiredPacket> packet, int32_t timeout)
+{
+	try
+	{
+		std::shared_ptr<BusState> bus = getBus(packet->destinationAddress());
+		std::shared_ptr<IHMWiredInterface> physicalInterface = bus->physicalInterface;
+		//The gateway sends and resends on its own
+		if(physicalInterface->autoResend()) return getResponse(packet, true);
+
+		int64_t time = BaseLib::HelperFunctions::getTime();
+		int64_t timeDifference = time - physicalInterface->lastPacketReceived();
+		uint32_t responseDelay = physicalInterface->responseDelay();
+		if(timeDifference >= 0 && timeDifference < responseDelay) std::this_thread::sleep_for(std::chrono::milliseconds(responseDelay - timeDifference));
+		bus->sentPackets.set(packet->destinationAddress(), packet);
+		time = BaseLib::HelperFunctions::getTime();
+		physicalInterface->sendPacket(packet);
+		for(int32_t i = 0; i < timeout; i++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			std::shared_ptr<HMWiredPacket> receivedPacket = bus->receivedPackets.get(0);
+			if(receivedPacket && receivedPacket->getTimeReceived() >= time && receivedPacket->receiverMessageCounter() == packet->senderMessageCounter()) return receivedPacket;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return std::shared_ptr<HMWiredPacket>();
+}
+
 uint8_t HMWiredCentral::getMessageCounter(int32_t destinationAddress)
 {
 	try
 	{
 		std::shared_ptr<HMWiredPeer> peer = getPeer(destinationAddress);
 		uint8_t messageCounter = 0;
+		std::lock_guard<std::mutex> messageCounterGuard(_messageCounterMutex);
 		if(peer)
 		{
 			messageCounter = peer->getMessageCounter();
 			peer->setMessageCounter(messageCounter + 1);
 		}
-		else messageCounter = _messageCounter[destinationAddress]++;
+		else messageCounter = _messageCounter[destinationAddress]++; //Address 0 is the broadcast counter
 		return messageCounter;
 	}
 	catch(const std::exception& ex)
@@ -671,7 +857,7 @@ std::shared_ptr<HMWiredPacket> HMWiredCentral::getResponse(std::vector<uint8_t>&
 		if(peer) peer->ignorePackets = true;
 		std::shared_ptr<HMWiredPacket> request(new HMWiredPacket(HMWiredPacketType::iMessage, _address, destinationAddress, synchronizationBit, getMessageCounter(destinationAddress), 0, 0, payload));
 		std::shared_ptr<HMWiredPacket> response = sendPacket(request, true);
-		if(response && response->type() != HMWiredPacketType::ackMessage) sendOK(response->senderMessageCounter(), destinationAddress);
+		if(response && response->type() != HMWiredPacketType::ackMessage) sendOK(response->senderMessageCounter(), destinationAddress, response->getTimeReceived());
 		if(peer) peer->ignorePackets = false;
 		return response;
 	}
@@ -695,7 +881,7 @@ std::shared_ptr<HMWiredPacket> HMWiredCentral::getResponse(std::shared_ptr<HMWir
 		if(peer) peer->ignorePackets = true;
 		std::shared_ptr<HMWiredPacket> request(packet);
 		std::shared_ptr<HMWiredPacket> response = sendPacket(request, true, systemResponse);
-		if(response && response->type() != HMWiredPacketType::ackMessage && response->type() != HMWiredPacketType::system) sendOK(response->senderMessageCounter(), packet->destinationAddress());
+		if(response && response->type() != HMWiredPacketType::ackMessage && response->type() != HMWiredPacketType::system) sendOK(response->senderMessageCounter(), packet->destinationAddress(), response->getTimeReceived());
 		if(peer) peer->ignorePackets = false;
 		return response;
 	}
@@ -726,7 +912,7 @@ std::vector<uint8_t> HMWiredCentral::readEEPROM(int32_t deviceAddress, int32_t e
 		std::shared_ptr<HMWiredPacket> response = sendPacket(request, true);
 		if(response)
 		{
-			sendOK(response->senderMessageCounter(), deviceAddress);
+			sendOK(response->senderMessageCounter(), deviceAddress, response->getTimeReceived());
 			if(peer) peer->ignorePackets = false;
 			return response->payload();
 		}
@@ -743,6 +929,34 @@ std::vector<uint8_t> HMWiredCentral::readEEPROM(int32_t deviceAddress, int32_t e
 	return std::vector<uint8_t>();
 }
 
+std::map<int32_t, std::vector<uint8_t>> HMWiredCentral::readEEPROM(int32_t deviceAddress, const std::set<int32_t>& eepromAddresses)
+{
+	std::map<int32_t, std::vector<uint8_t>> blocks;
+	try
+	{
+		//Read all blocks back to back before anybody starts working with them
+		for(std::set<int32_t>::const_iterator i = eepromAddresses.begin(); i != eepromAddresses.end(); ++i)
+		{
+			std::vector<uint8_t> data = readEEPROM(deviceAddress, *i);
+			if(data.size() != 0x10)
+			{
+				GD::out.printError("Error: HomeMatic Wired Device " + std::to_string(_deviceId) + ": Could not read EEPROM block 0x" + BaseLib::HelperFunctions::getHexString(*i, 4) + " of device 0x" + BaseLib::HelperFunctions::getHexString(deviceAddress, 8) + ".");
+				return std::map<int32_t, std::vector<uint8_t>>();
+			}
+			blocks[*i] = data;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return blocks;
+}
+
 bool HMWiredCentral::writeEEPROM(int32_t deviceAddress, int32_t eepromAddress, std::vector<uint8_t>& data)
 {
 	std::shared_ptr<HMWiredPeer> peer = getPeer(deviceAddress);
@@ -780,13 +994,90 @@ bool HMWiredCentral::writeEEPROM(int32_t deviceAddress, int32_t eepromAddress, s
 	return false;
 }
 
-void HMWiredCentral::sendOK(int32_t messageCounter, int32_t destinationAddress)
+std::shared_ptr<AckFrames> HMWiredCentral::getAckFrames(int32_t destinationAddress)
 {
 	try
 	{
+		{
+			std::lock_guard<std::mutex> ackFramesGuard(_ackFramesMutex);
+			std::unordered_map<int32_t, std::shared_ptr<AckFrames>>::iterator ackFramesIterator = _ackFrames.find(destinationAddress);
+			if(ackFramesIterator != _ackFrames.end()) return ackFramesIterator->second;
+		}
+
+		std::shared_ptr<AckFrames> ackFrames = std::make_shared<AckFrames>();
 		std::vector<uint8_t> payload;
-		std::shared_ptr<HMWiredPacket> ackPacket(new HMWiredPacket(HMWiredPacketType::ackMessage, _address, destinationAddress, false, 0, messageCounter, 0, payload));
-		sendPacket(ackPacket, false);
+		for(int32_t i = 0; i < (signed)ackFrames->size(); i++)
+		{
+			AckFrame& ackFrame = ackFrames->at(i);
+			ackFrame.packet.reset(new HMWiredPacket(HMWiredPacketType::ackMessage, _address, destinationAddress, false, 0, i, 0, payload));
+			ackFrame.data = ackFrame.packet->byteArray();
+		}
+
+		//Only cache frames of known peers, so packets of unpaired or foreign devices don't grow the map
+		if(!getPeer(destinationAddress)) return ackFrames;
+		std::lock_guard<std::mutex> ackFramesGuard(_ackFramesMutex);
+		_ackFrames[destinationAddress] = ackFrames;
+		return ackFrames;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return std::shared_ptr<AckFrames>();
+}
+
+void HMWiredCentral::sendOK(int32_t messageCounter, int32_t destinationAddress, int64_t timeReceived)
+{
+	try
+	{
+		std::shared_ptr<AckFrames> ackFrames = getAckFrames(destinationAddress);
+		if(!ackFrames) return;
+		AckFrame& ackFrame = ackFrames->at(messageCounter & 3);
+		std::shared_ptr<BusState> bus = getBus(destinationAddress);
+		if(bus->physicalInterface->autoResend())
+		{
+			//The gateway encodes the frame itself
+			sendPacket(bus, ackFrame.packet, false, false);
+		}
+		else
+		{
+			//Same timing as in sendPacket(): ACKs don't wait for the bus, but the device needs its response delay
+			int64_t time = BaseLib::HelperFunctions::getTime();
+			int64_t responseDelay = bus->physicalInterface->responseDelay();
+			std::shared_ptr<HMWiredPacketInfo> txPacketInfo = bus->sentPackets.getInfo(destinationAddress);
+			if(txPacketInfo && time - txPacketInfo->time < responseDelay)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(responseDelay - (time - txPacketInfo->time)));
+				time = BaseLib::HelperFunctions::getTime();
+			}
+			std::shared_ptr<HMWiredPacketInfo> rxPacketInfo = bus->receivedPackets.getInfo(destinationAddress);
+			if(rxPacketInfo)
+			{
+				int64_t timeDifference = time - rxPacketInfo->time;
+				if(timeDifference >= 0 && timeDifference < responseDelay)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(responseDelay - timeDifference));
+					time = BaseLib::HelperFunctions::getTime();
+				}
+				rxPacketInfo->time = time;
+			}
+			bus->sentPackets.set(destinationAddress, ackFrame.packet);
+			bus->physicalInterface->sendPacket(ackFrame.data);
+		}
+
+		if(timeReceived > 0)
+		{
+			uint64_t latency = BaseLib::HelperFunctions::getTime() - timeReceived;
+			_acksSent++;
+			_ackLatency += latency;
+			uint64_t maxAckLatency = _maxAckLatency;
+			while(latency > maxAckLatency && !_maxAckLatency.compare_exchange_weak(maxAckLatency, latency));
+			if(latency >= 150) _lateAcks++;
+		}
 	}
 	catch(const std::exception& ex)
 	{
@@ -816,11 +1107,40 @@ void HMWiredCentral::saveMessageCounters()
     }
 }
 
+void HMWiredCentral::savePeerMessageCounters()
+{
+	try
+	{
+		std::vector<std::shared_ptr<HMWiredPeer>> peers;
+		{
+			std::lock_guard<std::mutex> peersGuard(_peersMutex);
+			for(std::map<uint64_t, std::shared_ptr<BaseLib::Systems::Peer>>::iterator i = _peersById.begin(); i != _peersById.end(); ++i)
+			{
+				std::shared_ptr<HMWiredPeer> peer(std::dynamic_pointer_cast<HMWiredPeer>(i->second));
+				if(peer) peers.push_back(peer);
+			}
+		}
+		for(std::vector<std::shared_ptr<HMWiredPeer>>::iterator i = peers.begin(); i != peers.end(); ++i)
+		{
+			(*i)->saveMessageCounter();
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
 void HMWiredCentral::serializeMessageCounters(std::vector<uint8_t>& encodedData)
 {
 	try
 	{
 		BaseLib::BinaryEncoder encoder(_bl);
+		std::lock_guard<std::mutex> messageCounterGuard(_messageCounterMutex);
 		encoder.encodeInteger(encodedData, _messageCounter.size());
 		for(std::unordered_map<int32_t, uint8_t>::const_iterator i = _messageCounter.begin(); i != _messageCounter.end(); ++i)
 		{
@@ -845,6 +1165,7 @@ void HMWiredCentral::unserializeMessageCounters(std::shared_ptr<std::vector<char
 		BaseLib::BinaryDecoder decoder(_bl);
 		uint32_t position = 0;
 		uint32_t messageCounterSize = decoder.decodeInteger(*serializedData, position);
+		std::lock_guard<std::mutex> messageCounterGuard(_messageCounterMutex);
 		for(uint32_t i = 0; i < messageCounterSize; i++)
 		{
 			int32_t index = decoder.decodeInteger(*serializedData, position);
@@ -895,18 +1216,77 @@ std::string HMWiredCentral::handleCliCommand(std::string command)
 		{
 			stringStream << "List of commands:" << std::endl << std::endl;
 			stringStream << "For more information about the individual command type: COMMAND help" << std::endl << std::endl;
+			stringStream << "decoder benchmark (db)\tMeasures how many frames per second are decoded" << std::endl;
+			stringStream << "decoder stats (ds)\tPrints statistics of the frame decoders" << std::endl;
+			stringStream << "dispatcher stats (dps)\tPrints queue depth and latency of received packets" << std::endl;
+			stringStream << "events stats (es)\tPrints statistics of the event coalescing" << std::endl;
+			stringStream << "frames stats (fs)\tPrints statistics of the frames sent by setValue" << std::endl;
+			stringStream << "maintenance queue (mq)\tPrints the state of the reachability check and polling schedule" << std::endl;
+			stringStream << "maintenance stats (ms)\tPrints the bus usage of reachability checks and polling" << std::endl;
+			stringStream << "pairing queue (pq)\tPrints statistics of the pairing of announced devices" << std::endl;
+			stringStream << "peers link (plk)\tLinks peers" << std::endl;
 			stringStream << "peers list (ls)\t\tList all peers" << std::endl;
 			stringStream << "peers reset (prs)\tUnpair a peer and reset it to factory defaults" << std::endl;
 			stringStream << "peers select (ps)\tSelect a peer" << std::endl;
 			stringStream << "peers setname (pn)\tName a peer" << std::endl;
 			stringStream << "peers unpair (pup)\tUnpair a peer" << std::endl;
 			stringStream << "peers update (pud)\tUpdates a peer to the newest firmware version" << std::endl;
-			stringStream << "search (sp)\t\tSearches for new devices on the bus" << std::endl;
+			stringStream << "persistence flush (pfl)\tWrites all queued values to the database" << std::endl;
+			stringStream << "persistence stats (pst)\tPrints statistics of the persistence queue" << std::endl;
+			stringStream << "search (sp)\t\tSearches for new devices on all buses" << std::endl;
+			stringStream << "search benchmark (sb)\tCompares the search with fixed and adaptive timing on a simulated bus" << std::endl;
 			stringStream << "unselect (u)\t\tUnselect this device" << std::endl;
+			stringStream << "values stats (vs)\tPrints statistics of the values requested from the devices" << std::endl;
+			return stringStream.str();
+		}
+		if(command.compare(0, 16, "search benchmark") == 0 || command.compare(0, 2, "sb") == 0)
+		{
+			uint32_t deviceCount = 50;
+			int64_t responseDelay = (_defaultBus && _defaultBus->physicalInterface) ? _defaultBus->physicalInterface->responseDelay() : 0;
+
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 'b') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command searches a simulated bus once waiting the full response delay after every probe and retrying all unanswered probes and once with the adaptive timing used by \"search\". It prints the probes sent and the time the bus was busy. No packets are sent." << std::endl;
+						stringStream << "Usage: search benchmark [DEVICES] [RESPONSEDELAY]" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  DEVICES:\tThe number of devices on the simulated bus. Default: 50" << std::endl;
+						stringStream << "  RESPONSEDELAY:\tThe response delay in milliseconds. Default: The response delay of the default interface" << std::endl;
+						return stringStream.str();
+					}
+					int32_t value = BaseLib::Math::getNumber(element, false);
+					if(value <= 0) return "Invalid number of devices.\n";
+					deviceCount = value;
+				}
+				else if(index == 2 + offset)
+				{
+					int32_t value = BaseLib::Math::getNumber(element, false);
+					if(value <= 0) return "Invalid response delay.\n";
+					responseDelay = value;
+				}
+				index++;
+			}
+			if(responseDelay <= 0) return "No response delay is set. Please pass it as second parameter.\n";
+
+			stringStream << DiscoverySearch::benchmark(deviceCount, responseDelay);
 			return stringStream.str();
 		}
-		if(command.compare(0, 6, "search") == 0 || command.compare(0, 2, "sp") == 0)
+		else if(command.compare(0, 6, "search") == 0 || command.compare(0, 2, "sp") == 0)
 		{
+			bool incremental = true;
+
 			std::stringstream stream(command);
 			std::string element;
 			int32_t offset = (command.at(1) == 'p') ? 0 : 1;
@@ -922,17 +1302,18 @@ std::string HMWiredCentral::handleCliCommand(std::string command)
 				{
 					if(element == "help")
 					{
-						stringStream << "Description: This command searches for new devices on the bus." << std::endl;
-						stringStream << "Usage: search" << std::endl << std::endl;
+						stringStream << "Description: This command searches for new devices on all buses. By default probes only answered by paired devices are skipped." << std::endl;
+						stringStream << "Usage: search [full]" << std::endl << std::endl;
 						stringStream << "Parameters:" << std::endl;
-						stringStream << "  There are no parameters." << std::endl;
+						stringStream << "  full:\tSearch the whole address space, including the subtrees of paired devices." << std::endl;
 						return stringStream.str();
 					}
+					else if(element == "full") incremental = false;
 				}
 				index++;
 			}
 
-			PVariable result = searchDevices(nullptr, "");
+			PVariable result = searchDevices(nullptr, "", incremental);
 			if(result->errorStruct) stringStream << "Error: " << result->structValue->at("faultString")->stringValue << std::endl;
 			else stringStream << "Search completed successfully." << std::endl;
 			return stringStream.str();
@@ -1019,44 +1400,577 @@ std::string HMWiredCentral::handleCliCommand(std::string command)
 			}
 			return stringStream.str();
 		}
-		else if(command.compare(0, 10, "peers list") == 0 || command.compare(0, 2, "pl") == 0 || command.compare(0, 2, "ls") == 0)
+		else if(command.compare(0, 13, "decoder stats") == 0 || command.compare(0, 2, "ds") == 0)
 		{
-			try
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 's') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
 			{
-				std::string filterType;
-				std::string filterValue;
-
-				std::stringstream stream(command);
-				std::string element;
-				int32_t offset = (command.at(1) == 'l' || command.at(1) == 's') ? 0 : 1;
-				int32_t index = 0;
-				while(std::getline(stream, element, ' '))
+				if(index < 1 + offset)
 				{
-					if(index < 1 + offset)
-					{
-						index++;
-						continue;
-					}
-					else if(index == 1 + offset)
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
 					{
-						if(element == "help")
-						{
-							index = -1;
-							break;
-						}
-						filterType = BaseLib::HelperFunctions::toLower(element);
+						stringStream << "Description: This command prints the number of frames decoded since the start of Homegear per device type of the paired peers. The counters of a device type are reset, when its last peer is unpaired." << std::endl;
+						stringStream << "Usage: decoder stats" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
 					}
-					else if(index == 2 + offset)
+				}
+				index++;
+			}
+
+			std::vector<std::shared_ptr<FrameDecoder>> decoders = FrameDecoder::getAll();
+			if(decoders.empty()) return "No frames were decoded yet.\n";
+			stringStream << "Device\t\t\tFrame types\tFrames decoded\tAverage time (ns)\tFrames/s" << std::endl;
+			for(std::vector<std::shared_ptr<FrameDecoder>>::iterator i = decoders.begin(); i != decoders.end(); ++i)
+			{
+				uint64_t frames = (*i)->decodedFrames();
+				uint64_t time = (*i)->decodeTime();
+				std::string description = (*i)->getRpcDevice()->supportedDevices.empty() ? "" : (*i)->getRpcDevice()->supportedDevices.at(0)->id;
+				stringStream << std::left << std::setfill(' ') << std::setw(24) << description << std::right << (*i)->entryCount() << "\t\t" << frames << "\t\t" << (frames > 0 ? time / frames : 0) << "\t\t\t" << (time > 0 ? (frames * 1000000000) / time : 0) << std::endl;
+			}
+			return stringStream.str();
+		}
+		else if(command.compare(0, 17, "decoder benchmark") == 0 || command.compare(0, 2, "db") == 0)
+		{
+			uint32_t iterations = 1000;
+
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 'b') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
 					{
-						filterValue = element;
-						if(filterType == "name") BaseLib::HelperFunctions::toLower(filterValue);
+						stringStream << "Description: This command builds one packet for each frame to the central defined in the device descriptions of the paired peers and measures how many of them are decoded per second. The packets contain the default values of the frames' parameters." << std::endl;
+						stringStream << "Usage: decoder benchmark [ITERATIONS]" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  ITERATIONS:\tHow often to decode each packet. Default: 1000" << std::endl;
+						return stringStream.str();
 					}
-					index++;
+					int32_t value = BaseLib::Math::getNumber(element, false);
+					if(value <= 0) return "Invalid number of iterations.\n";
+					iterations = value;
 				}
-				if(index == -1)
+				index++;
+			}
+
+			//One peer per device description
+			std::map<HomegearDevice*, std::shared_ptr<HMWiredPeer>> peers;
+			{
+				std::lock_guard<std::mutex> peersGuard(_peersMutex);
+				for(std::map<uint64_t, std::shared_ptr<BaseLib::Systems::Peer>>::iterator i = _peersById.begin(); i != _peersById.end(); ++i)
 				{
-					stringStream << "Description: This command lists information about all peers." << std::endl;
-					stringStream << "Usage: peers list [FILTERTYPE] [FILTERVALUE]" << std::endl << std::endl;
+					std::shared_ptr<HMWiredPeer> peer(std::dynamic_pointer_cast<HMWiredPeer>(i->second));
+					if(!peer || !peer->getRpcDevice()) continue;
+					if(peers.find(peer->getRpcDevice().get()) == peers.end()) peers[peer->getRpcDevice().get()] = peer;
+				}
+			}
+			if(peers.empty()) return "No peers are paired to this central.\n";
+
+			stringStream << "Device\t\t\tFrames decoded\tValues decoded\tTime (us)\tFrames/s" << std::endl;
+			for(std::map<HomegearDevice*, std::shared_ptr<HMWiredPeer>>::iterator i = peers.begin(); i != peers.end(); ++i)
+			{
+				std::shared_ptr<FrameDecoder> decoder = FrameDecoder::get(i->second->getRpcDevice());
+				if(!decoder) continue;
+				uint64_t frames = 0;
+				uint64_t values = 0;
+				int64_t time = decoder->benchmark(i->second.get(), iterations, frames, values);
+				stringStream << std::left << std::setfill(' ') << std::setw(24) << i->second->getTypeString() << std::right << frames << "\t\t" << values << "\t\t" << time << "\t\t" << (time > 0 ? (frames * 1000000) / time : 0) << std::endl;
+			}
+			return stringStream.str();
+		}
+		else if(command.compare(0, 16, "dispatcher stats") == 0 || command.compare(0, 3, "dps") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 'p') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command prints histograms of the queue depth seen by the receiving thread and of the time received packets waited for processing since the start of Homegear. It also prints the time from receiving a packet to sending its ACK. \"Dropped\" is the number of packets not acknowledged, because the queue was full. The devices send them again." << std::endl;
+						stringStream << "Usage: dispatcher stats" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			if(!_packetDispatcher) return "The packet dispatcher is not running.\n";
+			PacketDispatcherStats stats = _packetDispatcher->getStats();
+			stringStream << "Dispatched:\t" << stats.dispatched << std::endl;
+			stringStream << "Queued:\t\t" << _packetDispatcher->size() << " of " << _packetDispatcher->capacity() << std::endl;
+			stringStream << "Dropped:\t" << stats.overflows << std::endl << std::endl;
+			stringStream << "Depth\t\tPackets" << std::endl;
+			for(uint32_t i = 0; i < stats.depth.size(); i++)
+			{
+				if(i == 0) stringStream << "0";
+				else if(i == 1) stringStream << "1";
+				else if(i == stats.depth.size() - 1) stringStream << ">= " << (1 << (i - 1));
+				else stringStream << (1 << (i - 1)) << "-" << ((1 << i) - 1);
+				stringStream << "\t\t" << stats.depth.at(i) << std::endl;
+			}
+			stringStream << std::endl << "Latency\t\tPackets" << std::endl;
+			std::vector<std::string> bounds{ "< 10 us", "< 100 us", "< 1 ms", "< 10 ms", "< 100 ms", "< 1 s", ">= 1 s" };
+			for(uint32_t i = 0; i < stats.latency.size() && i < bounds.size(); i++)
+			{
+				stringStream << bounds.at(i) << "\t" << (bounds.at(i).size() < 8 ? "\t" : "") << stats.latency.at(i) << std::endl;
+			}
+			stringStream << "Maximum (us):\t" << stats.maxLatency << std::endl << std::endl;
+			uint64_t acksSent = _acksSent;
+			stringStream << "ACKs sent:\t" << acksSent << std::endl;
+			stringStream << "ACK latency (ms):\t" << (acksSent > 0 ? _ackLatency / acksSent : 0) << " average, " << _maxAckLatency << " maximum" << std::endl;
+			stringStream << "ACKs >= 150 ms:\t" << _lateAcks << std::endl;
+			stringStream << "Retransmissions:\t" << _duplicates << std::endl;
+			return stringStream.str();
+		}
+		else if(command.compare(0, 17, "persistence flush") == 0 || command.compare(0, 3, "pfl") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 'f') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command writes all values waiting in the persistence queue to the database and returns when they were written." << std::endl;
+						stringStream << "Usage: persistence flush" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			std::shared_ptr<PersistenceQueue> persistenceQueue = GD::persistenceQueue;
+			if(!persistenceQueue) return "The persistence queue is disabled.\n";
+			uint32_t size = persistenceQueue->size();
+			persistenceQueue->flush();
+			stringStream << "Wrote " << size << " values." << std::endl;
+			return stringStream.str();
+		}
+		else if(command.compare(0, 17, "persistence stats") == 0 || command.compare(0, 3, "pst") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 's') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command prints statistics of the persistence queue since the start of Homegear. \"Time per save\" is the time the receive and RPC threads spent per saved value, \"Saves/s\" the resulting number of values these threads can persist per second." << std::endl;
+						stringStream << "Usage: persistence stats" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			std::shared_ptr<PersistenceQueue> persistenceQueue = GD::persistenceQueue;
+			if(!persistenceQueue) return "The persistence queue is disabled.\n";
+			PersistenceQueueStats stats = persistenceQueue->getStats();
+			uint64_t saves = stats.enqueued + stats.directWrites;
+			uint64_t timePerSave = saves > 0 ? stats.callerTime / saves : 0;
+			stringStream << "Window (ms):\t\t" << persistenceQueue->window() << std::endl;
+			stringStream << "Pending:\t\t" << persistenceQueue->size() << std::endl;
+			stringStream << "Queued:\t\t\t" << stats.enqueued << std::endl;
+			stringStream << "Coalesced:\t\t" << stats.coalesced << std::endl;
+			stringStream << "Written by queue:\t" << stats.written << std::endl;
+			stringStream << "Written directly:\t" << stats.directWrites << std::endl;
+			stringStream << "Batches:\t\t" << stats.batches << std::endl;
+			stringStream << "Largest batch:\t\t" << stats.maxBatchSize << std::endl;
+			stringStream << "Write time (ns):\t" << (stats.written > 0 ? stats.writeTime / stats.written : 0) << std::endl;
+			stringStream << "Time per save (ns):\t" << timePerSave << std::endl;
+			stringStream << "Saves/s:\t\t" << (timePerSave > 0 ? 1000000000 / timePerSave : 0) << std::endl;
+			return stringStream.str();
+		}
+		else if(command.compare(0, 12, "events stats") == 0 || command.compare(0, 2, "es") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 's') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command prints statistics of the event coalescing since the start of Homegear. Coalescing is configured per channel with the configuration parameters EVENT_COALESCE_MODE and EVENT_COALESCE_WINDOW. \"Received\" is the number of events of channels with coalescing enabled, \"Raised\" the number of events passed on to the RPC clients." << std::endl;
+						stringStream << "Usage: events stats" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			if(!_eventCoalescer) return "The event coalescer is not running.\n";
+			EventCoalescerStats stats = _eventCoalescer->getStats();
+			stringStream << "Received:\t\t" << stats.received << std::endl;
+			stringStream << "Raised directly:\t" << stats.raisedDirectly << std::endl;
+			stringStream << "Raised delayed:\t\t" << stats.raisedDelayed << std::endl;
+			stringStream << "Replaced values:\t" << stats.replacedValues << std::endl;
+			stringStream << "Pending:\t\t" << _eventCoalescer->size() << std::endl;
+			stringStream << "Max. pending:\t\t" << stats.maxPending << std::endl;
+			return stringStream.str();
+		}
+		else if(command.compare(0, 13, "pairing queue") == 0 || command.compare(0, 2, "pq") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 'q') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command prints statistics of the pairing of devices, which announced themselves, since the start of Homegear. \"Duplicates\" is the number of announces of devices already queued or being paired. \"Skipped\" is the number of devices already paired or being initialized." << std::endl;
+						stringStream << "Usage: pairing queue" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			if(!_pairingQueue) return "The pairing queue is not running.\n";
+			PairingQueueStats stats = _pairingQueue->getStats();
+			stringStream << "Announces:\t" << stats.announces << std::endl;
+			stringStream << "Duplicates:\t" << stats.duplicates << std::endl;
+			stringStream << "Paired:\t\t" << stats.paired << std::endl;
+			stringStream << "Skipped:\t" << stats.skipped << std::endl;
+			stringStream << "Failed:\t\t" << stats.failed << std::endl;
+			stringStream << "Pending:\t" << _pairingQueue->size() << std::endl;
+			stringStream << "Max. pending:\t" << stats.maxPending << std::endl;
+			return stringStream.str();
+		}
+		else if(command.compare(0, 12, "frames stats") == 0 || command.compare(0, 2, "fs") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 's') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command prints statistics of the frames sent by setValue since the start of Homegear. Frames are encoded once per channel, parameter and value and then reused as long as the other parameters of the frame don't change. \"RPC latency\" is the time from receiving the RPC call until the peer's response." << std::endl;
+						stringStream << "Usage: frames stats" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			SetValueStats& stats = HMWiredPeer::setValueStats;
+			uint64_t framesBuilt = stats.framesBuilt;
+			uint64_t buildTime = stats.buildTime;
+			uint64_t framesReused = stats.framesReused;
+			uint64_t reuseTime = stats.reuseTime;
+			uint64_t requests = stats.requests;
+			stringStream << "Frames built:\t\t" << framesBuilt << std::endl;
+			stringStream << "Frames built/s:\t\t" << (buildTime > 0 ? framesBuilt * 1000000000 / buildTime : 0) << std::endl;
+			stringStream << "Frames reused:\t\t" << framesReused << std::endl;
+			stringStream << "Frames reused/s:\t" << (reuseTime > 0 ? framesReused * 1000000000 / reuseTime : 0) << std::endl;
+			stringStream << "RPC calls:\t\t" << requests << std::endl;
+			stringStream << "RPC latency (ms):\t" << (requests > 0 ? stats.requestTime / requests / 1000000 : 0) << std::endl;
+			stringStream << "Max. RPC latency (ms):\t" << stats.maxRequestTime / 1000000 << std::endl;
+			return stringStream.str();
+		}
+		else if(command.compare(0, 17, "maintenance queue") == 0 || command.compare(0, 2, "mq") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 'q') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command prints the state of the reachability checks and value polls per interface. \"Due\" tasks wait for a free slot or for the airtime limit. \"Throttled\" is the time until the airtime limit allows the next task." << std::endl;
+						stringStream << "Usage: maintenance queue" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			if(!_maintenanceScheduler) return "The maintenance scheduler is not running.\n";
+			std::vector<MaintenanceQueueState> states = _maintenanceScheduler->getQueueState();
+			for(std::vector<MaintenanceQueueState>::iterator i = states.begin(); i != states.end(); ++i)
+			{
+				stringStream << "Interface " << i->interfaceId << ":" << std::endl;
+				stringStream << "  Scheduled:\t\t" << i->scheduled << std::endl;
+				stringStream << "  Due:\t\t\t" << i->due << std::endl;
+				stringStream << "  Running:\t\t" << i->running << std::endl;
+				if(i->scheduled > i->running) stringStream << "  Next due (s):\t\t" << i->nextDue / 1000 << std::endl;
+				stringStream << "  Throttled (ms):\t" << i->throttled << std::endl;
+				stringStream << "  Tasks:\t\t" << i->tasks << std::endl;
+				stringStream << "  Bus time (ms):\t" << i->busyTime << std::endl;
+			}
+			return stringStream.str();
+		}
+		else if(command.compare(0, 17, "maintenance stats") == 0 || command.compare(0, 2, "ms") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 's') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command prints the requests sent since the start of Homegear to check if unreachable devices are back (\"liveness probes\") and to poll the values of devices with \"POLLING\" enabled. \"Bus time\" is the time spent waiting for the responses. The probe type is set with \"livenessProbe\" in homematicwired.conf." << std::endl;
+						stringStream << "Usage: maintenance stats" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			MaintenanceStats& stats = HMWiredPeer::maintenanceStats;
+			int64_t uptime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - stats.startTime).count();
+			if(uptime < 1) uptime = 1;
+			uint64_t probeRequests = stats.probeRequests;
+			uint64_t probeTime = stats.probeTime;
+			uint64_t pollRequests = stats.pollRequests;
+			uint64_t pollTime = stats.pollTime;
+			stringStream << "Probe type:\t\t" << (GD::family->lightweightLiveness() ? "firmware" : "values") << std::endl;
+			stringStream << "Liveness probes:\t" << stats.probes << std::endl;
+			stringStream << "Probe requests:\t\t" << probeRequests << std::endl;
+			stringStream << "Probe requests/h:\t" << probeRequests * 3600 / uptime << std::endl;
+			stringStream << "Probe bus time (ms):\t" << probeTime << std::endl;
+			stringStream << "Value polls:\t\t" << stats.polls << std::endl;
+			stringStream << "Poll requests:\t\t" << pollRequests << std::endl;
+			stringStream << "Poll requests/h:\t" << pollRequests * 3600 / uptime << std::endl;
+			stringStream << "Poll bus time (ms):\t" << pollTime << std::endl;
+			stringStream << "Bus time/h (ms):\t" << (probeTime + pollTime) * 3600 / uptime << std::endl;
+			return stringStream.str();
+		}
+		else if(command.compare(0, 12, "values stats") == 0 || command.compare(0, 2, "vs") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 's') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command prints statistics of the values requested from the devices since the start of Homegear. \"Cached\" requests were answered with a value the device sent within \"valueMaxAge\" milliseconds. \"Merged\" requests waited for an equal request already on the bus." << std::endl;
+						stringStream << "Usage: values stats" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			ValueRequestStats& stats = HMWiredPeer::valueRequestStats;
+			stringStream << "Max. age (ms):\t" << GD::family->valueMaxAge() << std::endl;
+			stringStream << "Requests:\t" << stats.requests << std::endl;
+			stringStream << "Cached:\t\t" << stats.cached << std::endl;
+			stringStream << "Merged:\t\t" << stats.merged << std::endl;
+			stringStream << "Sent:\t\t" << stats.sent << std::endl;
+			return stringStream.str();
+		}
+		else if(command.compare(0, 10, "peers link") == 0 || command.compare(0, 3, "plk") == 0)
+		{
+			PVariable links(new Variable(VariableType::tArray));
+			PVariable link;
+			std::vector<std::string> keys{ "SENDER_ID", "SENDER_CHANNEL", "RECEIVER_ID", "RECEIVER_CHANNEL" };
+
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = (command.at(1) == 'l') ? 0 : 1;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				if(element == "help")
+				{
+					index = 1 + offset;
+					break;
+				}
+				int32_t keyIndex = (index - 1 - offset) % 4;
+				if(keyIndex == 0)
+				{
+					link.reset(new Variable(VariableType::tStruct));
+					links->arrayValue->push_back(link);
+				}
+				int64_t value = BaseLib::Math::getNumber64(element, false);
+				if(keyIndex % 2 == 0 && value <= 0) return "Invalid id.\n";
+				if(keyIndex % 2 == 1 && value < 0) return "Invalid channel.\n";
+				if(keyIndex % 2 == 0) link->structValue->insert(StructElement(keys.at(keyIndex), PVariable(new Variable((uint64_t)value))));
+				else link->structValue->insert(StructElement(keys.at(keyIndex), PVariable(new Variable((int32_t)value))));
+				index++;
+			}
+			if(index == 1 + offset || (index - 1 - offset) % 4 != 0)
+			{
+				stringStream << "Description: This command links peers. All links are written to the peers' EEPROMs at once." << std::endl;
+				stringStream << "Usage: peers link SENDERID SENDERCHANNEL RECEIVERID RECEIVERCHANNEL [SENDERID SENDERCHANNEL RECEIVERID RECEIVERCHANNEL...]" << std::endl << std::endl;
+				stringStream << "Parameters:" << std::endl;
+				stringStream << "  SENDERID:\t\tThe id of the sending peer. Example: 513" << std::endl;
+				stringStream << "  SENDERCHANNEL:\tThe channel of the sending peer. Example: 1" << std::endl;
+				stringStream << "  RECEIVERID:\t\tThe id of the receiving peer. Example: 514" << std::endl;
+				stringStream << "  RECEIVERCHANNEL:\tThe channel of the receiving peer. Example: 13" << std::endl;
+				return stringStream.str();
+			}
+
+			int64_t startTime = BaseLib::HelperFunctions::getTime();
+			PVariable result = addLinks(nullptr, links);
+			if(result->errorStruct)
+			{
+				stringStream << "Error: " << result->structValue->at("faultString")->stringValue << std::endl;
+				return stringStream.str();
+			}
+			uint32_t linkCount = 0;
+			for(uint32_t i = 0; i < result->arrayValue->size(); i++)
+			{
+				if(result->arrayValue->at(i)->errorStruct) stringStream << "Link " << (i + 1) << ": Error: " << result->arrayValue->at(i)->structValue->at("faultString")->stringValue << std::endl;
+				else linkCount++;
+			}
+			stringStream << linkCount << " of " << result->arrayValue->size() << " links created in " << (BaseLib::HelperFunctions::getTime() - startTime) << " ms." << std::endl;
+			return stringStream.str();
+		}
+		else if(command.compare(0, 10, "peers list") == 0 || command.compare(0, 2, "pl") == 0 || command.compare(0, 2, "ls") == 0)
+		{
+			try
+			{
+				std::string filterType;
+				std::string filterValue;
+
+				std::stringstream stream(command);
+				std::string element;
+				int32_t offset = (command.at(1) == 'l' || command.at(1) == 's') ? 0 : 1;
+				int32_t index = 0;
+				while(std::getline(stream, element, ' '))
+				{
+					if(index < 1 + offset)
+					{
+						index++;
+						continue;
+					}
+					else if(index == 1 + offset)
+					{
+						if(element == "help")
+						{
+							index = -1;
+							break;
+						}
+						filterType = BaseLib::HelperFunctions::toLower(element);
+					}
+					else if(index == 2 + offset)
+					{
+						filterValue = element;
+						if(filterType == "name") BaseLib::HelperFunctions::toLower(filterValue);
+					}
+					index++;
+				}
+				if(index == -1)
+				{
+					stringStream << "Description: This command lists information about all peers." << std::endl;
+					stringStream << "Usage: peers list [FILTERTYPE] [FILTERVALUE]" << std::endl << std::endl;
 					stringStream << "Parameters:" << std::endl;
 					stringStream << "  FILTERTYPE:\tSee filter types below." << std::endl;
 					stringStream << "  FILTERVALUE:\tDepends on the filter type. If a number is required, it has to be in hexadecimal format." << std::endl << std::endl;
@@ -1353,35 +2267,134 @@ std::shared_ptr<HMWiredPeer> HMWiredCentral::createPeer(int32_t address, int32_t
 		peer->setSerialNumber(serialNumber);
 		peer->setRpcDevice(GD::family->getRpcDevices()->find(deviceType, firmwareVersion, -1));
 		if(!peer->getRpcDevice()) return std::shared_ptr<HMWiredPeer>();
+		peer->setPhysicalInterfaceId(getBus(address)->physicalInterface->getID());
 		if(save) peer->save(true, true, false); //Save and create peerID
 		return peer;
 	}
-    catch(const std::exception& ex)
+    catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return std::shared_ptr<HMWiredPeer>();
+}
+
+void HMWiredCentral::updateFirmwares(std::vector<uint64_t> ids)
+{
+	try
+	{
+		if(_updateMode || _bl->deviceUpdateInfo.currentDevice > 0) return;
+		_bl->deviceUpdateInfo.updateMutex.lock();
+		_updateMode = true;
+		_bl->deviceUpdateInfo.devicesToUpdate = ids.size();
+		_bl->deviceUpdateInfo.currentUpdate = 0;
+
+		//Buses don't share any airtime, so every interface gets its own queue
+		std::map<std::string, std::vector<uint64_t>> idsByInterface;
+		for(std::vector<uint64_t>::iterator i = ids.begin(); i != ids.end(); ++i)
+		{
+			std::shared_ptr<HMWiredPeer> peer = getPeer(*i);
+			if(!peer) continue;
+			idsByInterface[peer->getPhysicalInterfaceId()].push_back(*i);
+		}
+
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads(idsByInterface.size());
+		uint32_t index = 0;
+		for(std::map<std::string, std::vector<uint64_t>>::iterator i = idsByInterface.begin(); i != idsByInterface.end(); ++i, ++index)
+		{
+			_bl->threadManager.start(threads.at(index), false, &HMWiredCentral::updateFirmwaresOnInterface, this, i->first, i->second);
+		}
+		for(std::vector<std::thread>::iterator i = threads.begin(); i != threads.end(); ++i)
+		{
+			_bl->threadManager.join(*i);
+		}
+		int64_t wallTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+		GD::out.printInfo("Info: Firmware update of " + std::to_string(ids.size()) + " peers on " + std::to_string(idsByInterface.size()) + " interfaces finished in " + std::to_string(wallTime) + " ms.");
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+	{
+		std::lock_guard<std::mutex> updateGuard(_updateMutex);
+		_updateProgress.clear();
+		_bl->deviceUpdateInfo.reset();
+	}
+	_updateMode = false;
+	_bl->deviceUpdateInfo.updateMutex.unlock();
+}
+
+void HMWiredCentral::updateFirmwaresOnInterface(std::string interfaceId, std::vector<uint64_t> ids)
+{
+	try
+	{
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		FirmwareImages images;
+		bool busLocked = false;
+		uint32_t updated = 0;
+		try
+		{
+			for(std::vector<uint64_t>::iterator i = ids.begin(); i != ids.end(); ++i)
+			{
+				{
+					std::lock_guard<std::mutex> updateGuard(_updateMutex);
+					_bl->deviceUpdateInfo.currentUpdate++;
+				}
+				setUpdateProgress(interfaceId, *i, 0);
+				updateFirmware(*i, &images, &busLocked);
+				std::lock_guard<std::mutex> updateGuard(_updateMutex);
+				std::map<uint64_t, std::pair<int32_t, std::string>>::iterator resultIterator = _bl->deviceUpdateInfo.results.find(*i);
+				if(resultIterator != _bl->deviceUpdateInfo.results.end() && resultIterator->second.first == 0) updated++;
+			}
+		}
+		catch(const std::exception& ex)
+		{
+			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+		if(busLocked) unlockBus(interfaceId);
+		{
+			std::lock_guard<std::mutex> updateGuard(_updateMutex);
+			_updateProgress.erase(interfaceId);
+		}
+		int64_t wallTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+		GD::out.printInfo("Info: Firmware update of " + std::to_string(ids.size()) + " peers on interface \"" + interfaceId + "\" finished in " + std::to_string(wallTime) + " ms. " + std::to_string(updated) + " peers are up to date, " + std::to_string(images.size()) + " firmware files were parsed.");
+	}
+	catch(const std::exception& ex)
     {
-    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
     }
     catch(...)
     {
-    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
     }
-    return std::shared_ptr<HMWiredPeer>();
 }
 
-void HMWiredCentral::updateFirmwares(std::vector<uint64_t> ids)
+void HMWiredCentral::setUpdateProgress(const std::string& interfaceId, uint64_t id, int32_t progress)
 {
 	try
 	{
-		if(_updateMode || _bl->deviceUpdateInfo.currentDevice > 0) return;
-		_bl->deviceUpdateInfo.updateMutex.lock();
-		_bl->deviceUpdateInfo.devicesToUpdate = ids.size();
-		_bl->deviceUpdateInfo.currentUpdate = 0;
-		for(std::vector<uint64_t>::iterator i = ids.begin(); i != ids.end(); ++i)
+		std::lock_guard<std::mutex> updateGuard(_updateMutex);
+		_updateProgress[interfaceId] = progress;
+		//deviceUpdateInfo only knows one device. Report the last device started and the average progress of all buses.
+		int32_t progressSum = 0;
+		for(std::map<std::string, int32_t>::iterator i = _updateProgress.begin(); i != _updateProgress.end(); ++i)
 		{
-			_bl->deviceUpdateInfo.currentDeviceProgress = 0;
-			_bl->deviceUpdateInfo.currentUpdate++;
-			_bl->deviceUpdateInfo.currentDevice = *i;
-			updateFirmware(*i);
+			progressSum += i->second;
 		}
+		if(progress == 0) _bl->deviceUpdateInfo.currentDevice = id;
+		_bl->deviceUpdateInfo.currentDeviceProgress = progressSum / _updateProgress.size();
 	}
 	catch(const std::exception& ex)
     {
@@ -1391,242 +2404,89 @@ void HMWiredCentral::updateFirmwares(std::vector<uint64_t> ids)
     {
         GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
     }
-	_bl->deviceUpdateInfo.reset();
-	_bl->deviceUpdateInfo.updateMutex.unlock();
 }
 
-void HMWiredCentral::updateFirmware(uint64_t id)
+void HMWiredCentral::setUpdateResult(uint64_t id, int32_t code, const std::string& message)
+{
+	std::lock_guard<std::mutex> updateGuard(_updateMutex);
+	_bl->deviceUpdateInfo.results[id].first = code;
+	_bl->deviceUpdateInfo.results[id].second = message;
+}
+
+void HMWiredCentral::updateFirmware(uint64_t id, FirmwareImages* images, bool* busLocked)
 {
+	std::string interfaceId;
 	try
 	{
-		if(_updateMode) return;
 		std::shared_ptr<HMWiredPeer> peer = getPeer(id);
 		if(!peer) return;
-		_updateMode = true;
-		_updateMutex.lock();
 		std::string filenamePrefix = BaseLib::HelperFunctions::getHexString(1, 4) + "." + BaseLib::HelperFunctions::getHexString(peer->getDeviceType(), 8);
 		std::string versionFile(_bl->settings.firmwarePath() + filenamePrefix + ".version");
 		if(!BaseLib::Io::fileExists(versionFile))
 		{
 			GD::out.printInfo("Info: Not updating peer with id " + std::to_string(id) + ". No version info file found.");
-			_bl->deviceUpdateInfo.results[id].first = 2;
-			_bl->deviceUpdateInfo.results[id].second = "No version file found.";
-			_updateMutex.unlock();
-			_updateMode = false;
+			setUpdateResult(id, 2, "No version file found.");
 			return;
 		}
 		std::string firmwareFile(_bl->settings.firmwarePath() + filenamePrefix + ".fw");
 		if(!BaseLib::Io::fileExists(firmwareFile))
 		{
 			GD::out.printInfo("Info: Not updating peer with id " + std::to_string(id) + ". No firmware file found.");
-			_bl->deviceUpdateInfo.results[id].first = 3;
-			_bl->deviceUpdateInfo.results[id].second = "No firmware file found.";
-			_updateMutex.unlock();
-			_updateMode = false;
+			setUpdateResult(id, 3, "No firmware file found.");
 			return;
 		}
 		int32_t firmwareVersion = peer->getNewFirmwareVersion();
 		if(peer->getFirmwareVersion() >= firmwareVersion)
 		{
-			_bl->deviceUpdateInfo.results[id].first = 0;
-			_bl->deviceUpdateInfo.results[id].second = "Already up to date.";
+			setUpdateResult(id, 0, "Already up to date.");
 			GD::out.printInfo("Info: Not updating peer with id " + std::to_string(id) + ". Peer firmware is already up to date.");
-			_updateMutex.unlock();
-			_updateMode = false;
 			return;
 		}
 		std::string oldVersionString = BaseLib::HelperFunctions::getHexString(peer->getFirmwareVersion() >> 8) + "." + BaseLib::HelperFunctions::getHexString(peer->getFirmwareVersion() & 0xFF, 2);
 		std::string versionString = BaseLib::HelperFunctions::getHexString(firmwareVersion >> 8) + "." + BaseLib::HelperFunctions::getHexString(firmwareVersion & 0xFF, 2);
 
-		std::string firmwareHex;
-		try
+		std::shared_ptr<FirmwareImage> image;
+		std::pair<uint32_t, int32_t> imageKey(peer->getDeviceType(), firmwareVersion);
+		if(images)
 		{
-			firmwareHex = BaseLib::Io::getFileContent(firmwareFile);
+			FirmwareImages::iterator imageIterator = images->find(imageKey);
+			if(imageIterator != images->end()) image = imageIterator->second;
 		}
-		catch(const std::exception& ex)
+		if(!image)
 		{
-			GD::out.printError("Error: Could not open firmware file: " + firmwareFile + ": " + ex.what());
-			_bl->deviceUpdateInfo.results[id].first = 4;
-			_bl->deviceUpdateInfo.results[id].second = "Could not open firmware file.";
-			_updateMutex.unlock();
-			_updateMode = false;
-			return;
+			image = std::make_shared<FirmwareImage>();
+			image->result = FirmwareUpdater::loadImage(firmwareFile, image->data, image->error);
+			if(images) (*images)[imageKey] = image;
 		}
-		catch(...)
+		if(image->result != 0)
 		{
-			GD::out.printError("Error: Could not open firmware file: " + firmwareFile + ".");
-			_bl->deviceUpdateInfo.results[id].first = 4;
-			_bl->deviceUpdateInfo.results[id].second = "Could not open firmware file.";
-			_updateMutex.unlock();
-			_updateMode = false;
-			return;
-		}
-
-		std::stringstream stream(firmwareHex);
-		std::string line;
-		int32_t currentAddress = 0;
-		std::vector<uint8_t> firmware;
-		while(std::getline(stream, line))
-		{
-			if(line.at(0) != ':' || line.size() < 11)
-			{
-				_bl->deviceUpdateInfo.results[id].first = 5;
-				_bl->deviceUpdateInfo.results[id].second = "Firmware file has wrong format.";
-				GD::out.printError("Error: Could not read firmware file: " + firmwareFile + ": Wrong format (no colon at position 0 or line too short).");
-				_updateMutex.unlock();
-				_updateMode = false;
-				return;
-			}
-			std::string hex = line.substr(1, 2);
-			int32_t bytes = BaseLib::Math::getNumber(hex, true);
-			hex = line.substr(7, 2);
-			int32_t recordType = BaseLib::Math::getNumber(hex, true);
-			if(recordType == 1) break; //End of file
-			if(recordType != 0)
-			{
-				_bl->deviceUpdateInfo.results[id].first = 5;
-				_bl->deviceUpdateInfo.results[id].second = "Firmware file has wrong format.";
-				GD::out.printError("Error: Could not read firmware file: " + firmwareFile + ": Wrong format (wrong record type).");
-				_updateMutex.unlock();
-				_updateMode = false;
-				return;
-			}
-			hex = line.substr(3, 4);
-			int32_t address = BaseLib::Math::getNumber(hex, true);
-			if(address != currentAddress || (11 + bytes * 2) > (signed)line.size())
-			{
-				_bl->deviceUpdateInfo.results[id].first = 5;
-				_bl->deviceUpdateInfo.results[id].second = "Firmware file has wrong format.";
-				GD::out.printError("Error: Could not read firmware file: " + firmwareFile + ": Wrong format (address does not match).");
-				_updateMutex.unlock();
-				_updateMode = false;
-				return;
-			}
-			currentAddress += bytes;
-			std::vector<uint8_t> data = _bl->hf.getUBinary(line.substr(9, bytes * 2));
-			hex = line.substr(9 + bytes * 2, 2);
-			int32_t checkSum = BaseLib::Math::getNumber(hex, true);
-			int32_t calculatedCheckSum = bytes + (address >> 8) + (address & 0xFF) + recordType;
-			for(std::vector<uint8_t>::iterator i = data.begin(); i != data.end(); ++i)
-			{
-				calculatedCheckSum += *i;
-			}
-			calculatedCheckSum = (((calculatedCheckSum & 0xFF) ^ 0xFF) + 1) & 0xFF;
-			if(calculatedCheckSum != checkSum)
-			{
-				_bl->deviceUpdateInfo.results[id].first = 5;
-				_bl->deviceUpdateInfo.results[id].second = "Firmware file has wrong format.";
-				GD::out.printError("Error: Could not read firmware file: " + firmwareFile + ": Wrong format (check sum failed).");
-				_updateMutex.unlock();
-				_updateMode = false;
-				return;
-			}
-			firmware.insert(firmware.end(), data.begin(), data.end());
-		}
-
-		lockBus();
-
-		std::shared_ptr<HMWiredPacket> response = getResponse(0x75, peer->getAddress(), true);
-		if(!response || response->type() != HMWiredPacketType::ackMessage)
-		{
-			unlockBus();
-			_bl->deviceUpdateInfo.results[id].first = 6;
-			_bl->deviceUpdateInfo.results[id].second = "Device did not respond to enter-bootloader packet.";
-			GD::out.printWarning("Warning: Device did not enter bootloader.");
-			_updateMutex.unlock();
-			_updateMode = false;
-			return;
-		}
-
-		//Wait for the device to enter bootloader
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-
-		std::vector<uint8_t> payload;
-		payload.push_back(0x75);
-		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, 0, peer->getAddress(), false, getMessageCounter(peer->getAddress()), 0, 0, payload));
-		response = getResponse(packet, true);
-		if(!response || response->type() != HMWiredPacketType::system)
-		{
-			unlockBus();
-			_bl->deviceUpdateInfo.results[id].first = 6;
-			_bl->deviceUpdateInfo.results[id].second = "Device did not respond to enter-bootloader packet.";
-			GD::out.printWarning("Warning: Device did not enter bootloader.");
-			_updateMutex.unlock();
-			_updateMode = false;
-			return;
-		}
-
-		payload.clear();
-		payload.push_back(0x70);
-		packet.reset(new HMWiredPacket(HMWiredPacketType::iMessage, 0, peer->getAddress(), false, getMessageCounter(peer->getAddress()), 0, 0, payload));
-		response = getResponse(packet, true);
-		int32_t packetSize = 0;
-		if(response && response->payload().size() == 2) packetSize = (response->payload().at(0) << 8) + response->payload().at(1);
-		if(!response || response->type() != HMWiredPacketType::system || response->payload().size() != 2 || packetSize > 128 || packetSize == 0)
-		{
-			unlockBus();
-			_bl->deviceUpdateInfo.results[id].first = 8;
-			_bl->deviceUpdateInfo.results[id].second = "Too many communication errors (block size request failed).";
-			GD::out.printWarning("Error: Block size request failed.");
-			_updateMutex.unlock();
-			_updateMode = false;
+			GD::out.printError("Error: Could not read firmware file: " + firmwareFile + ": " + image->error);
+			setUpdateResult(id, image->result, (image->result == 4) ? "Could not open firmware file." : "Firmware file has wrong format.");
 			return;
 		}
 
-		std::vector<uint8_t> data;
-		for(int32_t i = 0; i < (signed)firmware.size(); i += packetSize)
+		interfaceId = peer->getPhysicalInterfaceId();
+		if(!busLocked) lockBus(interfaceId);
+		else if(!*busLocked)
 		{
-			_bl->deviceUpdateInfo.currentDeviceProgress = (i * 100) / firmware.size();
-			int32_t currentPacketSize = (i + packetSize < (signed)firmware.size()) ? packetSize : firmware.size() - i;
-			data.clear();
-			data.push_back(0x77); //Type
-			data.push_back(i >> 8); //Address
-			data.push_back(i & 0xFF); //Address
-			data.push_back(currentPacketSize); //Length
-			data.insert(data.end(), firmware.begin() + i, firmware.begin() + i + currentPacketSize);
-
-			std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, 0, peer->getAddress(), false, getMessageCounter(peer->getAddress()), 0, 0, data));
-			response = getResponse(packet, true);
-			if(!response || response->type() != HMWiredPacketType::system || response->payload().size() != 2)
-			{
-				unlockBus();
-				_bl->deviceUpdateInfo.results[id].first = 8;
-				_bl->deviceUpdateInfo.results[id].second = "Too many communication errors.";
-				GD::out.printWarning("Error: Block size request failed.");
-				_updateMutex.unlock();
-				_updateMode = false;
-				return;
-			}
-			int32_t receivedBytes = (response->payload().at(0) << 8) + response->payload().at(1);
-			if(receivedBytes != currentPacketSize)
-			{
-				unlockBus();
-				_bl->deviceUpdateInfo.results[id].first = 8;
-				_bl->deviceUpdateInfo.results[id].second = "Too many communication errors (device received wrong number of bytes).";
-				GD::out.printWarning("Error: Block size request failed.");
-				_updateMutex.unlock();
-				_updateMode = false;
-				return;
-			}
+			lockBus(interfaceId);
+			*busLocked = true;
 		}
-
-		payload.clear();
-		payload.push_back(0x67);
-		packet.reset(new HMWiredPacket(HMWiredPacketType::iMessage, 0, peer->getAddress(), false, getMessageCounter(peer->getAddress()), 0, 0, payload));
-		for(int32_t i = 0; i < 3; i++)
+		FirmwareUpdater updater(this, peer);
+		std::string message;
+		int32_t result = updater.update(image->data, firmwareVersion, message);
+		if(!busLocked) unlockBus(interfaceId);
+
+		std::string stats = updater.getStats().toString();
+		setUpdateResult(id, result, message + " " + stats + ".");
+		if(result != 0)
 		{
-			sendPacket(packet, false);
-			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			GD::out.printWarning("Error: Firmware update of peer " + std::to_string(id) + " failed: " + message + " " + stats + ".");
+			return;
 		}
 
-		unlockBus();
-
 		peer->setFirmwareVersion(firmwareVersion);
-		_bl->deviceUpdateInfo.results[id].first = 0;
-		_bl->deviceUpdateInfo.results[id].second = "Update successful.";
-		GD::out.printInfo("Info: Peer " + std::to_string(id) + " was successfully updated to firmware version " + versionString + ".");
-		_updateMutex.unlock();
-		_updateMode = false;
+		GD::out.printInfo("Info: Peer " + std::to_string(id) + " was successfully updated to firmware version " + versionString + ". " + stats + ".");
 		return;
 	}
 	catch(const std::exception& ex)
@@ -1637,59 +2497,76 @@ void HMWiredCentral::updateFirmware(uint64_t id)
     {
         GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
     }
-    unlockBus();
-    _bl->deviceUpdateInfo.results[id].first = 1;
-	_bl->deviceUpdateInfo.results[id].second = "Unknown error.";
-    _updateMutex.unlock();
-    _updateMode = false;
+    if(!busLocked && !interfaceId.empty()) unlockBus(interfaceId);
+    setUpdateResult(id, 1, "Unknown error.");
+}
+
+bool HMWiredCentral::beginPeerInit(int32_t address)
+{
+	std::lock_guard<std::mutex> peerInitGuard(_peerInitMutex);
+	if(_peersInitializing.find(address) != _peersInitializing.end() || getPeer(address)) return false;
+	_peersInitializing.insert(address);
+	return true;
+}
+
+void HMWiredCentral::endPeerInit(int32_t address)
+{
+	std::lock_guard<std::mutex> peerInitGuard(_peerInitMutex);
+	_peersInitializing.erase(address);
+}
+
+void HMWiredCentral::scheduleMaintenance(uint64_t peerId, const std::string& interfaceId, MaintenanceType type, int64_t interval)
+{
+	if(_maintenanceScheduler) _maintenanceScheduler->schedule(peerId, interfaceId, type, interval);
 }
 
-void HMWiredCentral::handleAnnounce(std::shared_ptr<HMWiredPacket> packet)
+void HMWiredCentral::postponeMaintenance(uint64_t peerId)
 {
+	if(_maintenanceScheduler) _maintenanceScheduler->postpone(peerId);
+}
+
+AnnounceResult HMWiredCentral::handleAnnounce(std::shared_ptr<HMWiredPacket> packet)
+{
+	int32_t address = packet->senderAddress();
+	if(!beginPeerInit(address)) return AnnounceResult::skipped;
+	bool initializing = true;
 	try
 	{
-		_peerInitMutex.lock();
-		if(getPeer(packet->senderAddress()))
-		{
-			_peerInitMutex.unlock();
-			return;
-		}
 		GD::out.printInfo("Info: New device detected on bus.");
 		if(packet->payload().size() != 16)
 		{
 			GD::out.printWarning("Warning: Could not interpret announce packet: Packet has unknown size (payload size has to be 16).");
-			_peerInitMutex.unlock();
-			return;
+			endPeerInit(address);
+			return AnnounceResult::failed;
 		}
 		int32_t deviceType = (packet->payload().at(2) << 8) + packet->payload().at(3);
 		int32_t firmwareVersion = (packet->payload().at(4) << 8) + packet->payload().at(5);
 		std::string serialNumber((char*)&packet->payload().at(6), 10);
 
-		std::shared_ptr<HMWiredPeer> peer = createPeer(packet->senderAddress(), firmwareVersion, deviceType, serialNumber, true);
+		std::shared_ptr<HMWiredPeer> peer = createPeer(address, firmwareVersion, deviceType, serialNumber, true);
 		if(!peer)
 		{
-			GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(packet->senderAddress(), 8) + " (type: 0x" + BaseLib::HelperFunctions::getHexString(deviceType, 4) + ", firmware version: 0x" + BaseLib::HelperFunctions::getHexString(firmwareVersion, 4) + "). No matching XML file was found.");
-			_peerInitMutex.unlock();
-			return;
+			GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(address, 8) + " (type: 0x" + BaseLib::HelperFunctions::getHexString(deviceType, 4) + ", firmware version: 0x" + BaseLib::HelperFunctions::getHexString(firmwareVersion, 4) + "). No matching XML file was found.");
+			endPeerInit(address);
+			return AnnounceResult::failed;
 		}
 
-		if(peerInit(peer))
+		bool paired = peerInit(peer);
+		endPeerInit(address);
+		initializing = false;
+		if(!paired) return AnnounceResult::failed;
+
+		PVariable deviceDescriptions(new Variable(VariableType::tArray));
+		peer->restoreLinks();
+		std::shared_ptr<std::vector<PVariable>> descriptions = peer->getDeviceDescriptions(nullptr, true, std::map<std::string, bool>());
+		if(!descriptions) return AnnounceResult::paired;
+		for(std::vector<PVariable>::iterator j = descriptions->begin(); j != descriptions->end(); ++j)
 		{
-			PVariable deviceDescriptions(new Variable(VariableType::tArray));
-			peer->restoreLinks();
-			std::shared_ptr<std::vector<PVariable>> descriptions = peer->getDeviceDescriptions(nullptr, true, std::map<std::string, bool>());
-			if(!descriptions)
-			{
-				_peerInitMutex.unlock();
-				return;
-			}
-			for(std::vector<PVariable>::iterator j = descriptions->begin(); j != descriptions->end(); ++j)
-			{
-				deviceDescriptions->arrayValue->push_back(*j);
-			}
-            std::vector<uint64_t> newIds{ peer->getID() };
-			raiseRPCNewDevices(newIds, deviceDescriptions);
+			deviceDescriptions->arrayValue->push_back(*j);
 		}
+		std::vector<uint64_t> newIds{ peer->getID() };
+		raiseRPCNewDevices(newIds, deviceDescriptions);
+		return AnnounceResult::paired;
 	}
 	catch(const std::exception& ex)
 	{
@@ -1699,7 +2576,8 @@ void HMWiredCentral::handleAnnounce(std::shared_ptr<HMWiredPacket> packet)
 	{
 		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 	}
-	_peerInitMutex.unlock();
+	if(initializing) endPeerInit(address);
+	return AnnounceResult::failed;
 }
 
 bool HMWiredCentral::peerInit(std::shared_ptr<HMWiredPeer> peer)
@@ -1713,6 +2591,7 @@ bool HMWiredCentral::peerInit(std::shared_ptr<HMWiredPeer> peer)
 		std::vector<uint8_t> parameterData = readEEPROM(address, 0);
 		peer->binaryConfig[0].setBinaryData(parameterData);
 		peer->saveParameter(peer->binaryConfig[0].databaseId, 0, parameterData);
+		peer->configBlockChanged(0);
 		if(parameterData.size() != 0x10)
 		{
 			peer->deleteFromDatabase();
@@ -1761,6 +2640,7 @@ bool HMWiredCentral::peerInit(std::shared_ptr<HMWiredPeer> peer)
 						parameterData = readEEPROM(peer->getAddress(), configIndex);
 						peer->binaryConfig[configIndex].setBinaryData(parameterData);
 						peer->saveParameter(peer->binaryConfig[configIndex].databaseId, configIndex, parameterData);
+						peer->configBlockChanged(configIndex);
 						if(parameterData.size() != 0x10) GD::out.printError("Error: HomeMatic Wired Central: Error reading config from device with address 0x" + BaseLib::HelperFunctions::getHexString(address, 8) + ". Size is not 16 bytes.");
 					}
 				}
@@ -1773,8 +2653,14 @@ bool HMWiredCentral::peerInit(std::shared_ptr<HMWiredPeer> peer)
 			_peers[address] = peer;
 			if(!peer->getSerialNumber().empty()) _peersBySerial[peer->getSerialNumber()] = peer;
 			_peersById[peer->getID()] = peer;
-			peer->setMessageCounter(_messageCounter[address]);
-			_messageCounter.erase(address);
+			std::lock_guard<std::mutex> messageCounterGuard(_messageCounterMutex);
+			std::unordered_map<int32_t, uint8_t>::iterator messageCounterIterator = _messageCounter.find(address);
+			if(messageCounterIterator != _messageCounter.end())
+			{
+				peer->setMessageCounter(messageCounterIterator->second);
+				_messageCounter.erase(messageCounterIterator);
+			}
+			else peer->setMessageCounter(0);
 		}
 		catch(const std::exception& ex)
 		{
@@ -1785,6 +2671,8 @@ bool HMWiredCentral::peerInit(std::shared_ptr<HMWiredPeer> peer)
 			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 		}
 		_peersMutex.unlock();
+		//Build the ACK frames now, so the first ACK on the receiving thread doesn't need to. Only frames of registered peers are cached.
+		getAckFrames(address);
 		return true;
 	}
 	catch(const std::exception& ex)
@@ -1823,13 +2711,41 @@ PVariable HMWiredCentral::addLink(BaseLib::PRpcClientInfo clientInfo, std::strin
 }
 
 PVariable HMWiredCentral::addLink(BaseLib::PRpcClientInfo clientInfo, uint64_t senderID, int32_t senderChannelIndex, uint64_t receiverID, int32_t receiverChannelIndex, std::string name, std::string description)
+{
+	try
+	{
+		PVariable links(new Variable(VariableType::tArray));
+		PVariable link(new Variable(VariableType::tStruct));
+		link->structValue->insert(StructElement("SENDER_ID", PVariable(new Variable((uint64_t)senderID))));
+		link->structValue->insert(StructElement("SENDER_CHANNEL", PVariable(new Variable(senderChannelIndex))));
+		link->structValue->insert(StructElement("RECEIVER_ID", PVariable(new Variable((uint64_t)receiverID))));
+		link->structValue->insert(StructElement("RECEIVER_CHANNEL", PVariable(new Variable(receiverChannelIndex))));
+		link->structValue->insert(StructElement("NAME", PVariable(new Variable(name))));
+		link->structValue->insert(StructElement("DESCRIPTION", PVariable(new Variable(description))));
+		links->arrayValue->push_back(link);
+		PVariable result = addLinks(clientInfo, links);
+		if(result->errorStruct || result->arrayValue->empty()) return result;
+		return result->arrayValue->at(0);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return Variable::createError(-32500, "Unknown application error.");
+}
+
+PVariable HMWiredCentral::prepareLink(BaseLib::PRpcClientInfo clientInfo, uint64_t senderID, int32_t senderChannelIndex, uint64_t receiverID, int32_t receiverChannelIndex, std::string name, std::string description, std::shared_ptr<HMWiredPeer>& sender, std::shared_ptr<HMWiredPeer>& receiver, std::shared_ptr<BaseLib::Systems::BasicPeer>& senderPeer, std::shared_ptr<BaseLib::Systems::BasicPeer>& receiverPeer)
 {
 	try
 	{
 		if(senderID == 0) return Variable::createError(-2, "Given sender id is not set.");
 		if(receiverID == 0) return Variable::createError(-2, "Given receiver id is not set.");
-		std::shared_ptr<HMWiredPeer> sender = getPeer(senderID);
-		std::shared_ptr<HMWiredPeer> receiver = getPeer(receiverID);
+		sender = getPeer(senderID);
+		receiver = getPeer(receiverID);
 		if(!sender) return Variable::createError(-2, "Sender device not found.");
 		if(!receiver) return Variable::createError(-2, "Receiver device not found.");
 		if(senderChannelIndex < 0) senderChannelIndex = 0;
@@ -1882,25 +2798,28 @@ PVariable HMWiredCentral::addLink(BaseLib::PRpcClientInfo clientInfo, uint64_t s
             }
         }
 
-        std::shared_ptr<BaseLib::Systems::BasicPeer> senderPeer(new BaseLib::Systems::BasicPeer());
         if(!senderLinked)
         {
+            senderPeer.reset(new BaseLib::Systems::BasicPeer());
             senderPeer->isSender = true;
             senderPeer->id = sender->getID();
             senderPeer->address = sender->getAddress();
             senderPeer->channel = senderChannelIndex;
             senderPeer->physicalIndexOffset = senderFunction->physicalChannelIndexOffset;
             senderPeer->serialNumber = sender->getSerialNumber();
-            senderPeer->isSender = true;
             senderPeer->linkDescription = description;
             senderPeer->linkName = name;
-            senderPeer->configEEPROMAddress = receiver->getFreeEEPROMAddress(receiverChannelIndex, false);
-            if(senderPeer->configEEPROMAddress == -1) return Variable::createError(-32500, "Can't get free eeprom address to store config.");
+            senderPeer->configEEPROMAddress = receiver->getFreeEEPROMAddress(receiverChannelIndex, false, true);
+            if(senderPeer->configEEPROMAddress == -1)
+            {
+                senderPeer.reset();
+                return Variable::createError(-32500, "Can't get free eeprom address to store config.");
+            }
         }
 
-        std::shared_ptr<BaseLib::Systems::BasicPeer> receiverPeer(new BaseLib::Systems::BasicPeer());
         if(!receiverLinked)
         {
+            receiverPeer.reset(new BaseLib::Systems::BasicPeer());
             receiverPeer->id = receiver->getID();
             receiverPeer->address = receiver->getAddress();
             receiverPeer->channel = receiverChannelIndex;
@@ -1908,25 +2827,147 @@ PVariable HMWiredCentral::addLink(BaseLib::PRpcClientInfo clientInfo, uint64_t s
             receiverPeer->serialNumber = receiver->getSerialNumber();
             receiverPeer->linkDescription = description;
             receiverPeer->linkName = name;
-            receiverPeer->configEEPROMAddress = sender->getFreeEEPROMAddress(senderChannelIndex, true);
-            if(receiverPeer->configEEPROMAddress == -1) return Variable::createError(-32500, "Can't get free eeprom address to store config.");
+            receiverPeer->configEEPROMAddress = sender->getFreeEEPROMAddress(senderChannelIndex, true, true);
+            if(receiverPeer->configEEPROMAddress == -1)
+            {
+                if(senderPeer) receiver->releaseEEPROMAddress(receiverChannelIndex, senderPeer->configEEPROMAddress);
+                senderPeer.reset();
+                receiverPeer.reset();
+                return Variable::createError(-32500, "Can't get free eeprom address to store config.");
+            }
         }
 
-        if(!senderLinked)
-        {
-            sender->addPeer(senderChannelIndex, receiverPeer);
-            sender->initializeLinkConfig(senderChannelIndex, receiverPeer);
-            raiseRPCUpdateDevice(sender->getID(), senderChannelIndex, sender->getSerialNumber() + ":" + std::to_string(senderChannelIndex), 1);
-        }
+		return std::make_shared<Variable>(VariableType::tVoid);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return Variable::createError(-32500, "Unknown application error.");
+}
 
-        if(!receiverLinked)
-        {
-            receiver->addPeer(receiverChannelIndex, senderPeer);
-            receiver->initializeLinkConfig(receiverChannelIndex, senderPeer);
-            raiseRPCUpdateDevice(receiver->getID(), receiverChannelIndex, receiver->getSerialNumber() + ":" + std::to_string(receiverChannelIndex), 1);
-        }
+PVariable HMWiredCentral::addLinks(BaseLib::PRpcClientInfo clientInfo, PVariable links)
+{
+	try
+	{
+		if(!links || links->type != VariableType::tArray) return Variable::createError(-5, "Parameter is not an array of links.");
+		PVariable results(new Variable(VariableType::tArray));
+		results->arrayValue->reserve(links->arrayValue->size());
+
+		//Links are collected per peer first, so every peer's EEPROM is written with one write plan and its links are saved once
+		std::map<uint64_t, std::shared_ptr<HMWiredPeer>> peers;
+		std::map<uint64_t, std::vector<std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>>> peerLinks;
+		std::map<uint64_t, std::vector<int32_t>> peerResults;
+		std::set<std::string> requestedLinks;
+		//Sender ID, sender channel, receiver ID and receiver channel of every prepared link by result index
+		std::map<int32_t, std::tuple<uint64_t, int32_t, uint64_t, int32_t>> preparedLinks;
+		for(uint32_t i = 0; i < links->arrayValue->size(); i++)
+		{
+			PVariable link = links->arrayValue->at(i);
+			if(!link || link->type != VariableType::tStruct)
+			{
+				results->arrayValue->push_back(Variable::createError(-5, "Link is not a struct."));
+				continue;
+			}
+			uint64_t senderID = 0;
+			uint64_t receiverID = 0;
+			int32_t senderChannelIndex = 0;
+			int32_t receiverChannelIndex = 0;
+			std::string name;
+			std::string description;
+			for(Struct::iterator j = link->structValue->begin(); j != link->structValue->end(); ++j)
+			{
+				if(j->first == "SENDER_ID") senderID = j->second->integerValue64;
+				else if(j->first == "SENDER_CHANNEL") senderChannelIndex = j->second->integerValue;
+				else if(j->first == "RECEIVER_ID") receiverID = j->second->integerValue64;
+				else if(j->first == "RECEIVER_CHANNEL") receiverChannelIndex = j->second->integerValue;
+				else if(j->first == "NAME") name = j->second->stringValue;
+				else if(j->first == "DESCRIPTION") description = j->second->stringValue;
+			}
+			if(senderChannelIndex < 0) senderChannelIndex = 0;
+			if(receiverChannelIndex < 0) receiverChannelIndex = 0;
+			std::string linkKey = std::to_string(senderID) + ":" + std::to_string(senderChannelIndex) + "-" + std::to_string(receiverID) + ":" + std::to_string(receiverChannelIndex);
+			if(requestedLinks.find(linkKey) != requestedLinks.end())
+			{
+				results->arrayValue->push_back(Variable::createError(-6, "Link already exists."));
+				continue;
+			}
 
-		return std::make_shared<Variable>(VariableType::tVoid);
+			std::shared_ptr<HMWiredPeer> sender;
+			std::shared_ptr<HMWiredPeer> receiver;
+			std::shared_ptr<BaseLib::Systems::BasicPeer> senderPeer;
+			std::shared_ptr<BaseLib::Systems::BasicPeer> receiverPeer;
+			PVariable result = prepareLink(clientInfo, senderID, senderChannelIndex, receiverID, receiverChannelIndex, name, description, sender, receiver, senderPeer, receiverPeer);
+			results->arrayValue->push_back(result);
+			if(result->errorStruct) continue;
+			requestedLinks.insert(linkKey);
+			preparedLinks[i] = std::make_tuple(sender->getID(), senderChannelIndex, receiver->getID(), receiverChannelIndex);
+			if(receiverPeer)
+			{
+				peers[sender->getID()] = sender;
+				peerLinks[sender->getID()].push_back(std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>(senderChannelIndex, receiverPeer));
+				peerResults[sender->getID()].push_back(i);
+			}
+			if(senderPeer)
+			{
+				peers[receiver->getID()] = receiver;
+				peerLinks[receiver->getID()].push_back(std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>(receiverChannelIndex, senderPeer));
+				peerResults[receiver->getID()].push_back(i);
+			}
+		}
+
+		std::set<uint64_t> failedPeers;
+		for(std::map<uint64_t, std::vector<std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>>>::iterator i = peerLinks.begin(); i != peerLinks.end(); ++i)
+		{
+			std::shared_ptr<HMWiredPeer> peer = peers.at(i->first);
+			if(!peer->addLinks(i->second))
+			{
+				failedPeers.insert(i->first);
+				std::vector<int32_t>& resultIndexes = peerResults[i->first];
+				for(std::vector<int32_t>::iterator j = resultIndexes.begin(); j != resultIndexes.end(); ++j)
+				{
+					results->arrayValue->at(*j) = Variable::createError(-32500, "Could not write config to device's eeprom.");
+				}
+			}
+		}
+
+		//A link is only usable, when both peers have it. Remove the half, which was added, when the other peer failed.
+		if(!failedPeers.empty())
+		{
+			for(std::map<int32_t, std::tuple<uint64_t, int32_t, uint64_t, int32_t>>::iterator i = preparedLinks.begin(); i != preparedLinks.end(); ++i)
+			{
+				uint64_t senderID = std::get<0>(i->second);
+				int32_t senderChannel = std::get<1>(i->second);
+				uint64_t receiverID = std::get<2>(i->second);
+				int32_t receiverChannel = std::get<3>(i->second);
+				bool senderFailed = failedPeers.find(senderID) != failedPeers.end();
+				bool receiverFailed = failedPeers.find(receiverID) != failedPeers.end();
+				if(!senderFailed && !receiverFailed) continue;
+				if(!senderFailed && peers.find(senderID) != peers.end()) peers.at(senderID)->removePeer(senderChannel, receiverID, receiverChannel);
+				if(!receiverFailed && peers.find(receiverID) != peers.end()) peers.at(receiverID)->removePeer(receiverChannel, senderID, senderChannel);
+			}
+		}
+
+		for(std::map<uint64_t, std::vector<std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>>>::iterator i = peerLinks.begin(); i != peerLinks.end(); ++i)
+		{
+			if(failedPeers.find(i->first) != failedPeers.end()) continue;
+			std::shared_ptr<HMWiredPeer> peer = peers.at(i->first);
+			std::set<int32_t> channels;
+			for(std::vector<std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>>::iterator j = i->second.begin(); j != i->second.end(); ++j)
+			{
+				channels.insert(j->first);
+			}
+			for(std::set<int32_t>::iterator j = channels.begin(); j != channels.end(); ++j)
+			{
+				raiseRPCUpdateDevice(peer->getID(), *j, peer->getSerialNumber() + ":" + std::to_string(*j), 1);
+			}
+		}
+
+		return results;
 	}
 	catch(const std::exception& ex)
 	{
@@ -2102,90 +3143,177 @@ PVariable HMWiredCentral::removeLink(BaseLib::PRpcClientInfo clientInfo, uint64_
 	return Variable::createError(-32500, "Unknown application error.");
 }
 
-PVariable HMWiredCentral::searchDevices(BaseLib::PRpcClientInfo clientInfo, const std::string& interfaceId)
+std::shared_ptr<HMWiredPeer> HMWiredCentral::pairDevice(int32_t address)
+{
+	if(!beginPeerInit(address)) return std::shared_ptr<HMWiredPeer>();
+	std::shared_ptr<HMWiredPeer> peer = initPeer(address);
+	endPeerInit(address);
+	return peer;
+}
+
+std::shared_ptr<HMWiredPeer> HMWiredCentral::initPeer(int32_t address)
 {
 	try
 	{
-		lockBus();
-		_pairing = true;
-		std::vector<int32_t> foundDevices;
-		GD::physicalInterface->search(foundDevices);
-		unlockBus();
-		GD::out.printInfo("Info: Search completed. Found " + std::to_string(foundDevices.size()) + " devices.");
-		std::vector<std::shared_ptr<HMWiredPeer>> newPeers;
-		_peerInitMutex.lock();
-		try
+		//Get device type:
+		std::shared_ptr<HMWiredPacket> response = getResponse(0x68, address, true);
+		if(!response || response->payload().size() != 2)
 		{
-			for(std::vector<int32_t>::iterator i = foundDevices.begin(); i != foundDevices.end(); ++i)
-			{
-				if(getPeer(*i)) continue;
+			GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(address, 8) + ". Device type request failed.");
+			return std::shared_ptr<HMWiredPeer>();
+		}
+		uint32_t deviceType = (response->payload().at(0) << 8) + response->payload().at(1);
 
-				//Get device type:
-				std::shared_ptr<HMWiredPacket> response = getResponse(0x68, *i, true);
-				if(!response || response->payload().size() != 2)
-				{
-					GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(*i, 8) + ". Device type request failed.");
-					continue;
-				}
-				uint32_t deviceType = (response->payload().at(0) << 8) + response->payload().at(1);
+		//Get firmware version:
+		response = getResponse(0x76, address);
+		if(!response || response->payload().size() != 2)
+		{
+			GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(address, 8) + ". Firmware version request failed.");
+			return std::shared_ptr<HMWiredPeer>();
+		}
+		int32_t firmwareVersion = (response->payload().at(0) << 8) + response->payload().at(1);
 
-				//Get firmware version:
-				response = getResponse(0x76, *i);
-				if(!response || response->payload().size() != 2)
-				{
-					GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(*i, 8) + ". Firmware version request failed.");
-					continue;
-				}
-				int32_t firmwareVersion = (response->payload().at(0) << 8) + response->payload().at(1);
+		//Get serial number:
+		response = getResponse(0x6E, address);
+		if(!response || response->payload().empty())
+		{
+			GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(address, 8) + ". Serial number request failed.");
+			return std::shared_ptr<HMWiredPeer>();
+		}
+		std::string serialNumber((char*)&response->payload().at(0), response->payload().size());
 
-				//Get serial number:
-				response = getResponse(0x6E, *i);
-				if(!response || response->payload().empty())
-				{
-					GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(*i, 8) + ". Serial number request failed.");
-					continue;
-				}
-				std::string serialNumber((char*)&response->payload().at(0), response->payload().size());
+		std::shared_ptr<HMWiredPeer> peer = createPeer(address, firmwareVersion, deviceType, serialNumber, true);
+		if(!peer)
+		{
+			GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(address, 8) + " (type: 0x" + BaseLib::HelperFunctions::getHexString(deviceType, 4) + ", firmware version: 0x" + BaseLib::HelperFunctions::getHexString(firmwareVersion, 4) + "). No matching XML file was found.");
+			return std::shared_ptr<HMWiredPeer>();
+		}
 
-				std::shared_ptr<HMWiredPeer> peer = createPeer(*i, firmwareVersion, deviceType, serialNumber, true);
-				if(!peer)
-				{
-					GD::out.printError("Error: HomeMatic Wired Central: Could not pair device with address 0x" + BaseLib::HelperFunctions::getHexString(*i, 8) + " (type: 0x" + BaseLib::HelperFunctions::getHexString(deviceType, 4) + ", firmware version: 0x" + BaseLib::HelperFunctions::getHexString(firmwareVersion, 4) + "). No matching XML file was found.");
-					continue;
-				}
+		if(peerInit(peer)) return peer;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return std::shared_ptr<HMWiredPeer>();
+}
 
-				if(peerInit(peer)) newPeers.push_back(peer);;
+void HMWiredCentral::searchBus(std::shared_ptr<BusState> bus, bool incremental, std::vector<std::shared_ptr<HMWiredPeer>>* newPeers)
+{
+	try
+	{
+		std::string interfaceId = bus->physicalInterface->getID();
+		std::set<int32_t> knownDevices;
+		if(incremental)
+		{
+			std::lock_guard<std::mutex> peersGuard(_peersMutex);
+			for(std::unordered_map<int32_t, std::shared_ptr<BaseLib::Systems::Peer>>::iterator i = _peers.begin(); i != _peers.end(); ++i)
+			{
+				std::shared_ptr<HMWiredPeer> peer(std::dynamic_pointer_cast<HMWiredPeer>(i->second));
+				if(peer && peer->getPhysicalInterface() == bus->physicalInterface) knownDevices.insert(i->first);
 			}
+		}
 
-			if(newPeers.size() > 0)
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::vector<int32_t> foundDevices;
+		lockBus(interfaceId);
+		bus->physicalInterface->search(foundDevices, knownDevices);
+		unlockBus(interfaceId);
+
+		{
+			std::lock_guard<std::mutex> addressInterfacesGuard(_addressInterfacesMutex);
+			for(std::vector<int32_t>::iterator i = foundDevices.begin(); i != foundDevices.end(); ++i)
 			{
-				std::vector<uint64_t> newIds;
-				newIds.reserve(newPeers.size());
-				PVariable deviceDescriptions(new Variable(VariableType::tArray));
-				for(std::vector<std::shared_ptr<HMWiredPeer>>::iterator i = newPeers.begin(); i != newPeers.end(); ++i)
-				{
-					(*i)->restoreLinks();
-					std::shared_ptr<std::vector<PVariable>> descriptions = (*i)->getDeviceDescriptions(clientInfo, true, std::map<std::string, bool>());
-					if(!descriptions) continue;
-					newIds.push_back((*i)->getID());
-					for(std::vector<PVariable>::iterator j = descriptions->begin(); j != descriptions->end(); ++j)
-					{
-						deviceDescriptions->arrayValue->push_back(*j);
-					}
-				}
-				raiseRPCNewDevices(newIds, deviceDescriptions);
+				if(knownDevices.find(*i) == knownDevices.end()) _addressInterfaces[*i] = interfaceId;
 			}
 		}
-		catch(const std::exception& ex)
+
+		//The devices of one bus are paired one after the other. Every step of pairDevice() is a request/response
+		//transaction and the bus can only carry one transaction at a time, so pipelining them would only make the
+		//requests collide. Only the buses themselves are paired in parallel.
+		uint32_t newDevices = 0;
+		for(std::vector<int32_t>::iterator i = foundDevices.begin(); i != foundDevices.end(); ++i)
 		{
-			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			if(getPeer(*i)) continue;
+			newDevices++;
+			std::shared_ptr<HMWiredPeer> peer = pairDevice(*i);
+			if(peer) newPeers->push_back(peer);
 		}
-		catch(...)
+		int64_t duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+		GD::out.printInfo("Info: Search on interface \"" + interfaceId + "\" completed in " + std::to_string(duration) + " ms. Found " + std::to_string(foundDevices.size()) + " devices (" + std::to_string(newDevices) + " new, " + std::to_string(newPeers->size()) + " paired).");
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+PVariable HMWiredCentral::searchDevices(BaseLib::PRpcClientInfo clientInfo, const std::string& interfaceId)
+{
+	return searchDevices(clientInfo, interfaceId, true);
+}
+
+PVariable HMWiredCentral::searchDevices(BaseLib::PRpcClientInfo clientInfo, const std::string& interfaceId, bool incremental)
+{
+	try
+	{
+		std::vector<std::shared_ptr<BusState>> buses;
+		if(interfaceId.empty())
 		{
-			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+			for(std::map<std::string, std::shared_ptr<BusState>>::iterator i = _buses.begin(); i != _buses.end(); ++i)
+			{
+				buses.push_back(i->second);
+			}
+		}
+		else
+		{
+			std::map<std::string, std::shared_ptr<BusState>>::iterator busIterator = _buses.find(interfaceId);
+			if(busIterator == _buses.end()) return Variable::createError(-2, "Unknown interface.");
+			buses.push_back(busIterator->second);
+		}
+
+		_pairing = true;
+		//The buses are searched and paired in parallel, the devices of one bus sequentially (see searchBus())
+		std::vector<std::vector<std::shared_ptr<HMWiredPeer>>> newPeersByBus(buses.size());
+		std::vector<std::thread> threads(buses.size());
+		for(uint32_t i = 0; i < buses.size(); i++)
+		{
+			_bl->threadManager.start(threads.at(i), false, &HMWiredCentral::searchBus, this, buses.at(i), incremental, &newPeersByBus.at(i));
+		}
+		std::vector<std::shared_ptr<HMWiredPeer>> newPeers;
+		for(uint32_t i = 0; i < buses.size(); i++)
+		{
+			_bl->threadManager.join(threads.at(i));
+			newPeers.insert(newPeers.end(), newPeersByBus.at(i).begin(), newPeersByBus.at(i).end());
 		}
-		_peerInitMutex.unlock();
 		_pairing = false;
+
+		if(newPeers.size() > 0)
+		{
+			std::vector<uint64_t> newIds;
+			newIds.reserve(newPeers.size());
+			PVariable deviceDescriptions(new Variable(VariableType::tArray));
+			for(std::vector<std::shared_ptr<HMWiredPeer>>::iterator i = newPeers.begin(); i != newPeers.end(); ++i)
+			{
+				(*i)->restoreLinks();
+				std::shared_ptr<std::vector<PVariable>> descriptions = (*i)->getDeviceDescriptions(clientInfo, true, std::map<std::string, bool>());
+				if(!descriptions) continue;
+				newIds.push_back((*i)->getID());
+				for(std::vector<PVariable>::iterator j = descriptions->begin(); j != descriptions->end(); ++j)
+				{
+					deviceDescriptions->arrayValue->push_back(*j);
+				}
+			}
+			raiseRPCNewDevices(newIds, deviceDescriptions);
+		}
 		return PVariable(new Variable((uint32_t)newPeers.size()));
 	}
 	catch(const std::exception& ex)
@@ -2197,7 +3325,6 @@ PVariable HMWiredCentral::searchDevices(BaseLib::PRpcClientInfo clientInfo, cons
 		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 	}
 	_pairing = false;
-	unlockBus();
 	return Variable::createError(-32500, "Unknown application error.");
 }
 
@@ -33,14 +33,48 @@
 #include <homegear-base/BaseLib.h>
 #include "HMWiredPeer.h"
 #include "HMWiredPacketManager.h"
+#include "PacketDispatcher.h"
+#include "EventCoalescer.h"
+#include "FirmwareUpdater.h"
+#include "PairingQueue.h"
 
+#include <array>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 
 namespace HMWired
 {
 
+/**
+ * A fully encoded and escaped ACK frame.
+ */
+class AckFrame
+{
+public:
+	std::shared_ptr<HMWiredPacket> packet;
+	std::vector<uint8_t> data;
+};
+
+/**
+ * The ACK frames for one destination indexed by the receiver message counter.
+ */
+typedef std::array<AckFrame, 4> AckFrames;
+
+/**
+ * The state of one bus. Every interface has its own timing and its own pending requests, so the traffic on different buses doesn't
+ * block each other. Packets are sent on the calling thread and not through a send queue, so ACKs never wait behind requests.
+ */
+class BusState
+{
+public:
+	std::shared_ptr<IHMWiredInterface> physicalInterface;
+	HMWiredPacketManager receivedPackets;
+	HMWiredPacketManager sentPackets;
+};
+
 class HMWiredCentral : public BaseLib::Systems::ICentral
 {
 public:
@@ -49,40 +83,141 @@ public:
 	virtual ~HMWiredCentral();
 	virtual void dispose(bool wait = true);
 
+	/**
+	 * Processes a received packet on the dispatcher's thread.
+	 *
+	 * @param acknowledged Set to true, when the receiving thread sends the ACK.
+	 */
+	void dispatchPacket(std::shared_ptr<HMWiredPacket> packet, bool acknowledged);
+
+	/**
+	 * Returns the coalescer for the events of the peers or nullptr, when the central is not initialized.
+	 */
+	EventCoalescer* getEventCoalescer() { return _eventCoalescer.get(); }
+
 	std::shared_ptr<HMWiredPeer> getPeer(int32_t address);
 	std::shared_ptr<HMWiredPeer> getPeer(uint64_t id);
 	std::shared_ptr<HMWiredPeer> getPeer(std::string serialNumber);
 	virtual void saveMessageCounters();
+
+	/**
+	 * Saves the message counters of all peers, which changed since they were saved last.
+	 */
+	void savePeerMessageCounters();
 	virtual void serializeMessageCounters(std::vector<uint8_t>& encodedData);
 	virtual void unserializeMessageCounters(std::shared_ptr<std::vector<char>> serializedData);
 	virtual uint8_t getMessageCounter(int32_t destinationAddress);
 
 	virtual bool isInPairingMode() { return _pairing; }
+
+	/**
+	 * Sends a packet on the interface of the destination.
+	 * @see getBus(int32_t)
+	 */
 	virtual std::shared_ptr<HMWiredPacket> sendPacket(std::shared_ptr<HMWiredPacket> packet, bool resend, bool systemResponse = false);
-	std::shared_ptr<HMWiredPacket> getSentPacket(int32_t address) { return _sentPackets.get(address); }
+	std::shared_ptr<HMWiredPacket> getSentPacket(int32_t address) { return getBus(address)->sentPackets.get(address); }
 
 	virtual std::shared_ptr<HMWiredPacket> getResponse(uint8_t command, int32_t destinationAddress, bool synchronizationBit = false);
 	virtual std::shared_ptr<HMWiredPacket> getResponse(std::vector<uint8_t>& payload, int32_t destinationAddress, bool synchronizationBit = false);
 	virtual std::shared_ptr<HMWiredPacket> getResponse(std::shared_ptr<HMWiredPacket> packet, bool systemResponse = false);
+
+	/**
+	 * Sends a packet to a bootloader once and waits for its response. There is no bus arbitration, so the bus needs to be locked.
+	 *
+	 * @param timeout The time to wait for the response in milliseconds.
+	 * @return Returns the response or nullptr.
+	 */
+	std::shared_ptr<HMWiredPacket> getBootloaderResponse(std::shared_ptr<HMWiredPacket> packet, int32_t timeout);
 	virtual std::vector<uint8_t> readEEPROM(int32_t deviceAddress, int32_t eepromAddress);
+
+	/**
+	 * Reads several EEPROM blocks in one pass.
+	 *
+	 * @param deviceAddress The address of the device to read from.
+	 * @param eepromAddresses The start addresses of the 16 byte blocks to read.
+	 * @return Returns the blocks mapped by their start address or an empty map, when one of the blocks could not be read.
+	 */
+	virtual std::map<int32_t, std::vector<uint8_t>> readEEPROM(int32_t deviceAddress, const std::set<int32_t>& eepromAddresses);
 	virtual bool writeEEPROM(int32_t deviceAddress, int32_t eepromAddress, std::vector<uint8_t>& data);
-	virtual void sendOK(int32_t messageCounter, int32_t destinationAddress);
+
+	/**
+	 * Sends an ACK. Uses the precomputed frames of the destination and bypasses sendPacket().
+	 *
+	 * @param timeReceived The time the acknowledged packet was received. Used to measure the ACK latency. Not measured when 0.
+	 */
+	virtual void sendOK(int32_t messageCounter, int32_t destinationAddress, int64_t timeReceived = 0);
 
 	virtual bool onPacketReceived(std::string& senderID, std::shared_ptr<BaseLib::Systems::Packet> packet);
 	std::string handleCliCommand(std::string command);
 	uint64_t getPeerIdFromSerial(std::string& serialNumber) { std::shared_ptr<HMWiredPeer> peer = getPeer(serialNumber); if(peer) return peer->getID(); else return 0; }
+
+	/**
+	 * Updates several peers. The peers of different interfaces are updated in parallel. The peers of one interface are updated back
+	 * to back, the bus is locked once for all of them and every firmware file is parsed once per interface.
+	 */
 	void updateFirmwares(std::vector<uint64_t> ids);
-	void updateFirmware(uint64_t id);
-	void handleAnnounce(std::shared_ptr<HMWiredPacket> packet);
+
+	/**
+	 * Updates one peer.
+	 *
+	 * @param images Cache for the parsed firmware files or nullptr.
+	 * @param busLocked When set, the bus is only locked if "busLocked" is false and is not unlocked afterwards. "busLocked" is set to true when the bus was locked. The caller needs to unlock the bus then.
+	 */
+	void updateFirmware(uint64_t id, FirmwareImages* images = nullptr, bool* busLocked = nullptr);
+
+	/**
+	 * Sets the progress of the update running on an interface. The progress of all interfaces is aggregated in deviceUpdateInfo.
+	 *
+	 * @param progress The progress of the current device in percent.
+	 */
+	void setUpdateProgress(const std::string& interfaceId, uint64_t id, int32_t progress);
+
+	/**
+	 * Pairs a device, which announced itself. Called by the pairing queue.
+	 *
+	 * @return Returns AnnounceResult::skipped, when the device is already paired or being initialized.
+	 */
+	AnnounceResult handleAnnounce(std::shared_ptr<HMWiredPacket> packet);
+
+	/**
+	 * Sets the reachability check or value poll of a peer. Called by the peer's worker.
+	 *
+	 * @see MaintenanceScheduler::schedule()
+	 */
+	void scheduleMaintenance(uint64_t peerId, const std::string& interfaceId, MaintenanceType type, int64_t interval);
+
+	/**
+	 * Waits for a running reachability check or value poll of a peer and delays the next one by one interval.
+	 */
+	void postponeMaintenance(uint64_t peerId);
 	bool peerInit(std::shared_ptr<HMWiredPeer> peer);
 
 	virtual PVariable addLink(BaseLib::PRpcClientInfo clientInfo, std::string senderSerialNumber, int32_t senderChannel, std::string receiverSerialNumber, int32_t receiverChannel, std::string name, std::string description);
 	virtual PVariable addLink(BaseLib::PRpcClientInfo clientInfo, uint64_t senderID, int32_t senderChannel, uint64_t receiverID, int32_t receiverChannel, std::string name, std::string description);
+
+	/**
+	 * Adds several links at once. The EEPROM of every involved peer is written with one write plan and the links of each peer are saved once.
+	 * Available over RPC as family method "addLinks".
+	 *
+	 * @param clientInfo Information about the calling RPC client.
+	 * @param links Array of structs with the keys "SENDER_ID", "SENDER_CHANNEL", "RECEIVER_ID", "RECEIVER_CHANNEL" and optionally "NAME" and "DESCRIPTION".
+	 * @return Returns an array with one element per link: void on success or an error struct.
+	 */
+	PVariable addLinks(BaseLib::PRpcClientInfo clientInfo, PVariable links);
 	virtual PVariable deleteDevice(BaseLib::PRpcClientInfo clientInfo, std::string serialNumber, int32_t flags);
 	virtual PVariable deleteDevice(BaseLib::PRpcClientInfo clientInfo, uint64_t peerID, int32_t flags);
 	virtual PVariable removeLink(BaseLib::PRpcClientInfo clientInfo, std::string senderSerialNumber, int32_t senderChannel, std::string receiverSerialNumber, int32_t receiverChannel);
 	virtual PVariable removeLink(BaseLib::PRpcClientInfo clientInfo, uint64_t senderID, int32_t senderChannel, uint64_t receiverID, int32_t receiverChannel);
 	virtual PVariable searchDevices(BaseLib::PRpcClientInfo clientInfo, const std::string& interfaceId);
+
+	/**
+	 * Searches for new devices and pairs them.
+	 *
+	 * @param interfaceId The interface to search on. Searches all interfaces in parallel when empty.
+	 * @param incremental Skip the probes only answered by paired devices. The paired devices are still verified.
+	 * @return Returns the number of new peers or an error struct.
+	 */
+	PVariable searchDevices(BaseLib::PRpcClientInfo clientInfo, const std::string& interfaceId, bool incremental);
 	virtual PVariable updateFirmware(BaseLib::PRpcClientInfo clientInfo, std::vector<uint64_t> ids, bool manual);
 protected:
 	//In table variables
@@ -91,36 +226,133 @@ protected:
 	std::unordered_map<int32_t, uint8_t> _messageCounter;
 	//End
 
+	/**
+	 * Protects _messageCounter and the increment of the peers' message counters. Searches, pairings and updates run on all buses
+	 * at the same time.
+	 */
+	std::mutex _messageCounterMutex;
+
 	std::atomic_bool _stopWorkerThread;
 	std::thread _workerThread;
 
-	HMWiredPacketManager _receivedPackets;
-	HMWiredPacketManager _sentPackets;
+	/**
+	 * The buses mapped by interface ID. Only modified by init().
+	 */
+	std::map<std::string, std::shared_ptr<BusState>> _buses;
+	std::shared_ptr<BusState> _defaultBus;
+
+	/**
+	 * The interfaces of devices, which are not paired yet. Filled by received packets and searches.
+	 */
+	std::mutex _addressInterfacesMutex;
+	std::unordered_map<int32_t, std::string> _addressInterfaces;
+	std::unique_ptr<PacketDispatcher> _packetDispatcher;
+	std::unique_ptr<EventCoalescer> _eventCoalescer;
+
+	std::mutex _ackFramesMutex;
+	std::unordered_map<int32_t, std::shared_ptr<AckFrames>> _ackFrames;
+
+	//ACK latency from receiving a packet to sending the ACK in milliseconds
+	std::atomic<uint64_t> _acksSent{0};
+	std::atomic<uint64_t> _ackLatency{0};
+	std::atomic<uint64_t> _maxAckLatency{0};
+	std::atomic<uint64_t> _lateAcks{0};
+
+	//Packets received again, because our ACK got lost
+	std::atomic<uint64_t> _duplicates{0};
+
+	/**
+	 * Returns the ACK frames for a destination address. The frames are built on first use and cached for known peers only.
+	 */
+	std::shared_ptr<AckFrames> getAckFrames(int32_t destinationAddress);
 	std::atomic_bool _pairing;
 
+	/**
+	 * The addresses of the devices being paired. Devices found by a search can announce themselves at the same time, but different
+	 * devices are paired in parallel.
+	 */
 	std::mutex _peerInitMutex;
+	std::set<int32_t> _peersInitializing;
+	std::unique_ptr<PairingQueue> _pairingQueue;
+	std::unique_ptr<MaintenanceScheduler> _maintenanceScheduler;
+
+	/**
+	 * Reserves an address for pairing.
+	 *
+	 * @return Returns false, when the device is already paired or being paired.
+	 */
+	bool beginPeerInit(int32_t address);
+	void endPeerInit(int32_t address);
 
 	//Updates:
 	std::atomic_bool _updateMode;
 	std::mutex _updateFirmwareThreadMutex;
-	std::mutex _updateMutex;
 	std::thread _updateFirmwareThread;
-	//End
 
-	std::mutex _announceThreadMutex;
-	std::thread _announceThread;
+	/**
+	 * Protects _updateProgress and the results in deviceUpdateInfo, which are set by the update threads of all interfaces.
+	 */
+	std::mutex _updateMutex;
+	std::map<std::string, int32_t> _updateProgress;
+	//End
 
 	virtual void loadPeers();
 	virtual void savePeers(bool full);
 	virtual void loadVariables();
 	virtual void saveVariables();
 
+	/**
+	 * Checks a link and reserves the EEPROM slots on both ends.
+	 *
+	 * @param senderPeer Set to the peer to store on the receiver's side or nullptr when the receiver already knows the link.
+	 * @param receiverPeer Set to the peer to store on the sender's side or nullptr when the sender already knows the link.
+	 * @return Returns void on success or an error struct.
+	 */
+	PVariable prepareLink(BaseLib::PRpcClientInfo clientInfo, uint64_t senderID, int32_t senderChannelIndex, uint64_t receiverID, int32_t receiverChannelIndex, std::string name, std::string description, std::shared_ptr<HMWiredPeer>& sender, std::shared_ptr<HMWiredPeer>& receiver, std::shared_ptr<BaseLib::Systems::BasicPeer>& senderPeer, std::shared_ptr<BaseLib::Systems::BasicPeer>& receiverPeer);
+
 	std::shared_ptr<HMWiredPeer> createPeer(int32_t address, int32_t firmwareVersion, uint32_t deviceType, std::string serialNumber, bool save = true);
 	virtual void worker();
 	void deletePeer(uint64_t id);
 	virtual void init();
-	void lockBus();
-	void unlockBus();
+
+	/**
+	 * Returns the bus of an interface or the default bus, when the interface doesn't exist.
+	 */
+	std::shared_ptr<BusState> getBus(const std::string& interfaceId);
+
+	/**
+	 * Returns the bus a device is connected to. Uses the interface of the peer or, for unpaired devices, the interface the device
+	 * was last heard from. Returns the default bus for unknown devices.
+	 */
+	std::shared_ptr<BusState> getBus(int32_t address);
+	std::shared_ptr<HMWiredPacket> sendPacket(std::shared_ptr<BusState> bus, std::shared_ptr<HMWiredPacket> packet, bool resend, bool systemResponse);
+	void lockBus(const std::string& interfaceId);
+	void unlockBus(const std::string& interfaceId);
+
+	/**
+	 * Searches one bus and pairs the new devices found. Run in its own thread for every interface.
+	 *
+	 * @param[out] newPeers Filled with the paired peers.
+	 */
+	void searchBus(std::shared_ptr<BusState> bus, bool incremental, std::vector<std::shared_ptr<HMWiredPeer>>* newPeers);
+
+	/**
+	 * Queries type, firmware version and serial number of a device and pairs it.
+	 *
+	 * @return Returns the new peer or nullptr on error or when the device is already paired.
+	 */
+	std::shared_ptr<HMWiredPeer> pairDevice(int32_t address);
+
+	/**
+	 * Does the work of pairDevice(). The address needs to be reserved with beginPeerInit().
+	 */
+	std::shared_ptr<HMWiredPeer> initPeer(int32_t address);
+
+	/**
+	 * Updates the peers of one interface back to back. Run in its own thread for every interface.
+	 */
+	void updateFirmwaresOnInterface(std::string interfaceId, std::vector<uint64_t> ids);
+	void setUpdateResult(uint64_t id, int32_t code, const std::string& message);
 };
 
 } /* namespace HMWired */
@@ -440,6 +440,17 @@ void HMWiredPacket::escapePacket(std::vector<char>& result, const std::vector<ch
     }
 }
 
+void HMWiredPacket::setSynchronizationBit(bool value)
+{
+	if(_synchronizationBit == value) return;
+	_synchronizationBit = value;
+	generateControlByte();
+	//The packet is rebuilt with the new control byte on the next call to byteArray()
+	_packet.clear();
+	_escapedPacket.clear();
+	_checksum = 0;
+}
+
 void HMWiredPacket::generateControlByte()
 {
 	try
@@ -73,6 +73,7 @@ public:
     uint8_t senderMessageCounter() { return _senderMessageCounter; }
     uint8_t receiverMessageCounter() { return _receiverMessageCounter; }
     bool synchronizationBit() { return _synchronizationBit; }
+    void setSynchronizationBit(bool value);
     std::string hexString();
     std::vector<uint8_t> byteArray();
     std::vector<uint8_t>& payload() { return _payload; }
@@ -35,6 +35,10 @@
 
 namespace HMWired
 {
+SetValueStats HMWiredPeer::setValueStats;
+MaintenanceStats HMWiredPeer::maintenanceStats;
+ValueRequestStats HMWiredPeer::valueRequestStats;
+
 std::shared_ptr<BaseLib::Systems::ICentral> HMWiredPeer::getCentral()
 {
 	try
@@ -56,19 +60,14 @@ std::shared_ptr<BaseLib::Systems::ICentral> HMWiredPeer::getCentral()
 
 HMWiredPeer::HMWiredPeer(uint32_t parentID, IPeerEventSink* eventHandler) : Peer(GD::bl, parentID, eventHandler)
 {
-	_lastPing = BaseLib::HelperFunctions::getTime() - (BaseLib::HelperFunctions::getRandomNumber(1, 60) * 10000);
 }
 
 HMWiredPeer::HMWiredPeer(int32_t id, int32_t address, std::string serialNumber, uint32_t parentID, IPeerEventSink* eventHandler) : Peer(GD::bl, id, address, serialNumber, parentID, eventHandler)
 {
-	_lastPing = BaseLib::HelperFunctions::getTime() - (BaseLib::HelperFunctions::getRandomNumber(1, 60) * 10000);
 }
 
 HMWiredPeer::~HMWiredPeer()
 {
-	_pingThreadMutex.lock();
-	if(_pingThread.joinable()) _pingThread.join();
-	_pingThreadMutex.unlock();
 }
 
 void HMWiredPeer::worker()
@@ -77,56 +76,35 @@ void HMWiredPeer::worker()
 	try
 	{
 		int64_t time = BaseLib::HelperFunctions::getTime();
+		int64_t messageCounterChanged = _messageCounterChanged;
+		if(messageCounterChanged > 0 && (time - messageCounterChanged >= _messageCounterSaveDelay || time - _lastMessageCounterSave >= _messageCounterMaxSaveDelay)) saveMessageCounter();
 		if(_rpcDevice)
 		{
 			serviceMessages->checkUnreach(_rpcDevice->timeout, getLastPacketReceived());
+			std::shared_ptr<HMWiredCentral> central = std::dynamic_pointer_cast<HMWiredCentral>(getCentral());
+			if(!central) return;
+			MaintenanceType type = MaintenanceType::none;
+			int64_t interval = 0;
 			if(serviceMessages->getUnreach())
 			{
-				if(time - _lastPing > 600000)
-				{
-					_pingThreadMutex.lock();
-					if(!_disposing && !deleting && _lastPing < time) //Check that _lastPing wasn't set in putParamset after locking the mutex
-					{
-						_lastPing = time; //Set here to avoid race condition between worker thread and ping thread
-						_bl->threadManager.join(_pingThread);
-						_bl->threadManager.start(_pingThread, false, &HMWiredPeer::pingThread, this);
-					}
-					_pingThreadMutex.unlock();
-				}
+				type = MaintenanceType::probe;
+				interval = GD::family->livenessInterval();
 			}
-			else
+			else if(configCentral[0].find("POLLING") != configCentral[0].end())
 			{
-				if(configCentral[0].find("POLLING") != configCentral[0].end())
+				std::vector<uint8_t> parameterData = configCentral[0].at("POLLING").getBinaryData();
+				if(!parameterData.empty() && parameterData.at(0) > 0 && configCentral[0].find("POLLING_INTERVAL") != configCentral[0].end())
 				{
-					std::vector<uint8_t> parameterData = configCentral[0].at("POLLING").getBinaryData();
-					if(!parameterData.empty() && parameterData.at(0) > 0 && configCentral[0].find("POLLING_INTERVAL") != configCentral[0].end())
-					{
-						//Polling is enabled
-						BaseLib::Systems::RpcConfigurationParameter& parameter = configCentral[0]["POLLING_INTERVAL"];
-						int32_t data = 0;
-						_bl->hf.memcpyBigEndian(data, parameter.getBinaryData()); //Shortcut to save resources. The normal way would be to call "convertFromPacket".
-						int64_t pollingInterval = data * 60000;
-						if(pollingInterval < 600000) pollingInterval = 600000;
-						if(time - _lastPing >= pollingInterval)
-						{
-							int64_t timeSinceLastPacket = time - ((int64_t)_lastPacketReceived * 1000);
-							if(timeSinceLastPacket > 0 && timeSinceLastPacket >= pollingInterval)
-							{
-								_pingThreadMutex.lock();
-								if(!_disposing && !deleting && _lastPing < time) //Check that _lastPing wasn't set in putParamset after locking the mutex
-								{
-									_lastPing = time; //Set here to avoid race condition between worker thread and ping thread
-									_bl->threadManager.join(_pingThread);
-									_bl->threadManager.start(_pingThread, false, &HMWiredPeer::pingThread, this);
-								}
-								_pingThreadMutex.unlock();
-							}
-						}
-					}
-					else _lastPing = time;
+					//Polling is enabled
+					BaseLib::Systems::RpcConfigurationParameter& parameter = configCentral[0]["POLLING_INTERVAL"];
+					int32_t data = 0;
+					_bl->hf.memcpyBigEndian(data, parameter.getBinaryData()); //Shortcut to save resources. The normal way would be to call "convertFromPacket".
+					type = MaintenanceType::poll;
+					interval = data * 60000;
+					if(interval < 600000) interval = 600000;
 				}
-				else _lastPing = time; //Set _lastPing, so there is a delay of 10 minutes after the device is unreachable before the first ping.
 			}
+			central->scheduleMaintenance(_peerID, getPhysicalInterfaceId(), type, interval);
 		}
 	}
 	catch(const std::exception& ex)
@@ -140,6 +118,26 @@ void HMWiredPeer::worker()
 }
 
 void HMWiredPeer::initializeLinkConfig(int32_t channel, std::shared_ptr<BaseLib::Systems::BasicPeer> peer)
+{
+	try
+	{
+		EEPROMWritePlan plan;
+		if(!addLinkToWritePlan(plan, channel, peer)) return;
+		if(!executeWritePlan(plan)) GD::out.printError("Error: Could not write config to device's eeprom.");
+		PLinkParameters linkGroup(std::dynamic_pointer_cast<LinkParameters>(getParameterSet(channel, ParameterGroup::Type::Enum::link)));
+		updateLinkSlot(linkGroup, peer->configEEPROMAddress);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+bool HMWiredPeer::addLinkToWritePlan(EEPROMWritePlan& plan, int32_t channel, std::shared_ptr<BaseLib::Systems::BasicPeer> peer)
 {
 	try
 	{
@@ -147,13 +145,13 @@ void HMWiredPeer::initializeLinkConfig(int32_t channel, std::shared_ptr<BaseLib:
 		if(!parameterGroup)
 		{
 			GD::out.printError("Error: No link parameter set found.");
-			return;
+			return false;
 		}
 		PLinkParameters linkGroup(std::dynamic_pointer_cast<LinkParameters>(parameterGroup));
 		if(!linkGroup)
 		{
 			GD::out.printError("Error: No link parameter set found (2). Something weird is going on...");
-			return;
+			return false;
 		}
 		PFunction rpcFunction = _rpcDevice->functions.at(channel);
 		//Check if address data is continuous
@@ -166,7 +164,7 @@ void HMWiredPeer::initializeLinkConfig(int32_t channel, std::shared_ptr<BaseLib:
 		if(max - min != 5)
 		{
 			GD::out.printError("Error: Address format of parameter set is not supported.");
-			return;
+			return false;
 		}
 
 		std::vector<uint8_t> data(6);
@@ -179,24 +177,69 @@ void HMWiredPeer::initializeLinkConfig(int32_t channel, std::shared_ptr<BaseLib:
 		if(peer->configEEPROMAddress == -1)
 		{
 			GD::out.printError("Error: Link config's EEPROM address is invalid.");
-			return;
+			return false;
 		}
-		std::vector<int32_t> configBlocks = setConfigParameter((double)peer->configEEPROMAddress, 6.0, data);
-		for(std::vector<int32_t>::iterator i = configBlocks.begin(); i != configBlocks.end(); ++i)
+		if(!plan.addParameter("LINK_ADDRESS", (double)peer->configEEPROMAddress, 6.0, data)) return false;
+
+		if(!peer->isSender) return true; //Nothing more to do
+		if(linkGroup->memoryAddressStart == -1 || linkGroup->memoryAddressStep == -1)
 		{
-			std::vector<uint8_t> configBlock = binaryConfig.at(*i).getBinaryData();
-			if(!std::dynamic_pointer_cast<HMWiredCentral>(getCentral())->writeEEPROM(_address, *i, configBlock)) GD::out.printError("Error: Could not write config to device's eeprom.");
+			GD::out.printError("Error: Storage type of link parameter set not supported.");
+			return true;
 		}
 
-		if(!peer->isSender) return; //Nothing more to do
-
-		PVariable variables(new Variable(VariableType::tStruct));
+		//Default values of the link parameters
 		for(Parameters::iterator i = linkGroup->parameters.begin(); i != linkGroup->parameters.end(); ++i)
 		{
-			variables->structValue->insert(StructElement(i->second->id, i->second->logical->getDefaultValue()));
+			if(i->first.empty()) continue;
+			if(i->second->physical->memoryIndexOperation == IPhysical::MemoryIndexOperation::Enum::none) continue;
+			if(i->second->physical->operationType != IPhysical::OperationType::Enum::memory) continue;
+			std::vector<uint8_t> value;
+			i->second->convertToPacket(i->second->logical->getDefaultValue(), Role(), value);
+			plan.addParameter(i->first, peer->configEEPROMAddress + i->second->physical->memoryIndex, i->second->physical->size, value);
+		}
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+bool HMWiredPeer::addLinks(std::vector<std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>>& links)
+{
+	try
+	{
+		if(links.empty()) return true;
+		EEPROMWritePlan plan;
+		bool result = true;
+		for(std::vector<std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>>::iterator i = links.begin(); i != links.end(); ++i)
+		{
+			if(!addLinkToWritePlan(plan, i->first, i->second))
+			{
+				result = false;
+				break;
+			}
+		}
+		if(result && !executeWritePlan(plan))
+		{
+			GD::out.printError("Error: Could not write config to device's eeprom.");
+			result = false;
 		}
-		PVariable result = putParamset(nullptr, channel, ParameterGroup::Type::Enum::link, peer->id, peer->channel, variables, false);
-		if(result->errorStruct) GD::out.printError("Error: " + result->structValue->at("faultString")->stringValue);
+
+		for(std::vector<std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>>::iterator i = links.begin(); i != links.end(); ++i)
+		{
+			//Releases the slots reserved by getFreeEEPROMAddress() when writing failed. executeWritePlan() restored the shadow then.
+			updateLinkSlot(std::dynamic_pointer_cast<LinkParameters>(getParameterSet(i->first, ParameterGroup::Type::Enum::link)), i->second->configEEPROMAddress);
+			if(result) addPeer(i->first, i->second, false);
+		}
+		if(result) savePeers();
+		return result;
 	}
 	catch(const std::exception& ex)
     {
@@ -206,6 +249,7 @@ void HMWiredPeer::initializeLinkConfig(int32_t channel, std::shared_ptr<BaseLib:
     {
     	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
     }
+    return false;
 }
 
 std::string HMWiredPeer::handleCliCommand(std::string command)
@@ -222,6 +266,7 @@ std::string HMWiredPeer::handleCliCommand(std::string command)
 			stringStream << "channel count Print the number of channels of this peer" << std::endl;
 			stringStream << "eeprom print  Prints the known areas of the eeprom" << std::endl;
 			stringStream << "config print  Prints all configuration parameters and their values" << std::endl;
+			stringStream << "config explain Prints the EEPROM accesses needed to set configuration parameters" << std::endl;
 			stringStream << "peers list    Lists all peers paired to this peer" << std::endl;
 			return stringStream.str();
 		}
@@ -285,6 +330,7 @@ std::string HMWiredPeer::handleCliCommand(std::string command)
 			{
 				stringStream << "0x" << std::hex << std::setfill('0') << std::setw(4) << i->first << "\t" << BaseLib::HelperFunctions::getHexString(i->second.getBinaryData()) << std::dec << std::endl;
 			}
+			stringStream << std::endl << "Blocks read in batches: " << _prefetchedBlocks << " (current read ahead window: " << _readAheadBlocks << " blocks)" << std::endl;
 			return stringStream.str();
 		}
 		else if(command.compare(0, 10, "peers list") == 0)
@@ -355,6 +401,57 @@ std::string HMWiredPeer::handleCliCommand(std::string command)
 
 			return printConfig();
 		}
+		else if(command.compare(0, 14, "config explain") == 0)
+		{
+			int32_t channel = -1;
+			std::vector<std::string> parameterIds;
+
+			std::stringstream stream(command);
+			std::string element;
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 2)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 2)
+				{
+					if(element == "help") break;
+					channel = BaseLib::Math::getNumber(element, false);
+				}
+				else if(!element.empty()) parameterIds.push_back(element);
+				index++;
+			}
+			if(channel < 0 || parameterIds.empty())
+			{
+				stringStream << "Description: This command prints which EEPROM blocks need to be read and written to set the given configuration parameters. Nothing is sent to the device." << std::endl;
+				stringStream << "Usage: config explain CHANNEL PARAMETER [PARAMETER...]" << std::endl << std::endl;
+				stringStream << "Parameters:" << std::endl;
+				stringStream << "  CHANNEL:\tThe channel of the parameters. Example: 1" << std::endl;
+				stringStream << "  PARAMETER:\tThe ID of a configuration parameter of the channel. Example: LOGGING" << std::endl;
+				return stringStream.str();
+			}
+
+			PParameterGroup parameterGroup = getParameterSet(channel, ParameterGroup::Type::Enum::config);
+			if(!parameterGroup) return "Unknown channel.\n";
+			EEPROMWritePlan plan;
+			for(std::vector<std::string>::iterator i = parameterIds.begin(); i != parameterIds.end(); ++i)
+			{
+				PParameter parameter = parameterGroup->getParameter(*i);
+				if(!parameter || parameter->physical->operationType != IPhysical::OperationType::Enum::memory)
+				{
+					stringStream << "Parameter " << *i << " is not stored in the EEPROM." << std::endl;
+					continue;
+				}
+				//The costs don't depend on the value
+				std::vector<uint8_t> value((uint32_t)std::ceil(parameter->physical->size), 0);
+				if(!addToWritePlan(plan, channel, parameterGroup, parameter, value)) stringStream << "Parameter " << *i << " can't be mapped to the EEPROM." << std::endl;
+			}
+			stringStream << explainWritePlan(plan);
+			return stringStream.str();
+		}
 		else if(command.compare(0, 11, "test config") == 0)
 		{
 			int32_t address1 = 0x350;
@@ -739,6 +836,7 @@ std::vector<int32_t> HMWiredPeer::setConfigParameter(double index, double size,
 				{
 					configBlock->setBinaryData(parameterData);
 					saveParameter(configBlock->databaseId, configBlockIndex, parameterData);
+					configBlockChanged(configBlockIndex);
 					configBlockIndex += 0x10;
 					changedBlocks.push_back(configBlockIndex);
 					if(binaryConfig.find(configBlockIndex) == binaryConfig.end())
@@ -761,6 +859,7 @@ std::vector<int32_t> HMWiredPeer::setConfigParameter(double index, double size,
 			}
 			configBlock->setBinaryData(parameterData);
 			saveParameter(configBlock->databaseId, configBlockIndex, parameterData);
+			configBlockChanged(configBlockIndex);
 		}
 		else
 		{
@@ -792,6 +891,7 @@ std::vector<int32_t> HMWiredPeer::setConfigParameter(double index, double size,
 						intByteIndex = -i;
 						configBlock->setBinaryData(parameterData);
 						saveParameter(configBlock->databaseId, configBlockIndex, parameterData);
+						configBlockChanged(configBlockIndex);
 						configBlockIndex += 0x10;
 						changedBlocks.push_back(configBlockIndex);
 						if(binaryConfig.find(configBlockIndex) == binaryConfig.end())
@@ -824,6 +924,7 @@ std::vector<int32_t> HMWiredPeer::setConfigParameter(double index, double size,
 							intByteIndex = -i;
 							configBlock->setBinaryData(parameterData);
 							saveParameter(configBlock->databaseId, configBlockIndex, parameterData);
+							configBlockChanged(configBlockIndex);
 							configBlockIndex += 0x10;
 							changedBlocks.push_back(configBlockIndex);
 							if(binaryConfig.find(configBlockIndex) == binaryConfig.end())
@@ -850,6 +951,7 @@ std::vector<int32_t> HMWiredPeer::setConfigParameter(double index, double size,
 						intByteIndex = -(missingBytes + i);
 						configBlock->setBinaryData(parameterData);
 						saveParameter(configBlock->databaseId, configBlockIndex, parameterData);
+						configBlockChanged(configBlockIndex);
 						configBlockIndex += 0x10;
 						changedBlocks.push_back(configBlockIndex);
 						if(binaryConfig.find(configBlockIndex) == binaryConfig.end())
@@ -871,6 +973,7 @@ std::vector<int32_t> HMWiredPeer::setConfigParameter(double index, double size,
 			}
 			configBlock->setBinaryData(parameterData);
 			saveParameter(configBlock->databaseId, configBlockIndex, parameterData);
+			configBlockChanged(configBlockIndex);
 		}
 	}
 	catch(const std::exception& ex)
@@ -884,7 +987,7 @@ std::vector<int32_t> HMWiredPeer::setConfigParameter(double index, double size,
 	return changedBlocks;
 }
 
-std::vector<int32_t> HMWiredPeer::setMasterConfigParameter(int32_t channelIndex, double index, double step, double size, std::vector<uint8_t>& binaryValue)
+double HMWiredPeer::getMasterConfigIndex(int32_t channelIndex, double index, double step)
 {
 	try
 	{
@@ -902,7 +1005,193 @@ std::vector<int32_t> HMWiredPeer::setMasterConfigParameter(int32_t channelIndex,
 			bitSteps = (indexBits + bitSteps) - 8;
 		}
 		index += ((double)bitSteps) / 10.0;
-		return setConfigParameter(index, size, binaryValue);
+		return index;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return -1;
+}
+
+double HMWiredPeer::getMasterConfigIndex(int32_t channel, PParameterGroup parameterGroup, PParameter parameter)
+{
+	try
+	{
+		Functions::iterator functionIterator = _rpcDevice->functions.find(channel);
+		if(functionIterator == _rpcDevice->functions.end()) return -1;
+		PFunction rpcFunction = functionIterator->second;
+		if(parameter->physical->memoryIndexOperation == IPhysical::MemoryIndexOperation::none)
+		{
+			return getMasterConfigIndex(channel - rpcFunction->channel, parameter->physical->memoryIndex, parameter->physical->memoryChannelStep);
+		}
+		if(parameterGroup->memoryAddressStart == -1 || parameterGroup->memoryAddressStep == -1)
+		{
+			GD::out.printError("Error: Can't get parameter set. address_start or address_step is not set.");
+			return -1;
+		}
+		int32_t channelIndex = channel - rpcFunction->channel;
+		if(channelIndex >= (signed)rpcFunction->channelCount)
+		{
+			GD::out.printError("Error: Can't get parameter set. Out of bounds.");
+			return -1;
+		}
+		return parameterGroup->memoryAddressStart + (channelIndex * parameterGroup->memoryAddressStep) + parameter->physical->memoryIndex;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return -1;
+}
+
+bool HMWiredPeer::addToWritePlan(EEPROMWritePlan& plan, int32_t channel, PParameterGroup parameterGroup, PParameter parameter, std::vector<uint8_t>& binaryValue)
+{
+	try
+	{
+		double index = getMasterConfigIndex(channel, parameterGroup, parameter);
+		if(index < 0) return false;
+		return plan.addParameter(parameter->id, index, parameter->physical->size, binaryValue);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+bool HMWiredPeer::executeWritePlan(EEPROMWritePlan& plan)
+{
+	try
+	{
+		if(plan.empty()) return true;
+		std::shared_ptr<HMWiredCentral> central(std::dynamic_pointer_cast<HMWiredCentral>(getCentral()));
+		if(!central) return false;
+
+		std::set<int32_t> blocks = plan.blocks();
+		std::set<int32_t> missingBlocks;
+		std::map<int32_t, std::vector<uint8_t>> blockData;
+		for(std::set<int32_t>::iterator i = blocks.begin(); i != blocks.end(); ++i)
+		{
+			if(binaryConfig.find(*i) == binaryConfig.end()) missingBlocks.insert(*i);
+			else blockData[*i] = binaryConfig[*i].getBinaryData();
+		}
+		if(!missingBlocks.empty())
+		{
+			std::map<int32_t, std::vector<uint8_t>> fetchedBlocks = central->readEEPROM(_address, missingBlocks);
+			if(fetchedBlocks.size() != missingBlocks.size())
+			{
+				GD::out.printError("Error: HomeMatic Wired peer " + std::to_string(_peerID) + ": Can't set configuration parameters. Can't read EEPROM.");
+				return false;
+			}
+			blockData.insert(fetchedBlocks.begin(), fetchedBlocks.end());
+		}
+		std::map<int32_t, std::vector<uint8_t>> originalData = blockData;
+
+		//Apply all edits in memory first, so nothing is changed when one of the blocks is invalid
+		for(std::map<int32_t, std::vector<uint8_t>>::iterator i = blockData.begin(); i != blockData.end(); ++i)
+		{
+			if(!plan.apply(i->first, i->second))
+			{
+				GD::out.printError("Error: HomeMatic Wired peer " + std::to_string(_peerID) + ": Can't set configuration parameters. EEPROM block 0x" + BaseLib::HelperFunctions::getHexString(i->first, 4) + " is invalid.");
+				return false;
+			}
+		}
+
+		for(std::map<int32_t, std::vector<uint8_t>>::iterator i = blockData.begin(); i != blockData.end(); ++i)
+		{
+			BaseLib::Systems::ConfigDataBlock& configBlock = binaryConfig[i->first];
+			configBlock.setBinaryData(i->second);
+			saveParameter(configBlock.databaseId, i->first, i->second);
+			configBlockChanged(i->first);
+		}
+
+		for(std::map<int32_t, std::vector<uint8_t>>::iterator i = blockData.begin(); i != blockData.end(); ++i)
+		{
+			if(!central->writeEEPROM(_address, i->first, i->second))
+			{
+				GD::out.printError("Error: Could not write config to device's eeprom.");
+				//Restore the previous configuration, so neither the device nor the shadow keep half of the plan. Blocks, which can't be
+				//restored on the device, keep their new content in the shadow.
+				for(std::map<int32_t, std::vector<uint8_t>>::iterator j = originalData.begin(); j != originalData.end(); ++j)
+				{
+					if(j->first < i->first && !central->writeEEPROM(_address, j->first, j->second))
+					{
+						GD::out.printError("Error: Could not restore EEPROM block 0x" + BaseLib::HelperFunctions::getHexString(j->first, 4) + " of peer " + std::to_string(_peerID) + ".");
+						continue;
+					}
+					BaseLib::Systems::ConfigDataBlock& configBlock = binaryConfig[j->first];
+					configBlock.setBinaryData(j->second);
+					saveParameter(configBlock.databaseId, j->first, j->second);
+					configBlockChanged(j->first);
+				}
+				return false;
+			}
+		}
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+std::string HMWiredPeer::explainWritePlan(EEPROMWritePlan& plan)
+{
+	try
+	{
+		std::ostringstream stringStream;
+		std::set<int32_t> blocks = plan.blocks();
+		uint32_t missingBlocks = 0;
+		stringStream << "Parameters: " << plan.parameterCount() << std::endl;
+		stringStream << "Address	Cached" << std::endl;
+		for(std::set<int32_t>::iterator i = blocks.begin(); i != blocks.end(); ++i)
+		{
+			bool cached = binaryConfig.find(*i) != binaryConfig.end();
+			if(!cached) missingBlocks++;
+			stringStream << "0x" << std::hex << std::setfill('0') << std::setw(4) << *i << std::dec << "	" << (cached ? "yes" : "no") << std::endl;
+		}
+		stringStream << std::endl;
+		//Read: request, response and ACK. Write: request and ACK.
+		stringStream << "Blocks to read:           " << missingBlocks << " (" << (missingBlocks * 3) << " packets)" << std::endl;
+		stringStream << "Blocks to write:          " << blocks.size() << " (" << (blocks.size() * 2) << " packets)" << std::endl;
+		stringStream << "Database writes:          " << blocks.size() << " (" << (plan.sequentialBlockWrites() + missingBlocks) << " without plan)" << std::endl;
+		stringStream << "Estimated round trips:    " << (missingBlocks + blocks.size()) << std::endl;
+		return stringStream.str();
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return "";
+}
+
+std::vector<int32_t> HMWiredPeer::setMasterConfigParameter(int32_t channelIndex, double index, double step, double size, std::vector<uint8_t>& binaryValue)
+{
+	try
+	{
+		return setConfigParameter(getMasterConfigIndex(channelIndex, index, step), size, binaryValue);
 	}
 	catch(const std::exception& ex)
     {
@@ -971,45 +1260,186 @@ std::vector<int32_t> HMWiredPeer::setMasterConfigParameter(int32_t channel, PPar
     return std::vector<int32_t>();
 }
 
-std::vector<uint8_t> HMWiredPeer::getConfigParameter(double index, double size, int32_t mask, bool onlyKnownConfig)
+void HMWiredPeer::readConfigBlock(int32_t configBlockIndex)
 {
 	try
 	{
-		std::vector<uint8_t> result;
-		if(!_rpcDevice)
+		if(!_rpcDevice) return;
+		//Sequential misses are usually caused by a loop over a table. Read ahead and double the window on every further miss.
+		if(_lastReadBlock != -1 && configBlockIndex == _lastReadBlock + 0x10)
 		{
-			result.push_back(0);
-			return result;
+			_readAheadBlocks = _readAheadBlocks == 0 ? 1 : _readAheadBlocks * 2;
+			if(_readAheadBlocks > _maxReadAheadBlocks) _readAheadBlocks = _maxReadAheadBlocks;
 		}
-		if(size < 0 || index < 0)
+		else _readAheadBlocks = 0;
+
+		std::set<int32_t> blocks;
+		blocks.insert(configBlockIndex);
+		int32_t lastBlock = configBlockIndex;
+		for(int32_t i = 1; i <= _readAheadBlocks; i++)
 		{
-			GD::out.printError("Error: Can't get configuration parameter. Index or size is negative.");
-			result.push_back(0);
-			return result;
+			int32_t blockIndex = configBlockIndex + (i * 0x10);
+			if(blockIndex >= (signed)_rpcDevice->memorySize) break;
+			lastBlock = blockIndex;
+			if(binaryConfig.find(blockIndex) == binaryConfig.end()) blocks.insert(blockIndex);
 		}
+		_lastReadBlock = lastBlock;
+		prefetchConfigBlocks(blocks);
+
+		//Keep the old behavior for the requested block, so callers detect invalid data
+		if(binaryConfig.find(configBlockIndex) == binaryConfig.end()) binaryConfig[configBlockIndex].setBinaryData(std::vector<uint8_t>());
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void HMWiredPeer::prefetchConfigBlocks(const std::set<int32_t>& blocks)
+{
+	try
+	{
+		if(blocks.empty()) return;
 		std::shared_ptr<HMWiredCentral> central(std::dynamic_pointer_cast<HMWiredCentral>(getCentral()));
-		double byteIndex = std::floor(index);
-		int32_t intByteIndex = byteIndex;
-		int32_t configBlockIndex = (intByteIndex / 0x10) * 0x10;
-		if(configBlockIndex >= (signed)_rpcDevice->memorySize)
-		{
-			GD::out.printError("Error: Can't get configuration parameter. Index is larger than EEPROM.");
-			result.push_back(0);
-			return result;
-		}
-		intByteIndex = intByteIndex - configBlockIndex;
-		if(configBlockIndex >= (signed)_rpcDevice->memorySize)
+		if(!central) return;
+		for(std::set<int32_t>::const_iterator i = blocks.begin(); i != blocks.end(); ++i)
 		{
-			GD::out.printError("Error: Can't get configuration parameter. Index is larger than EEPROM.");
-			result.clear();
-			result.push_back(0);
-			return result;
+			if(binaryConfig.find(*i) != binaryConfig.end()) continue;
+			std::vector<uint8_t> parameterData = central->readEEPROM(_address, *i);
+			if(parameterData.size() != 0x10) continue; //Blocks that can't be read are read again on access
+			binaryConfig[*i].setBinaryData(parameterData);
+			_prefetchedBlocks++;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void HMWiredPeer::getConfigBlocks(double index, double size, std::set<int32_t>& blocks)
+{
+	try
+	{
+		if(!_rpcDevice || index < 0 || size < 0) return;
+		int32_t startAddress = std::floor(index);
+		int32_t endAddress = startAddress;
+		if(startAddress != index || size <= 1.0)
+		{
+			int32_t bitSize = std::lround(size * 10);
+			if(bitSize > 8) bitSize = 8;
+			if((std::lround(index * 10) % 10) + bitSize > 8) endAddress++;
+		}
+		else endAddress += (int32_t)std::ceil(size) - 1;
+		for(int32_t blockIndex = (startAddress / 0x10) * 0x10; blockIndex <= endAddress && blockIndex < (signed)_rpcDevice->memorySize; blockIndex += 0x10)
+		{
+			blocks.insert(blockIndex);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+std::set<int32_t> HMWiredPeer::getConfigBlocks(int32_t channel, PParameterGroup parameterGroup, std::shared_ptr<BaseLib::Systems::BasicPeer> remotePeer)
+{
+	std::set<int32_t> blocks;
+	try
+	{
+		if(!parameterGroup) return blocks;
+		for(Parameters::iterator i = parameterGroup->parameters.begin(); i != parameterGroup->parameters.end(); ++i)
+		{
+			if(i->second->physical->operationType != IPhysical::OperationType::Enum::memory) continue;
+			double index = -1;
+			if(remotePeer)
+			{
+				if(remotePeer->configEEPROMAddress == -1) return blocks;
+				index = remotePeer->configEEPROMAddress + i->second->physical->memoryIndex;
+			}
+			else index = getMasterConfigIndex(channel, parameterGroup, i->second);
+			getConfigBlocks(index, i->second->physical->size, blocks);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return blocks;
+}
+
+std::set<int32_t> HMWiredPeer::getLinkTableBlocks(PLinkParameters linkGroup)
+{
+	std::set<int32_t> blocks;
+	try
+	{
+		if(!linkGroup || linkGroup->memoryAddressStart < 0 || linkGroup->memoryAddressStep <= 0 || linkGroup->maxLinkCount <= 0) return blocks;
+		getConfigBlocks(linkGroup->memoryAddressStart, linkGroup->maxLinkCount * linkGroup->memoryAddressStep, blocks);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return blocks;
+}
+
+std::vector<uint8_t> HMWiredPeer::getConfigParameter(double index, double size, int32_t mask, bool onlyKnownConfig)
+{
+	try
+	{
+		std::vector<uint8_t> result;
+		if(!_rpcDevice)
+		{
+			result.push_back(0);
+			return result;
+		}
+		if(size < 0 || index < 0)
+		{
+			GD::out.printError("Error: Can't get configuration parameter. Index or size is negative.");
+			result.push_back(0);
+			return result;
+		}
+		double byteIndex = std::floor(index);
+		int32_t intByteIndex = byteIndex;
+		int32_t configBlockIndex = (intByteIndex / 0x10) * 0x10;
+		if(configBlockIndex >= (signed)_rpcDevice->memorySize)
+		{
+			GD::out.printError("Error: Can't get configuration parameter. Index is larger than EEPROM.");
+			result.push_back(0);
+			return result;
+		}
+		intByteIndex = intByteIndex - configBlockIndex;
+		if(configBlockIndex >= (signed)_rpcDevice->memorySize)
+		{
+			GD::out.printError("Error: Can't get configuration parameter. Index is larger than EEPROM.");
+			result.clear();
+			result.push_back(0);
+			return result;
 		}
 		if(binaryConfig.find(configBlockIndex) == binaryConfig.end())
 		{
 			if(onlyKnownConfig) return std::vector<uint8_t>();
-			std::vector<uint8_t> parameterData = central->readEEPROM(_address, configBlockIndex);
-			binaryConfig[configBlockIndex].setBinaryData(parameterData);
+			readConfigBlock(configBlockIndex);
 		}
 		std::vector<uint8_t> parameterData = binaryConfig[configBlockIndex].getBinaryData();
 		if(parameterData.size() != 0x10)
@@ -1047,8 +1477,7 @@ std::vector<uint8_t> HMWiredPeer::getConfigParameter(double index, double size,
 					if(binaryConfig.find(configBlockIndex) == binaryConfig.end())
 					{
 						if(onlyKnownConfig) return std::vector<uint8_t>();
-						parameterData = central->readEEPROM(_address, configBlockIndex);
-						binaryConfig[configBlockIndex].setBinaryData(parameterData);
+						readConfigBlock(configBlockIndex);
 					}
 					parameterData = binaryConfig[configBlockIndex].getBinaryData();
 					if(parameterData.size() != 0x10)
@@ -1094,8 +1523,7 @@ std::vector<uint8_t> HMWiredPeer::getConfigParameter(double index, double size,
 					if(binaryConfig.find(configBlockIndex) == binaryConfig.end())
 					{
 						if(onlyKnownConfig) return std::vector<uint8_t>();
-						parameterData = central->readEEPROM(_address, configBlockIndex);
-						binaryConfig[configBlockIndex].setBinaryData(parameterData);
+						readConfigBlock(configBlockIndex);
 					}
 					parameterData = binaryConfig[configBlockIndex].getBinaryData();
 					if(parameterData.size() != 0x10)
@@ -1130,21 +1558,7 @@ std::vector<uint8_t> HMWiredPeer::getMasterConfigParameter(int32_t channelIndex,
 {
 	try
 	{
-		int32_t bitStep = (std::lround(step * 10) % 10) + (((int32_t)step) * 8);
-		int32_t bitSteps = bitStep * channelIndex;
-		while(bitSteps >= 8)
-		{
-			index += 1.0;
-			bitSteps -= 8;
-		}
-		int32_t indexBits = std::lround(index * 10) % 10;
-		if(indexBits + bitSteps >= 8)
-		{
-			index = std::ceil(index);
-			bitSteps = (indexBits + bitSteps) - 8;
-		}
-		index += ((double)bitSteps) / 10.0;
-		return getConfigParameter(index, size);
+		return getConfigParameter(getMasterConfigIndex(channelIndex, index, step), size);
 	}
 	catch(const std::exception& ex)
     {
@@ -1227,17 +1641,53 @@ bool HMWiredPeer::ping(int32_t packetCount, bool waitForResponse)
 	{
 		std::shared_ptr<HMWiredCentral> central = std::dynamic_pointer_cast<HMWiredCentral>(getCentral());
 		if(!central) return false;
-		uint32_t time = BaseLib::HelperFunctions::getTimeSeconds();
-		_lastPing = (int64_t)time * 1000;
+		if(!GD::family->lightweightLiveness()) return pollValues(waitForResponse, true);
+
+		//Any answer shows the device is alive. The firmware version is the shortest request every device supports.
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::shared_ptr<HMWiredPacket> response = central->getResponse(0x76, _address);
+		maintenanceStats.probes++;
+		maintenanceStats.probeRequests++;
+		maintenanceStats.probeTime += std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+		if(!response || response->payload().size() != 2) return false;
+
+		//The probe doesn't return any values. Inputs may have changed while the device was unreachable, so request them once. This is
+		//a poll, not part of the probe, so it is counted as one.
+		if(serviceMessages->getUnreach()) pollValues(true, false);
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return true;
+}
+
+bool HMWiredPeer::pollValues(bool waitForResponse, bool liveness)
+{
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	uint32_t requests = 0;
+	bool success = true;
+	try
+	{
 		if(_rpcDevice && !_rpcDevice->valueRequestPackets.empty())
 		{
-			for(ValueRequestPackets::iterator i = _rpcDevice->valueRequestPackets.begin(); i != _rpcDevice->valueRequestPackets.end(); ++i)
+			for(ValueRequestPackets::iterator i = _rpcDevice->valueRequestPackets.begin(); i != _rpcDevice->valueRequestPackets.end() && success; ++i)
 			{
 				for(std::map<std::string, PPacket>::iterator j = i->second.begin(); j != i->second.end(); ++j)
 				{
 					if(j->second->associatedVariables.empty()) continue;
+					requests++;
 					PVariable result = getValueFromDevice(j->second->associatedVariables.at(0), i->first, !waitForResponse);
-					if(!result || result->errorStruct || result->type == VariableType::tVoid) return false;
+					if(!result || result->errorStruct || result->type == VariableType::tVoid)
+					{
+						success = false;
+						break;
+					}
 				}
 			}
 		}
@@ -1250,16 +1700,53 @@ bool HMWiredPeer::ping(int32_t packetCount, bool waitForResponse)
     {
         GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
     }
-    return true;
+	uint64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+	if(liveness)
+	{
+		maintenanceStats.probes++;
+		maintenanceStats.probeRequests += requests;
+		maintenanceStats.probeTime += time;
+	}
+	else
+	{
+		maintenanceStats.polls++;
+		maintenanceStats.pollRequests += requests;
+		maintenanceStats.pollTime += time;
+	}
+	return success;
 }
 
-void HMWiredPeer::pingThread()
+bool HMWiredPeer::runMaintenance(MaintenanceType type, int64_t interval)
 {
-	if(ping(3, true)) serviceMessages->endUnreach();
-	else serviceMessages->setUnreach(true, false);
+	try
+	{
+		if(_disposing || deleting) return false;
+		bool reachable = false;
+		if(type == MaintenanceType::probe) reachable = ping(3, true);
+		else if(type == MaintenanceType::poll)
+		{
+			//The values are up to date, when the device sent a packet within the interval
+			int64_t timeSinceLastPacket = BaseLib::HelperFunctions::getTime() - ((int64_t)_lastPacketReceived * 1000);
+			if(timeSinceLastPacket < interval) return false;
+			reachable = pollValues(true, false);
+		}
+		else return false;
+		if(reachable) serviceMessages->endUnreach();
+		else serviceMessages->setUnreach(true, false);
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
 }
 
-void HMWiredPeer::addPeer(int32_t channel, std::shared_ptr<BaseLib::Systems::BasicPeer> peer)
+void HMWiredPeer::addPeer(int32_t channel, std::shared_ptr<BaseLib::Systems::BasicPeer> peer, bool save)
 {
 	try
 	{
@@ -1273,7 +1760,7 @@ void HMWiredPeer::addPeer(int32_t channel, std::shared_ptr<BaseLib::Systems::Bas
 			}
 		}
 		_peers[channel].push_back(peer);
-		savePeers();
+		if(save) savePeers();
 	}
 	catch(const std::exception& ex)
     {
@@ -1307,6 +1794,7 @@ void HMWiredPeer::removePeer(int32_t channel, uint64_t id, int32_t remoteChannel
 						std::vector<uint8_t> parameterData = binaryConfig[*j].getBinaryData();
 						if(!central->writeEEPROM(_address, *j, parameterData)) GD::out.printError("Error: Could not write config to device's eeprom.");
 					}
+					updateLinkSlot(std::dynamic_pointer_cast<LinkParameters>(parameterSet), (*i)->configEEPROMAddress);
 				}
 				_peers[channel].erase(i);
 				savePeers();
@@ -1324,7 +1812,108 @@ void HMWiredPeer::removePeer(int32_t channel, uint64_t id, int32_t remoteChannel
     }
 }
 
-int32_t HMWiredPeer::getFreeEEPROMAddress(int32_t channel, bool isSender)
+int32_t HMWiredPeer::getLinkSlotState(PLinkParameters linkGroup, int32_t address)
+{
+	try
+	{
+		std::vector<uint8_t> result = getConfigParameter(address + linkGroup->peerAddressMemoryOffset, 4.0, -1, true);
+		if(result.size() != 4) return -1;
+		//Endianness doesn't matter
+		return (*((int32_t*)&result.at(0)) == -1) ? 0 : 1;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return -1;
+}
+
+std::shared_ptr<LinkSlotTable> HMWiredPeer::getLinkSlotTable(PLinkParameters linkGroup, bool onlyKnownConfig)
+{
+	try
+	{
+		if(!linkGroup || linkGroup->memoryAddressStart < 0 || linkGroup->memoryAddressStep <= 0 || linkGroup->peerAddressMemoryOffset < 0 || linkGroup->maxLinkCount <= 0) return std::shared_ptr<LinkSlotTable>();
+		{
+			std::lock_guard<std::mutex> linkSlotTablesGuard(_linkSlotTablesMutex);
+			std::map<int32_t, std::shared_ptr<LinkSlotTable>>::iterator tableIterator = _linkSlotTables.find(linkGroup->memoryAddressStart);
+			if(tableIterator != _linkSlotTables.end() && tableIterator->second->memoryAddressStep == linkGroup->memoryAddressStep && (signed)tableIterator->second->usedSlots.size() == linkGroup->maxLinkCount) return tableIterator->second;
+		}
+
+		if(!onlyKnownConfig) prefetchConfigBlocks(getLinkTableBlocks(linkGroup));
+		std::shared_ptr<LinkSlotTable> linkSlots(new LinkSlotTable());
+		linkSlots->memoryAddressStart = linkGroup->memoryAddressStart;
+		linkSlots->memoryAddressStep = linkGroup->memoryAddressStep;
+		linkSlots->usedSlots.resize(linkGroup->maxLinkCount, true);
+		bool complete = true;
+		for(int32_t i = 0; i < linkGroup->maxLinkCount; i++)
+		{
+			int32_t state = getLinkSlotState(linkGroup, linkGroup->memoryAddressStart + (i * linkGroup->memoryAddressStep));
+			if(state == -1)
+			{
+				//Slots we can't read are never handed out. Without a complete EEPROM shadow the table is built again on the next call.
+				complete = false;
+				continue;
+			}
+			linkSlots->usedSlots[i] = state == 1;
+			if(state == 0) linkSlots->freeSlots++;
+		}
+		if(complete)
+		{
+			std::lock_guard<std::mutex> linkSlotTablesGuard(_linkSlotTablesMutex);
+			_linkSlotTables[linkGroup->memoryAddressStart] = linkSlots;
+		}
+		return linkSlots;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return std::shared_ptr<LinkSlotTable>();
+}
+
+void HMWiredPeer::updateLinkSlot(PLinkParameters linkGroup, int32_t address)
+{
+	try
+	{
+		if(!linkGroup || linkGroup->memoryAddressStep <= 0 || address < linkGroup->memoryAddressStart) return;
+		int32_t slot = (address - linkGroup->memoryAddressStart) / linkGroup->memoryAddressStep;
+		int32_t state = getLinkSlotState(linkGroup, address);
+		std::lock_guard<std::mutex> linkSlotTablesGuard(_linkSlotTablesMutex);
+		std::map<int32_t, std::shared_ptr<LinkSlotTable>>::iterator tableIterator = _linkSlotTables.find(linkGroup->memoryAddressStart);
+		if(tableIterator == _linkSlotTables.end()) return;
+		std::shared_ptr<LinkSlotTable>& linkSlots = tableIterator->second;
+		if(slot >= (signed)linkSlots->usedSlots.size()) return;
+		if(state == -1)
+		{
+			//The slot's content is unknown now. Build the table again when it is needed.
+			_linkSlotTables.erase(tableIterator);
+			return;
+		}
+		bool used = state == 1;
+		if(linkSlots->usedSlots[slot] == used) return;
+		linkSlots->usedSlots[slot] = used;
+		if(used) linkSlots->freeSlots--;
+		else linkSlots->freeSlots++;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+int32_t HMWiredPeer::getFreeEEPROMAddress(int32_t channel, bool isSender, bool reserve)
 {
 	try
 	{
@@ -1338,22 +1927,35 @@ int32_t HMWiredPeer::getFreeEEPROMAddress(int32_t channel, bool isSender)
 		if(!parameterGroup) return -1;
 		PLinkParameters linkGroup(std::dynamic_pointer_cast<LinkParameters>(parameterGroup));
 		if(!linkGroup || linkGroup->memoryAddressStart < 0 || linkGroup->memoryAddressStep <= 0 || linkGroup->peerAddressMemoryOffset < 0) return -1;
-		int32_t max = linkGroup->memoryAddressStart + (linkGroup->maxLinkCount * linkGroup->memoryAddressStep);
-
-		int32_t currentAddress = 0;
-		for(currentAddress = linkGroup->memoryAddressStart; currentAddress < max; currentAddress += linkGroup->memoryAddressStep)
+		std::shared_ptr<LinkSlotTable> linkSlots = getLinkSlotTable(linkGroup, false);
+		if(linkSlots)
 		{
-			std::vector<uint8_t> result = getConfigParameter(currentAddress + linkGroup->peerAddressMemoryOffset, 4.0);
-			if(result.size() != 4) continue;
-			//Endianness doesn't matter
-			if(*((int32_t*)&result.at(0)) == -1) return currentAddress;
-		}
-		if(currentAddress >= max)
-		{
-			GD::out.printError("Error: There are no free EEPROM addresses to store links.");
-			return -1;
+			std::lock_guard<std::mutex> linkSlotTablesGuard(_linkSlotTablesMutex);
+			if(reserve)
+			{
+				std::map<int32_t, std::shared_ptr<LinkSlotTable>>::iterator tableIterator = _linkSlotTables.find(linkGroup->memoryAddressStart);
+				if(tableIterator == _linkSlotTables.end() || tableIterator->second != linkSlots)
+				{
+					GD::out.printError("Error: Can't reserve link slot. The link table of peer " + std::to_string(_peerID) + " could not be read completely.");
+					return -1;
+				}
+			}
+			if(linkSlots->freeSlots > 0)
+			{
+				for(uint32_t i = 0; i < linkSlots->usedSlots.size(); i++)
+				{
+					if(linkSlots->usedSlots[i]) continue;
+					if(reserve)
+					{
+						linkSlots->usedSlots[i] = true;
+						linkSlots->freeSlots--;
+					}
+					return linkGroup->memoryAddressStart + (i * linkGroup->memoryAddressStep);
+				}
+			}
 		}
-		return currentAddress;
+		GD::out.printError("Error: There are no free EEPROM addresses to store links.");
+		return -1;
 	}
 	catch(const std::exception& ex)
     {
@@ -1382,6 +1984,12 @@ void HMWiredPeer::loadVariables(BaseLib::Systems::ICentral* central, std::shared
 			case 12:
 				unserializePeers(row->second.at(5)->binaryValue);
 				break;
+			case 13:
+				_firmwareCheckpoint.unserialize(_bl, row->second.at(5)->binaryValue);
+				break;
+			case 14:
+				_physicalInterfaceId = row->second.at(4)->textValue;
+				break;
 			}
 		}
 	}
@@ -1401,6 +2009,7 @@ bool HMWiredPeer::load(BaseLib::Systems::ICentral* central)
 	{
 		std::shared_ptr<BaseLib::Database::DataTable> rows;
 		loadVariables(central, rows);
+		_lastMessageCounterSave = BaseLib::HelperFunctions::getTime();
 
 		_rpcDevice = GD::family->getRpcDevices()->find(_deviceType, _firmwareVersion, -1);
 		if(!_rpcDevice)
@@ -1410,6 +2019,7 @@ bool HMWiredPeer::load(BaseLib::Systems::ICentral* central)
 		}
 
 		if(_rpcDevice->memorySize == 0) _rpcDevice->memorySize = 1024;
+		std::atomic_store(&_frameDecoder, FrameDecoder::get(_rpcDevice));
 
 		initializeTypeString();
 		std::string entry;
@@ -1438,8 +2048,14 @@ void HMWiredPeer::saveVariables()
 	{
 		if(_peerID == 0) return;
 		Peer::saveVariables();
-		saveVariable(5, (int32_t)_messageCounter);
+		_messageCounterChanged = 0;
+		_lastMessageCounterSave = BaseLib::HelperFunctions::getTime();
+		saveVariable(5, (int64_t)_messageCounter);
 		savePeers(); //12
+		{
+			std::lock_guard<std::mutex> physicalInterfaceIdGuard(_physicalInterfaceIdMutex);
+			saveVariable(14, _physicalInterfaceId);
+		}
 	}
 	catch(const std::exception& ex)
     {
@@ -1451,13 +2067,15 @@ void HMWiredPeer::saveVariables()
     }
 }
 
-void HMWiredPeer::savePeers()
+void HMWiredPeer::saveMessageCounter()
 {
 	try
 	{
-		std::vector<uint8_t> serializedData;
-		serializePeers(serializedData);
-		saveVariable(12, serializedData);
+		if(_peerID == 0 || _messageCounterChanged == 0) return;
+		_messageCounterChanged = 0;
+		_lastMessageCounterSave = BaseLib::HelperFunctions::getTime();
+		//The counter is only saved every few minutes, so write it directly instead of queueing it
+		saveVariable(5, (int64_t)_messageCounter);
 	}
 	catch(const std::exception& ex)
     {
@@ -1469,30 +2087,108 @@ void HMWiredPeer::savePeers()
     }
 }
 
-void HMWiredPeer::serializePeers(std::vector<uint8_t>& encodedData)
+std::shared_ptr<IHMWiredInterface> HMWiredPeer::getPhysicalInterface()
+{
+	std::lock_guard<std::mutex> physicalInterfaceIdGuard(_physicalInterfaceIdMutex);
+	std::map<std::string, std::shared_ptr<IHMWiredInterface>>::iterator interfaceIterator = GD::physicalInterfaces.find(_physicalInterfaceId);
+	if(interfaceIterator != GD::physicalInterfaces.end()) return interfaceIterator->second;
+	return GD::physicalInterface;
+}
+
+std::string HMWiredPeer::getPhysicalInterfaceId()
+{
+	std::shared_ptr<IHMWiredInterface> physicalInterface = getPhysicalInterface();
+	return physicalInterface ? physicalInterface->getID() : "";
+}
+
+void HMWiredPeer::setPhysicalInterfaceId(const std::string& interfaceId)
 {
 	try
 	{
-		BaseLib::BinaryEncoder encoder(_bl);
-		encoder.encodeInteger(encodedData, _peers.size());
-		for(std::unordered_map<int32_t, std::vector<std::shared_ptr<BaseLib::Systems::BasicPeer>>>::const_iterator i = _peers.begin(); i != _peers.end(); ++i)
-		{
-			encoder.encodeInteger(encodedData, i->first);
-			encoder.encodeInteger(encodedData, i->second.size());
-			for(std::vector<std::shared_ptr<BaseLib::Systems::BasicPeer>>::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
-			{
-				if(!*j) continue;
-				encoder.encodeBoolean(encodedData, (*j)->isSender);
-				encoder.encodeInteger(encodedData, (*j)->id);
-				encoder.encodeInteger(encodedData, (*j)->address);
-				encoder.encodeInteger(encodedData, (*j)->channel);
-				encoder.encodeInteger(encodedData, (*j)->physicalIndexOffset);
-				encoder.encodeString(encodedData, (*j)->serialNumber);
-				encoder.encodeBoolean(encodedData, (*j)->isVirtual);
-				encoder.encodeString(encodedData, (*j)->linkName);
-				encoder.encodeString(encodedData, (*j)->linkDescription);
-				encoder.encodeInteger(encodedData, (*j)->configEEPROMAddress);
-				encoder.encodeInteger(encodedData, (*j)->data.size());
+		std::lock_guard<std::mutex> physicalInterfaceIdGuard(_physicalInterfaceIdMutex);
+		if(interfaceId == _physicalInterfaceId) return;
+		_physicalInterfaceId = interfaceId;
+		if(_peerID > 0) saveVariable(14, _physicalInterfaceId);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+FirmwareCheckpoint HMWiredPeer::getFirmwareCheckpoint()
+{
+	std::lock_guard<std::mutex> firmwareCheckpointGuard(_firmwareCheckpointMutex);
+	return _firmwareCheckpoint;
+}
+
+void HMWiredPeer::setFirmwareCheckpoint(FirmwareCheckpoint checkpoint)
+{
+	try
+	{
+		std::lock_guard<std::mutex> firmwareCheckpointGuard(_firmwareCheckpointMutex);
+		if(checkpoint.empty() && _firmwareCheckpoint.empty()) return;
+		_firmwareCheckpoint = checkpoint;
+		std::vector<uint8_t> serializedData;
+		if(!checkpoint.empty()) checkpoint.serialize(_bl, serializedData);
+		saveVariable(13, serializedData);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void HMWiredPeer::savePeers()
+{
+	try
+	{
+		std::vector<uint8_t> serializedData;
+		serializePeers(serializedData);
+		saveVariable(12, serializedData);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void HMWiredPeer::serializePeers(std::vector<uint8_t>& encodedData)
+{
+	try
+	{
+		BaseLib::BinaryEncoder encoder(_bl);
+		encoder.encodeInteger(encodedData, _peers.size());
+		for(std::unordered_map<int32_t, std::vector<std::shared_ptr<BaseLib::Systems::BasicPeer>>>::const_iterator i = _peers.begin(); i != _peers.end(); ++i)
+		{
+			encoder.encodeInteger(encodedData, i->first);
+			encoder.encodeInteger(encodedData, i->second.size());
+			for(std::vector<std::shared_ptr<BaseLib::Systems::BasicPeer>>::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
+			{
+				if(!*j) continue;
+				encoder.encodeBoolean(encodedData, (*j)->isSender);
+				encoder.encodeInteger(encodedData, (*j)->id);
+				encoder.encodeInteger(encodedData, (*j)->address);
+				encoder.encodeInteger(encodedData, (*j)->channel);
+				encoder.encodeInteger(encodedData, (*j)->physicalIndexOffset);
+				encoder.encodeString(encodedData, (*j)->serialNumber);
+				encoder.encodeBoolean(encodedData, (*j)->isVirtual);
+				encoder.encodeString(encodedData, (*j)->linkName);
+				encoder.encodeString(encodedData, (*j)->linkDescription);
+				encoder.encodeInteger(encodedData, (*j)->configEEPROMAddress);
+				encoder.encodeInteger(encodedData, (*j)->data.size());
 				encodedData.insert(encodedData.end(), (*j)->data.begin(), (*j)->data.end());
 			}
 		}
@@ -1595,8 +2291,10 @@ void HMWiredPeer::restoreLinks()
 			PLinkParameters linkGroup(std::dynamic_pointer_cast<LinkParameters>(parameterGroup));
 			if(!linkGroup || linkGroup->memoryAddressStart < 0 || linkGroup->memoryAddressStep <= 0 || linkGroup->peerAddressMemoryOffset < 0) continue;
 			int32_t max = linkGroup->memoryAddressStart + (linkGroup->maxLinkCount * linkGroup->memoryAddressStep);
+			std::shared_ptr<LinkSlotTable> linkSlots = getLinkSlotTable(linkGroup, true);
 			for(int32_t currentAddress = linkGroup->memoryAddressStart; currentAddress < max; currentAddress += linkGroup->memoryAddressStep)
 			{
+				if(linkSlots && !linkSlots->usedSlots.at((currentAddress - linkGroup->memoryAddressStart) / linkGroup->memoryAddressStep)) continue;
 				std::vector<uint8_t> result = getConfigParameter(currentAddress + linkGroup->peerAddressMemoryOffset, 4.0, -1, true);
 				if(result.size() != 4) continue;
 				//Endianness doesn't matter
@@ -1731,14 +2429,422 @@ std::string HMWiredPeer::getFirmwareVersionString(int32_t firmwareVersion)
     {
     	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
     }
-	return "";
+	return "";
+}
+
+bool HMWiredPeer::firmwareUpdateAvailable()
+{
+	try
+	{
+		return _firmwareVersion > 0 && _firmwareVersion < getNewFirmwareVersion();
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+	return false;
+}
+
+void HMWiredPeer::getValuesFromPacket(std::shared_ptr<HMWiredPacket> packet, std::vector<FrameValues>& frameValues)
+{
+	try
+	{
+		if(!_rpcDevice) return;
+		std::shared_ptr<FrameDecoder> frameDecoder = std::atomic_load(&_frameDecoder);
+		if(!frameDecoder || frameDecoder->getRpcDevice() != _rpcDevice)
+		{
+			frameDecoder = FrameDecoder::get(_rpcDevice);
+			std::atomic_store(&_frameDecoder, frameDecoder);
+			invalidateValueSlots();
+		}
+		if(!frameDecoder) return;
+		frameDecoder->decode(this, _address, packet, frameValues);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+bool HMWiredPeer::channelHasParameter(int32_t channel, ParameterGroup::Type::Enum type, const std::string& id)
+{
+	try
+	{
+		if(_rpcDevice->functions.find(channel) == _rpcDevice->functions.end()) return false;
+		PParameterGroup parameterGroup = getParameterSet(channel, type);
+		return parameterGroup && parameterGroup->getParameter(id);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+std::shared_ptr<HMWiredPacket> HMWiredPeer::getResponse(std::shared_ptr<HMWiredPacket> packet)
+{
+	try
+	{
+		std::shared_ptr<HMWiredPacket> request(packet);
+		std::shared_ptr<HMWiredPacket> response = std::dynamic_pointer_cast<HMWiredCentral>(getCentral())->sendPacket(request, true);
+		//Don't send ok here! It's sent in packetReceived if necessary.
+		return response;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return std::shared_ptr<HMWiredPacket>();
+}
+
+PVariable HMWiredPeer::getValueFromDevice(PParameter& parameter, int32_t channel, bool asynchronous)
+{
+	try
+	{
+		if(!parameter) return Variable::createError(-32500, "parameter is nullptr.");
+		if(parameter->getPackets.empty()) return Variable::createError(-6, "Parameter can't be requested actively.");
+		std::string getRequestFrame = parameter->getPackets.at(0)->id;
+		std::string getResponseFrame = parameter->getPackets.at(0)->responseId;
+		PacketsById::iterator packetIterator = _rpcDevice->packetsById.find(getRequestFrame);
+		if(packetIterator == _rpcDevice->packetsById.end()) return Variable::createError(-6, "No frame was found for parameter " + parameter->id);
+		PPacket frame = packetIterator->second;
+		PPacket responseFrame;
+		packetIterator = _rpcDevice->packetsById.find(getResponseFrame);
+		if(packetIterator != _rpcDevice->packetsById.end()) responseFrame = _rpcDevice->packetsById[getResponseFrame];
+
+		if(valuesCentral.find(channel) == valuesCentral.end()) return Variable::createError(-2, "Unknown channel.");
+		if(valuesCentral[channel].find(parameter->id) == valuesCentral[channel].end()) return Variable::createError(-5, "Unknown parameter.");
+
+		PParameterGroup parameterGroup = getParameterSet(channel, ParameterGroup::Type::Enum::variables);
+		if(!parameterGroup) return Variable::createError(-3, "Unknown parameter set.");
+
+		valueRequestStats.requests++;
+		int64_t maxAge = GD::family->valueMaxAge();
+		if(maxAge > 0 && valueIsFresh(channel, parameter->id, maxAge)) valueRequestStats.cached++;
+		else
+		{
+			std::pair<uint32_t, std::string> requestKey(channel, getRequestFrame);
+			std::shared_ptr<ValueRequest> request;
+			bool merged = false;
+			{
+				std::unique_lock<std::mutex> valueRequestsGuard(_valueRequestsMutex);
+				std::map<std::pair<uint32_t, std::string>, std::shared_ptr<ValueRequest>>::iterator requestIterator = _valueRequests.find(requestKey);
+				if(requestIterator != _valueRequests.end())
+				{
+					//The response of the running request updates valuesCentral for this request, too
+					request = requestIterator->second;
+					merged = true;
+					valueRequestStats.merged++;
+					//The timeout is a safety net only. The request is always completed by the caller sending it.
+					if(!_valueRequestsConditionVariable.wait_for(valueRequestsGuard, std::chrono::milliseconds(10000), [&] { return request->done; }) || !request->success) return PVariable(new Variable(VariableType::tVoid));
+				}
+				else
+				{
+					request = std::make_shared<ValueRequest>();
+					_valueRequests.emplace(requestKey, request);
+				}
+			}
+
+			if(!merged)
+			{
+				//Completes the request on every way out of this scope, so the merged callers are woken up even when sending throws
+				class RequestCompletion
+				{
+				public:
+					RequestCompletion(HMWiredPeer* peer, const std::pair<uint32_t, std::string>& key, std::shared_ptr<ValueRequest> request) : _peer(peer), _key(key), _request(request) {}
+					~RequestCompletion()
+					{
+						{
+							std::lock_guard<std::mutex> valueRequestsGuard(_peer->_valueRequestsMutex);
+							_request->done = true;
+							_peer->_valueRequests.erase(_key);
+						}
+						_peer->_valueRequestsConditionVariable.notify_all();
+					}
+				private:
+					HMWiredPeer* _peer;
+					std::pair<uint32_t, std::string> _key;
+					std::shared_ptr<ValueRequest> _request;
+				} requestCompletion(this, requestKey, request);
+
+				valueRequestStats.sent++;
+				std::shared_ptr<HMWiredPacket> response = sendValueRequest(frame, channel, parameterGroup);
+				if(!response) return PVariable(new Variable(VariableType::tVoid));
+				std::lock_guard<std::mutex> valueRequestsGuard(_valueRequestsMutex);
+				request->success = true;
+			}
+		}
+
+		auto& rpcConfigurationParameter = valuesCentral[channel][parameter->id];
+		std::vector<uint8_t> parameterData = rpcConfigurationParameter.getBinaryData();
+		return parameter->convertFromPacket(parameterData, rpcConfigurationParameter.mainRole(), true);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return Variable::createError(-32500, "Unknown application error.");
+}
+
+std::shared_ptr<HMWiredPacket> HMWiredPeer::sendValueRequest(PPacket frame, int32_t channel, PParameterGroup parameterGroup)
+{
+	try
+	{
+		std::vector<uint8_t> payload({ (uint8_t)frame->type });
+		if(frame->subtype > -1 && frame->subtypeIndex >= 9)
+		{
+			while((signed)payload.size() - 1 < frame->subtypeIndex - 9) payload.push_back(0);
+			payload.at(frame->subtypeIndex - 9) = (uint8_t)frame->subtype;
+		}
+		if(frame->channelIndex >= 9)
+		{
+			while((signed)payload.size() - 1 < frame->channelIndex - 9) payload.push_back(0);
+			payload.at(frame->channelIndex - 9) = (uint8_t)channel + _rpcDevice->functions.at(channel)->physicalChannelIndexOffset;
+		}
+
+		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, getCentral()->getAddress(), _address, false, _messageCounter, 0, 0, payload));
+		for(BinaryPayloads::iterator i = frame->binaryPayloads.begin(); i != frame->binaryPayloads.end(); ++i)
+		{
+			if((*i)->constValueInteger > -1)
+			{
+				std::vector<uint8_t> data;
+				_bl->hf.memcpyBigEndian(data, (*i)->constValueInteger);
+				packet->setPosition((*i)->index, (*i)->size, data);
+				continue;
+			}
+
+			bool paramFound = false;
+			for(Parameters::iterator j = parameterGroup->parameters.begin(); j != parameterGroup->parameters.end(); ++j)
+			{
+				if((*i)->parameterId == j->second->physical->groupId)
+				{
+					std::vector<uint8_t> parameterData = valuesCentral[channel][j->second->id].getBinaryData();
+					packet->setPosition((*i)->index, (*i)->size, parameterData);
+					paramFound = true;
+					break;
+				}
+			}
+			if(!paramFound) GD::out.printError("Error constructing packet. param \"" + (*i)->parameterId + "\" not found. Peer: " + std::to_string(_peerID) + " Serial number: " + _serialNumber + " Frame: " + frame->id);
+		}
+		setMessageCounter(_messageCounter + 1);
+
+		return getResponse(packet);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return std::shared_ptr<HMWiredPacket>();
+}
+
+bool HMWiredPeer::valueIsFresh(uint32_t channel, const std::string& parameterId, int64_t maxAge)
+{
+	try
+	{
+		std::lock_guard<std::mutex> valueTimesGuard(_valueTimesMutex);
+		std::unordered_map<uint32_t, std::unordered_map<std::string, int64_t>>::iterator channelIterator = _valueTimes.find(channel);
+		if(channelIterator == _valueTimes.end()) return false;
+		std::unordered_map<std::string, int64_t>::iterator timeIterator = channelIterator->second.find(parameterId);
+		if(timeIterator == channelIterator->second.end()) return false;
+		return BaseLib::HelperFunctions::getTime() - timeIterator->second <= maxAge;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return false;
+}
+
+
+std::shared_ptr<ValueSlots> HMWiredPeer::getValueSlots()
+{
+	try
+	{
+		uint32_t generation = 0;
+		{
+			std::lock_guard<std::mutex> valueSlotsGuard(_valueSlotsMutex);
+			if(_valueSlots) return _valueSlots;
+			generation = _valueSlotsGeneration;
+		}
+		std::shared_ptr<FrameDecoder> frameDecoder = std::atomic_load(&_frameDecoder);
+		if(!_rpcDevice || _rpcDevice->functions.empty() || !frameDecoder) return std::shared_ptr<ValueSlots>();
+
+		std::shared_ptr<ValueSlots> valueSlots(new ValueSlots());
+		valueSlots->resize(_rpcDevice->functions.rbegin()->first + 1);
+		for(Functions::iterator i = _rpcDevice->functions.begin(); i != _rpcDevice->functions.end(); ++i)
+		{
+			std::vector<ValueSlot>& channelSlots = valueSlots->at(i->first);
+			channelSlots.resize(frameDecoder->slotCount());
+			PParameterGroup parameterGroup = getParameterSet(i->first, ParameterGroup::Type::Enum::variables);
+			if(!parameterGroup) continue;
+			std::unordered_map<uint32_t, std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>>::iterator channelIterator = valuesCentral.find(i->first);
+			for(Parameters::iterator j = parameterGroup->parameters.begin(); j != parameterGroup->parameters.end(); ++j)
+			{
+				int32_t slot = frameDecoder->getSlot(j->first);
+				if(slot < 0) continue;
+				channelSlots.at(slot).parameter = j->second;
+				if(channelIterator == valuesCentral.end()) continue;
+				std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>::iterator valueIterator = channelIterator->second.find(j->first);
+				//Elements of unordered_map keep their address, so the pointer stays valid as long as the value isn't erased
+				if(valueIterator != channelIterator->second.end()) channelSlots.at(slot).value = &valueIterator->second;
+			}
+		}
+
+		std::lock_guard<std::mutex> valueSlotsGuard(_valueSlotsMutex);
+		if(generation == _valueSlotsGeneration) _valueSlots = valueSlots;
+		return valueSlots;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return std::shared_ptr<ValueSlots>();
+}
+
+void HMWiredPeer::invalidateValueSlots()
+{
+	try
+	{
+		std::lock_guard<std::mutex> valueSlotsGuard(_valueSlotsMutex);
+		_valueSlotsGeneration++;
+		_valueSlots.reset();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void HMWiredPeer::saveParameterDeferred(uint64_t databaseId, ParameterGroup::Type::Enum parameterSetType, uint32_t channel, const std::string& parameterName, std::vector<uint8_t>& value)
+{
+	try
+	{
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::shared_ptr<PersistenceQueue> persistenceQueue = GD::persistenceQueue;
+		if(databaseId > 0 && persistenceQueue && persistenceQueue->enqueueParameter(std::static_pointer_cast<HMWiredPeer>(shared_from_this()), databaseId, value))
+		{
+			persistenceQueue->addCallerTime(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count(), false);
+			return;
+		}
+		saveParameter(databaseId, parameterSetType, channel, parameterName, value);
+		if(persistenceQueue) persistenceQueue->addCallerTime(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count(), true);
+	}
+	catch(const std::bad_weak_ptr& ex)
+	{
+		//Not owned by a shared pointer yet
+		saveParameter(databaseId, parameterSetType, channel, parameterName, value);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void HMWiredPeer::flushDeferredSaves()
+{
+	try
+	{
+		std::shared_ptr<PersistenceQueue> persistenceQueue = GD::persistenceQueue;
+		if(persistenceQueue) persistenceQueue->flush(_peerID);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void HMWiredPeer::saveVariableDeferred(uint32_t index, int64_t value)
+{
+	try
+	{
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::shared_ptr<PersistenceQueue> persistenceQueue = GD::persistenceQueue;
+		//New variables are inserted directly, so only this thread modifies _variableDatabaseIDs
+		if(_peerID > 0 && persistenceQueue && _variableDatabaseIDs.find(index) != _variableDatabaseIDs.end() && persistenceQueue->enqueueVariable(std::static_pointer_cast<HMWiredPeer>(shared_from_this()), index, value))
+		{
+			persistenceQueue->addCallerTime(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count(), false);
+			return;
+		}
+		saveVariable(index, value);
+		if(persistenceQueue) persistenceQueue->addCallerTime(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count(), true);
+	}
+	catch(const std::bad_weak_ptr& ex)
+	{
+		saveVariable(index, value);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
 }
 
-bool HMWiredPeer::firmwareUpdateAvailable()
+std::shared_ptr<SetValueFrame> HMWiredPeer::getSetValueFrame(uint32_t channel, const std::string& valueKey, const std::vector<uint8_t>& value)
 {
 	try
 	{
-		return _firmwareVersion > 0 && _firmwareVersion < getNewFirmwareVersion();
+		std::shared_ptr<SetValueFrame> frame;
+		{
+			std::lock_guard<std::mutex> setValueFramesGuard(_setValueFramesMutex);
+			std::map<std::tuple<uint32_t, std::string, std::vector<uint8_t>>, std::shared_ptr<SetValueFrame>>::iterator frameIterator = _setValueFrames.find(std::make_tuple(channel, valueKey, value));
+			if(frameIterator == _setValueFrames.end()) return std::shared_ptr<SetValueFrame>();
+			frame = frameIterator->second;
+		}
+		std::unordered_map<uint32_t, std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>>::iterator channelIterator = valuesCentral.find(channel);
+		if(channelIterator == valuesCentral.end()) return std::shared_ptr<SetValueFrame>();
+		for(std::vector<std::pair<std::string, std::vector<uint8_t>>>::iterator i = frame->dependencies.begin(); i != frame->dependencies.end(); ++i)
+		{
+			std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>::iterator parameterIterator = channelIterator->second.find(i->first);
+			if(parameterIterator == channelIterator->second.end() || !parameterIterator->second.equals(i->second)) return std::shared_ptr<SetValueFrame>();
+		}
+		return frame;
 	}
 	catch(const std::exception& ex)
     {
@@ -1748,99 +2854,17 @@ bool HMWiredPeer::firmwareUpdateAvailable()
     {
     	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
     }
-	return false;
+    return std::shared_ptr<SetValueFrame>();
 }
 
-void HMWiredPeer::getValuesFromPacket(std::shared_ptr<HMWiredPacket> packet, std::vector<FrameValues>& frameValues)
+void HMWiredPeer::addSetValueFrame(uint32_t channel, const std::string& valueKey, const std::vector<uint8_t>& value, std::shared_ptr<SetValueFrame> frame)
 {
 	try
 	{
-		if(!_rpcDevice) return;
-		//equal_range returns all elements with "0" or an unknown element as argument
-		if(packet->messageType() == 0 || _rpcDevice->packetsByMessageType.find(packet->messageType()) == _rpcDevice->packetsByMessageType.end()) return;
-		std::pair<PacketsByMessageType::iterator, PacketsByMessageType::iterator> range = _rpcDevice->packetsByMessageType.equal_range((uint32_t)packet->messageType());
-		if(range.first == _rpcDevice->packetsByMessageType.end()) return;
-		PacketsByMessageType::iterator i = range.first;
-		do
-		{
-			FrameValues currentFrameValues;
-			PPacket frame(i->second);
-			if(!frame) continue;
-			if(frame->direction == Packet::Direction::Enum::toCentral && packet->senderAddress() != _address) continue;
-			if(frame->direction == Packet::Direction::Enum::fromCentral && packet->destinationAddress() != _address) continue;
-			if(packet->payload().empty()) continue;
-			if(frame->subtype > -1 && frame->subtypeIndex >= 9 && (signed)packet->payload().size() > (frame->subtypeIndex - 9) && packet->payload().at(frame->subtypeIndex - 9) != (unsigned)frame->subtype) continue;
-			int32_t channelIndex = frame->channelIndex;
-			int32_t channel = -1;
-			if(channelIndex >= 9 && (signed)packet->payload().size() > (channelIndex - 9)) channel = packet->payload().at(channelIndex - 9) - frame->channelIndexOffset;
-			if(channel > -1 && frame->channelSize < 1.0) channel &= (0xFF >> (8 - std::lround(frame->channelSize * 10) % 10));
-			if(frame->channel > -1) channel = frame->channel;
-			currentFrameValues.frameID = frame->id;
-
-			for(BinaryPayloads::iterator j = frame->binaryPayloads.begin(); j != frame->binaryPayloads.end(); ++j)
-			{
-				std::vector<uint8_t> data;
-				if((*j)->size > 0 && (*j)->index > 0)
-				{
-					if(((int32_t)(*j)->index) - 9 >= (signed)packet->payload().size()) continue;
-					data = packet->getPosition((*j)->index, (*j)->size, -1);
-
-					if((*j)->constValueInteger > -1)
-					{
-						int32_t intValue = 0;
-						_bl->hf.memcpyBigEndian(intValue, data);
-						if(intValue != (*j)->constValueInteger) break; else continue;
-					}
-				}
-				else if((*j)->constValueInteger > -1)
-				{
-					_bl->hf.memcpyBigEndian(data, (*j)->constValueInteger);
-				}
-				else continue;
-				for(std::vector<PParameter>::iterator k = frame->associatedVariables.begin(); k != frame->associatedVariables.end(); ++k)
-				{
-					if((*k)->physical->groupId != (*j)->parameterId) continue;
-					currentFrameValues.parameterSetType = (*k)->parent()->type();
-					bool setValues = false;
-					if(currentFrameValues.paramsetChannels.empty()) //Fill paramsetChannels
-					{
-						int32_t startChannel = (channel < 0) ? 0 : channel;
-						int32_t endChannel;
-						//When fixedChannel is -2 (means '*') cycle through all channels
-						if(frame->channel == -2)
-						{
-							startChannel = 0;
-							endChannel = _rpcDevice->functions.rbegin()->first;
-						}
-						else endChannel = startChannel;
-						for(int32_t l = startChannel; l <= endChannel; l++)
-						{
-							if(_rpcDevice->functions.find(l) == _rpcDevice->functions.end()) continue;
-							PParameterGroup parameteGroup = getParameterSet(l, currentFrameValues.parameterSetType);
-							if(!parameteGroup) continue;
-							if(!parameteGroup->getParameter((*k)->id)) continue;
-							currentFrameValues.paramsetChannels.push_back(l);
-							currentFrameValues.values[(*k)->id].channels.push_back(l);
-							setValues = true;
-						}
-					}
-					else //Use paramsetChannels
-					{
-						for(std::list<uint32_t>::const_iterator l = currentFrameValues.paramsetChannels.begin(); l != currentFrameValues.paramsetChannels.end(); ++l)
-						{
-							if(_rpcDevice->functions.find(*l) == _rpcDevice->functions.end()) continue;
-							PParameterGroup parameterGroup = getParameterSet(*l, currentFrameValues.parameterSetType);
-							if(!parameterGroup) continue;
-							if(!parameterGroup->getParameter((*k)->id)) continue;
-							currentFrameValues.values[(*k)->id].channels.push_back(*l);
-							setValues = true;
-						}
-					}
-					if(setValues) currentFrameValues.values[(*k)->id].value = data;
-				}
-			}
-			if(!currentFrameValues.values.empty()) frameValues.push_back(currentFrameValues);
-		} while(++i != range.second && i != _rpcDevice->packetsByMessageType.end());
+		std::lock_guard<std::mutex> setValueFramesGuard(_setValueFramesMutex);
+		//Values like LEVEL have many encodings. Start over instead of tracking the usage of each frame.
+		if(_setValueFrames.size() >= _maxSetValueFrames) _setValueFrames.clear();
+		_setValueFrames[std::make_tuple(channel, valueKey, value)] = frame;
 	}
 	catch(const std::exception& ex)
     {
@@ -1852,91 +2876,29 @@ void HMWiredPeer::getValuesFromPacket(std::shared_ptr<HMWiredPacket> packet, std
     }
 }
 
-std::shared_ptr<HMWiredPacket> HMWiredPeer::getResponse(std::shared_ptr<HMWiredPacket> packet)
+void HMWiredPeer::clearSetValueFrames()
 {
-	try
-	{
-		std::shared_ptr<HMWiredPacket> request(packet);
-		std::shared_ptr<HMWiredPacket> response = std::dynamic_pointer_cast<HMWiredCentral>(getCentral())->sendPacket(request, true);
-		//Don't send ok here! It's sent in packetReceived if necessary.
-		return response;
-	}
-	catch(const std::exception& ex)
-	{
-		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
-	}
-	catch(...)
-	{
-		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
-	}
-	return std::shared_ptr<HMWiredPacket>();
+	std::lock_guard<std::mutex> setValueFramesGuard(_setValueFramesMutex);
+	_setValueFrames.clear();
 }
 
-PVariable HMWiredPeer::getValueFromDevice(PParameter& parameter, int32_t channel, bool asynchronous)
+void HMWiredPeer::configBlockChanged(int32_t configBlockIndex)
 {
 	try
 	{
-		if(!parameter) return Variable::createError(-32500, "parameter is nullptr.");
-		if(parameter->getPackets.empty()) return Variable::createError(-6, "Parameter can't be requested actively.");
-		std::string getRequestFrame = parameter->getPackets.at(0)->id;
-		std::string getResponseFrame = parameter->getPackets.at(0)->responseId;
-		PacketsById::iterator packetIterator = _rpcDevice->packetsById.find(getRequestFrame);
-		if(packetIterator == _rpcDevice->packetsById.end()) return Variable::createError(-6, "No frame was found for parameter " + parameter->id);
-		PPacket frame = packetIterator->second;
-		PPacket responseFrame;
-		packetIterator = _rpcDevice->packetsById.find(getResponseFrame);
-		if(packetIterator != _rpcDevice->packetsById.end()) responseFrame = _rpcDevice->packetsById[getResponseFrame];
-
-		if(valuesCentral.find(channel) == valuesCentral.end()) return Variable::createError(-2, "Unknown channel.");
-		if(valuesCentral[channel].find(parameter->id) == valuesCentral[channel].end()) return Variable::createError(-5, "Unknown parameter.");
-
-		PParameterGroup parameterGroup = getParameterSet(channel, ParameterGroup::Type::Enum::variables);
-		if(!parameterGroup) return Variable::createError(-3, "Unknown parameter set.");
-
-		std::vector<uint8_t> payload({ (uint8_t)frame->type });
-		if(frame->subtype > -1 && frame->subtypeIndex >= 9)
-		{
-			while((signed)payload.size() - 1 < frame->subtypeIndex - 9) payload.push_back(0);
-			payload.at(frame->subtypeIndex - 9) = (uint8_t)frame->subtype;
-		}
-		if(frame->channelIndex >= 9)
-		{
-			while((signed)payload.size() - 1 < frame->channelIndex - 9) payload.push_back(0);
-			payload.at(frame->channelIndex - 9) = (uint8_t)channel + _rpcDevice->functions.at(channel)->physicalChannelIndexOffset;
-		}
-
-		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, getCentral()->getAddress(), _address, false, _messageCounter, 0, 0, payload));
-		for(BinaryPayloads::iterator i = frame->binaryPayloads.begin(); i != frame->binaryPayloads.end(); ++i)
 		{
-			if((*i)->constValueInteger > -1)
-			{
-				std::vector<uint8_t> data;
-				_bl->hf.memcpyBigEndian(data, (*i)->constValueInteger);
-				packet->setPosition((*i)->index, (*i)->size, data);
-				continue;
-			}
-
-			bool paramFound = false;
-			for(Parameters::iterator j = parameterGroup->parameters.begin(); j != parameterGroup->parameters.end(); ++j)
+			std::lock_guard<std::mutex> parameterGroupCacheGuard(_parameterGroupCacheMutex);
+			_parameterGroupCacheGeneration++;
+			if(_parameterGroupSelectorBlocks.find(configBlockIndex) != _parameterGroupSelectorBlocks.end())
 			{
-				if((*i)->parameterId == j->second->physical->groupId)
-				{
-					std::vector<uint8_t> parameterData = valuesCentral[channel][j->second->id].getBinaryData();
-					packet->setPosition((*i)->index, (*i)->size, parameterData);
-					paramFound = true;
-					break;
-				}
+				_parameterGroupCache.clear();
+				_parameterGroupSelectorBlocks.clear();
 			}
-			if(!paramFound) GD::out.printError("Error constructing packet. param \"" + (*i)->parameterId + "\" not found. Peer: " + std::to_string(_peerID) + " Serial number: " + _serialNumber + " Frame: " + frame->id);
 		}
-		setMessageCounter(_messageCounter + 1);
-
-		std::shared_ptr<HMWiredPacket> response = getResponse(packet);
-		if(!response) return PVariable(new Variable(VariableType::tVoid));
-
-		auto& rpcConfigurationParameter = valuesCentral[channel][parameter->id];
-		std::vector<uint8_t> parameterData = rpcConfigurationParameter.getBinaryData();
-		return parameter->convertFromPacket(parameterData, rpcConfigurationParameter.mainRole(), true);
+		//The value slots might have been built from a parameter group which wasn't cached
+		std::shared_ptr<FrameDecoder> frameDecoder = std::atomic_load(&_frameDecoder);
+		if(frameDecoder && frameDecoder->hasSelectors()) invalidateValueSlots();
+		clearSetValueFrames();
 	}
 	catch(const std::exception& ex)
 	{
@@ -1946,7 +2908,6 @@ PVariable HMWiredPeer::getValueFromDevice(PParameter& parameter, int32_t channel
 	{
 		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 	}
-	return Variable::createError(-32500, "Unknown application error.");
 }
 
 PParameterGroup HMWiredPeer::getParameterSet(int32_t channel, ParameterGroup::Type::Enum type)
@@ -1957,6 +2918,20 @@ PParameterGroup HMWiredPeer::getParameterSet(int32_t channel, ParameterGroup::Ty
 		PParameterGroup parameterGroup;
 		if(rpcFunction->parameterGroupSelector && !rpcFunction->alternativeFunctions.empty())
 		{
+			uint32_t generation = 0;
+			{
+				std::lock_guard<std::mutex> parameterGroupCacheGuard(_parameterGroupCacheMutex);
+				std::unordered_map<int32_t, std::unordered_map<int32_t, PParameterGroup>>::iterator channelIterator = _parameterGroupCache.find(channel);
+				if(channelIterator != _parameterGroupCache.end())
+				{
+					std::unordered_map<int32_t, PParameterGroup>::iterator typeIterator = channelIterator->second.find((int32_t)type);
+					if(typeIterator != channelIterator->second.end()) return typeIterator->second;
+				}
+				generation = _parameterGroupCacheGeneration;
+			}
+
+			std::set<int32_t> selectorBlocks;
+			getConfigBlocks(getMasterConfigIndex(channel - rpcFunction->channel, rpcFunction->parameterGroupSelector->physical->memoryIndex, rpcFunction->parameterGroupSelector->physical->memoryChannelStep), rpcFunction->parameterGroupSelector->physical->size, selectorBlocks);
 			std::vector<uint8_t> value = getMasterConfigParameter(channel - rpcFunction->channel, rpcFunction->parameterGroupSelector->physical->memoryIndex, rpcFunction->parameterGroupSelector->physical->memoryChannelStep, rpcFunction->parameterGroupSelector->physical->size);
 			BaseLib::Systems::RpcConfigurationParameter& parameter = configCentral[channel][rpcFunction->parameterGroupSelector->id];
 			if(!parameter.rpcParameter) parameterGroup = rpcFunction->getParameterGroup(type);
@@ -1975,6 +2950,27 @@ PParameterGroup HMWiredPeer::getParameterSet(int32_t channel, ParameterGroup::Ty
 					}
 				} else parameterGroup = rpcFunction->getParameterGroup(type);
 			}
+
+			//Only cache the result when the selector was read from valid EEPROM data
+			bool selectorKnown = !selectorBlocks.empty();
+			for(std::set<int32_t>::iterator i = selectorBlocks.begin(); i != selectorBlocks.end(); ++i)
+			{
+				std::unordered_map<uint32_t, BaseLib::Systems::ConfigDataBlock>::iterator blockIterator = binaryConfig.find(*i);
+				if(blockIterator == binaryConfig.end() || blockIterator->second.getBinaryData().size() != 0x10)
+				{
+					selectorKnown = false;
+					break;
+				}
+			}
+			if(parameterGroup && selectorKnown)
+			{
+				std::lock_guard<std::mutex> parameterGroupCacheGuard(_parameterGroupCacheMutex);
+				if(generation == _parameterGroupCacheGeneration)
+				{
+					_parameterGroupCache[channel][(int32_t)type] = parameterGroup;
+					_parameterGroupSelectorBlocks.insert(selectorBlocks.begin(), selectorBlocks.end());
+				}
+			}
 		}
 		else
 		{
@@ -1998,7 +2994,99 @@ PParameterGroup HMWiredPeer::getParameterSet(int32_t channel, ParameterGroup::Ty
 	return PParameterGroup();
 }
 
-void HMWiredPeer::packetReceived(std::shared_ptr<HMWiredPacket> packet)
+bool HMWiredPeer::isDuplicate(std::shared_ptr<HMWiredPacket> packet)
+{
+	try
+	{
+		int32_t window = GD::family->duplicateWindow();
+		if(window <= 0) return false;
+		//FNV-1a over the control byte, the destination address and the payload. The control byte contains the message counters and the synchronization bit.
+		uint32_t hash = 2166136261;
+		hash = (hash ^ packet->controlByte()) * 16777619;
+		int32_t destinationAddress = packet->destinationAddress();
+		for(int32_t i = 24; i >= 0; i -= 8) hash = (hash ^ (uint8_t)(destinationAddress >> i)) * 16777619;
+		std::vector<uint8_t>& payload = packet->payload();
+		for(std::vector<uint8_t>::iterator i = payload.begin(); i != payload.end(); ++i) hash = (hash ^ *i) * 16777619;
+		int64_t time = packet->getTimeReceived();
+		if(time == 0) time = BaseLib::HelperFunctions::getTime();
+
+		std::lock_guard<std::mutex> lastPacketGuard(_lastPacketMutex);
+		if(_lastPacketTime > 0 && packet->senderMessageCounter() == _lastPacketCounter && hash == _lastPacketHash && time - _lastPacketTime >= 0 && time - _lastPacketTime < window)
+		{
+			//Measure the window from the last retransmission, so a device repeating a packet several times is still detected
+			_lastPacketTime = time;
+			return true;
+		}
+		_lastPacketCounter = packet->senderMessageCounter();
+		_lastPacketHash = hash;
+		_lastPacketTime = time;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+void HMWiredPeer::forgetLastPacket()
+{
+	std::lock_guard<std::mutex> lastPacketGuard(_lastPacketMutex);
+	_lastPacketTime = 0;
+}
+
+void HMWiredPeer::raiseCoalescedEvent(uint32_t channel, std::shared_ptr<std::vector<std::string>> valueKeys, std::shared_ptr<std::vector<PVariable>> values)
+{
+	try
+	{
+		if(!valueKeys || !values || valueKeys->empty()) return;
+		std::string eventSource = "device-" + std::to_string(_peerID);
+		std::string address(_serialNumber + ":" + std::to_string(channel));
+		raiseEvent(eventSource, _peerID, channel, valueKeys, values);
+		raiseRPCEvent(eventSource, _peerID, channel, address, valueKeys, values);
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+EventCoalescer::Mode HMWiredPeer::getEventCoalescing(uint32_t channel, int32_t& window)
+{
+	try
+	{
+		window = 0;
+		std::unordered_map<uint32_t, std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>>::iterator channelIterator = configCentral.find(channel);
+		if(channelIterator == configCentral.end()) return EventCoalescer::Mode::none;
+		std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>::iterator modeIterator = channelIterator->second.find("EVENT_COALESCE_MODE");
+		if(modeIterator == channelIterator->second.end()) return EventCoalescer::Mode::none;
+		std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>::iterator windowIterator = channelIterator->second.find("EVENT_COALESCE_WINDOW");
+		if(windowIterator == channelIterator->second.end()) return EventCoalescer::Mode::none;
+		int32_t mode = 0;
+		_bl->hf.memcpyBigEndian(mode, modeIterator->second.getBinaryData()); //Shortcut to save resources. The normal way would be to call "convertFromPacket".
+		_bl->hf.memcpyBigEndian(window, windowIterator->second.getBinaryData());
+		if(window <= 0 || mode < (int32_t)EventCoalescer::Mode::minInterval || mode > (int32_t)EventCoalescer::Mode::lastValue) return EventCoalescer::Mode::none;
+		return (EventCoalescer::Mode)mode;
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return EventCoalescer::Mode::none;
+}
+
+void HMWiredPeer::packetReceived(std::shared_ptr<HMWiredPacket> packet, bool acknowledged)
 {
 	try
 	{
@@ -2014,75 +3102,116 @@ void HMWiredPeer::packetReceived(std::shared_ptr<HMWiredPacket> packet)
 		getValuesFromPacket(packet, frameValues);
 		std::map<uint32_t, std::shared_ptr<std::vector<std::string>>> valueKeys;
 		std::map<uint32_t, std::shared_ptr<std::vector<PVariable>>> rpcValues;
+		std::set<uint32_t> actionChannels;
+		std::shared_ptr<ValueSlots> valueSlots = frameValues.empty() ? std::shared_ptr<ValueSlots>() : getValueSlots();
+		int64_t timeReceived = GD::family->valueMaxAge() > 0 ? (packet->getTimeReceived() > 0 ? packet->getTimeReceived() : BaseLib::HelperFunctions::getTime()) : 0;
 		//Loop through all matching frames
 		for(std::vector<FrameValues>::iterator a = frameValues.begin(); a != frameValues.end(); ++a)
 		{
-			PPacket frame;
-			if(!a->frameID.empty()) frame = _rpcDevice->packetsById.at(a->frameID);
-
-			for(std::map<std::string, FrameValue>::iterator i = a->values.begin(); i != a->values.end(); ++i)
+			for(std::vector<FrameValue>::iterator i = a->values.begin(); i != a->values.end(); ++i)
 			{
-				for(std::list<uint32_t>::const_iterator j = a->paramsetChannels.begin(); j != a->paramsetChannels.end(); ++j)
+				const std::string& parameterId = i->parameter->id;
+				for(std::vector<uint32_t>::const_iterator j = a->paramsetChannels.begin(); j != a->paramsetChannels.end(); ++j)
 				{
-					if(std::find(i->second.channels.begin(), i->second.channels.end(), *j) == i->second.channels.end()) continue;
-					if(!valueKeys[*j] || !rpcValues[*j])
+					if(std::find(i->channels.begin(), i->channels.end(), *j) == i->channels.end()) continue;
+					ValueSlot* slot = nullptr;
+					if(valueSlots && i->slot > -1 && *j < valueSlots->size() && i->slot < (signed)valueSlots->at(*j).size()) slot = &valueSlots->at(*j).at(i->slot);
+					PParameter currentParameter;
+					BaseLib::Systems::RpcConfigurationParameter* parameter = nullptr;
+					if(slot && slot->value && slot->parameter)
 					{
-						valueKeys[*j].reset(new std::vector<std::string>());
-						rpcValues[*j].reset(new std::vector<PVariable>());
+						parameter = slot->value;
+						currentParameter = slot->parameter;
 					}
-					BaseLib::Systems::RpcConfigurationParameter& parameter = valuesCentral[*j][i->first];
-					if(_rpcDevice->functions.find(*j) == _rpcDevice->functions.end())
+					else
 					{
-						GD::out.printWarning("Warning: Can't set value of parameter " + i->first + " for channel " + std::to_string(*j) + ". Channel not found.");
-						continue;
+						parameter = &valuesCentral[*j][parameterId];
+						if(slot && slot->parameter) invalidateValueSlots(); //The slots were built before the value existed
+						if(_rpcDevice->functions.find(*j) == _rpcDevice->functions.end())
+						{
+							GD::out.printWarning("Warning: Can't set value of parameter " + parameterId + " for channel " + std::to_string(*j) + ". Channel not found.");
+							continue;
+						}
+						PParameterGroup parameterSet = getParameterSet(*j, a->parameterSetType);
+						if(!parameterSet)
+						{
+							GD::out.printWarning("Warning: Can't set value of parameter " + parameterId + " for channel " + std::to_string(*j) + ". Value parameter set not found.");
+							continue;
+						}
+						currentParameter = parameterSet->getParameter(parameterId);
+						if(!currentParameter)
+						{
+							GD::out.printWarning("Warning: Can't set value of parameter " + parameterId + " for channel " + std::to_string(*j) + ". Value parameter set not found.");
+							continue;
+						}
 					}
-					PParameterGroup parameterSet = getParameterSet(*j, a->parameterSetType);
-					if(!parameterSet)
+					if(timeReceived > 0)
 					{
-						GD::out.printWarning("Warning: Can't set value of parameter " + i->first + " for channel " + std::to_string(*j) + ". Value parameter set not found.");
-						continue;
+						std::lock_guard<std::mutex> valueTimesGuard(_valueTimesMutex);
+						_valueTimes[*j][parameterId] = timeReceived;
 					}
-					PParameter currentParameter = parameterSet->getParameter(i->first);
-					if(!currentParameter)
+					bool unchanged = GD::family->changeFilterEnabled() && parameter->getBinaryData() == i->value;
+					if(!unchanged)
 					{
-						GD::out.printWarning("Warning: Can't set value of parameter " + i->first + " for channel " + std::to_string(*j) + ". Value parameter set not found.");
-						continue;
+						parameter->setBinaryData(i->value);
+						saveParameterDeferred(parameter->databaseId, a->parameterSetType, *j, parameterId, i->value);
+						if(_bl->debugLevel >= 4) GD::out.printInfo("Info: " + parameterId + " of HomeMatic Wired peer " + std::to_string(_peerID) + " with serial number " + _serialNumber + ":" + std::to_string(*j) + " was set to 0x" + BaseLib::HelperFunctions::getHexString(i->value) + ".");
 					}
-					parameter.setBinaryData(i->second.value);
-					saveParameter(parameter.databaseId, a->parameterSetType, *j, i->first, i->second.value);
-					if(_bl->debugLevel >= 4) GD::out.printInfo("Info: " + i->first + " of HomeMatic Wired peer " + std::to_string(_peerID) + " with serial number " + _serialNumber + ":" + std::to_string(*j) + " was set to 0x" + BaseLib::HelperFunctions::getHexString(i->second.value) + ".");
 
 					 //Process service messages
-					if(currentParameter->service && !i->second.value.empty())
+					if(currentParameter->service && !i->value.empty())
 					{
 						if(currentParameter->logical->type == ILogical::Type::Enum::tEnum)
 						{
-							serviceMessages->set(i->first, i->second.value.at(0), *j);
+							serviceMessages->set(parameterId, i->value.at(0), *j);
 						}
 						else if(currentParameter->logical->type == ILogical::Type::Enum::tBoolean)
 						{
-							serviceMessages->set(i->first, (bool)i->second.value.at(0));
+							serviceMessages->set(parameterId, (bool)i->value.at(0));
 						}
 					}
 
-					valueKeys[*j]->push_back(i->first);
-					rpcValues[*j]->push_back(currentParameter->convertFromPacket(i->second.value, parameter.mainRole(), true));
+					//Periodic status frames mostly repeat the stored values. Only actions and explicitly listed parameters are raised again.
+					if(unchanged && currentParameter->logical->type != ILogical::Type::Enum::tAction && !GD::family->alwaysEmit(parameterId))
+					{
+						if(_bl->debugLevel >= 5) GD::out.printDebug("Debug: " + parameterId + " of HomeMatic Wired peer " + std::to_string(_peerID) + " with serial number " + _serialNumber + ":" + std::to_string(*j) + " didn't change.");
+						continue;
+					}
+
+					//Only channels with values to raise get vectors
+					std::shared_ptr<std::vector<std::string>>& channelValueKeys = valueKeys[*j];
+					std::shared_ptr<std::vector<PVariable>>& channelValues = rpcValues[*j];
+					if(!channelValueKeys || !channelValues)
+					{
+						channelValueKeys = std::make_shared<std::vector<std::string>>();
+						channelValues = std::make_shared<std::vector<PVariable>>();
+					}
+					channelValueKeys->push_back(parameterId);
+					channelValues->push_back(currentParameter->convertFromPacket(i->value, parameter->mainRole(), true));
+					if(currentParameter->logical->type == ILogical::Type::Enum::tAction) actionChannels.insert(*j);
 				}
 			}
 		}
-		if(packet->type() == HMWiredPacketType::iMessage && packet->destinationAddress() == central->getAddress())
+		if(!acknowledged && packet->type() == HMWiredPacketType::iMessage && packet->destinationAddress() == central->getAddress())
 		{
-			if(packet->getTimeReceived() != 0 && BaseLib::HelperFunctions::getTime() - packet->getTimeReceived() < 150) central->sendOK(packet->senderMessageCounter(), packet->senderAddress());
+			if(packet->getTimeReceived() != 0 && BaseLib::HelperFunctions::getTime() - packet->getTimeReceived() < 150) central->sendOK(packet->senderMessageCounter(), packet->senderAddress(), packet->getTimeReceived());
 		}
 		if(!rpcValues.empty())
 		{
+			EventCoalescer* eventCoalescer = central->getEventCoalescer();
 			for(std::map<uint32_t, std::shared_ptr<std::vector<std::string>>>::iterator j = valueKeys.begin(); j != valueKeys.end(); ++j)
 			{
-				if(j->second->empty()) continue;
-                std::string eventSource = "device-" + std::to_string(_peerID);
-                std::string address(_serialNumber + ":" + std::to_string(j->first));
-                raiseEvent(eventSource, _peerID, j->first, j->second, rpcValues.at(j->first));
-                raiseRPCEvent(eventSource, _peerID, j->first, address, j->second, rpcValues.at(j->first));
+				if(!j->second || j->second->empty()) continue;
+				std::shared_ptr<std::vector<PVariable>>& values = rpcValues.at(j->first);
+				int32_t window = 0;
+				EventCoalescer::Mode mode = eventCoalescer ? getEventCoalescing(j->first, window) : EventCoalescer::Mode::none;
+				if(mode != EventCoalescer::Mode::none)
+				{
+					//Actions can't be merged, so they are raised right away together with the held back values
+					if(actionChannels.find(j->first) != actionChannels.end()) eventCoalescer->takePending(_peerID, j->first, j->second, values);
+					else if(!eventCoalescer->add(std::static_pointer_cast<HMWiredPeer>(shared_from_this()), j->first, mode, window, j->second, values)) continue;
+				}
+				raiseCoalescedEvent(j->first, j->second, values);
 			}
 		}
 	}
@@ -2103,7 +3232,7 @@ PVariable HMWiredPeer::getDeviceInfo(BaseLib::PRpcClientInfo clientInfo, std::ma
 		PVariable info(Peer::getDeviceInfo(clientInfo, fields));
 		if(info->errorStruct) return info;
 
-		if(fields.empty() || fields.find("INTERFACE") != fields.end()) info->structValue->insert(StructElement("INTERFACE", PVariable(new Variable(GD::physicalInterface->getID()))));
+		if(fields.empty() || fields.find("INTERFACE") != fields.end()) info->structValue->insert(StructElement("INTERFACE", PVariable(new Variable(getPhysicalInterfaceId()))));
 
 		return info;
 	}
@@ -2135,6 +3264,15 @@ PVariable HMWiredPeer::getParamset(BaseLib::PRpcClientInfo clientInfo, int32_t c
         auto central = getCentral();
         if(!central) return Variable::createError(-32500, "Could not get central.");
 
+		std::shared_ptr<BaseLib::Systems::BasicPeer> remotePeer;
+		if(type == ParameterGroup::Type::Enum::config) prefetchConfigBlocks(getConfigBlocks(channel, parameterGroup, remotePeer));
+		else if(type == ParameterGroup::Type::Enum::link)
+		{
+			if(remoteID > 0) remotePeer = getPeer(channel, remoteID, remoteChannel);
+			//Read all blocks of the link's parameter set at once instead of block by block
+			if(remotePeer && parameterGroup->memoryAddressStart != -1 && parameterGroup->memoryAddressStep != -1) prefetchConfigBlocks(getConfigBlocks(channel, parameterGroup, remotePeer));
+		}
+
 		PVariable variables(new Variable(VariableType::tStruct));
 		for(Parameters::iterator i = parameterGroup->parameters.begin(); i != parameterGroup->parameters.end(); ++i)
 		{
@@ -2163,8 +3301,6 @@ PVariable HMWiredPeer::getParamset(BaseLib::PRpcClientInfo clientInfo, int32_t c
 			}
 			else if(type == ParameterGroup::Type::Enum::link)
 			{
-				std::shared_ptr<BaseLib::Systems::BasicPeer> remotePeer;
-				if(remoteID > 0) remotePeer = getPeer(channel, remoteID, remoteChannel);
 				if(!remotePeer) return Variable::createError(-3, "Not paired to this peer.");
 				if(remotePeer->configEEPROMAddress == -1) return Variable::createError(-3, "No parameter set eeprom address set.");
 				if(parameterGroup->memoryAddressStart == -1 || parameterGroup->memoryAddressStep == -1) return Variable::createError(-3, "Storage type of link parameter set not supported.");
@@ -2239,13 +3375,10 @@ PVariable HMWiredPeer::putParamset(BaseLib::PRpcClientInfo clientInfo, int32_t c
         auto central = std::dynamic_pointer_cast<HMWiredCentral>(getCentral());
         if(!central) return Variable::createError(-32500, "Could not get central.");
 
-        {
-            std::lock_guard<std::mutex> pingThreadGuard(_pingThreadMutex);
-            _lastPing = BaseLib::HelperFunctions::getTime(); //No ping now
-            if(_pingThread.joinable()) _pingThread.join();
-        }
+        central->postponeMaintenance(_peerID); //No ping now
 
-		std::map<int32_t, bool> changedBlocks;
+		//All EEPROM edits are collected first, so every block is read, persisted and written only once
+		EEPROMWritePlan plan;
 		if(type == ParameterGroup::Type::Enum::config)
 		{
 			for(Struct::iterator i = variables->structValue->begin(); i != variables->structValue->end(); ++i)
@@ -2255,22 +3388,22 @@ PVariable HMWiredPeer::putParamset(BaseLib::PRpcClientInfo clientInfo, int32_t c
 				if(!currentParameter) continue;
 				std::vector<uint8_t> value;
 				currentParameter->convertToPacket(i->second, Role(), value);
-				std::vector<int32_t> result;
-				if(currentParameter->physical->operationType == IPhysical::OperationType::Enum::memory) result = setMasterConfigParameter(channel, parameterGroup, currentParameter, value);
+				if(currentParameter->physical->operationType == IPhysical::OperationType::Enum::memory)
+				{
+					if(!addToWritePlan(plan, channel, parameterGroup, currentParameter, value)) continue;
+				}
 				else if(currentParameter->physical->operationType == IPhysical::OperationType::Enum::store)
 				{
 					if(configCentral.find(channel) == configCentral.end() || configCentral[channel].find(i->first) == configCentral[channel].end()) continue;
 					BaseLib::Systems::RpcConfigurationParameter& parameter = configCentral[channel][i->first];
 					parameter.setBinaryData(value);
-					if(parameter.databaseId > 0) saveParameter(parameter.databaseId, value);
-					else saveParameter(0, ParameterGroup::Type::Enum::config, channel, i->first, value);
+					saveParameterDeferred(parameter.databaseId, ParameterGroup::Type::Enum::config, channel, i->first, value);
 
 				}
 				GD::out.printInfo("Info: Parameter " + i->first + " of peer " + std::to_string(_peerID) + " was set to 0x" + BaseLib::HelperFunctions::getHexString(value) + ".");
-				//Only send to device when parameter is of type eeprom
-				if(currentParameter->physical->operationType != IPhysical::OperationType::Enum::memory) continue;
-				for(std::vector<int32_t>::iterator i = result.begin(); i != result.end(); ++i) changedBlocks[*i] = true;
 			}
+			//Configuration set by RPC needs to be durable when the call returns
+			flushDeferredSaves();
 		}
 		else if(type == ParameterGroup::Type::Enum::variables)
 		{
@@ -2297,27 +3430,18 @@ PVariable HMWiredPeer::putParamset(BaseLib::PRpcClientInfo clientInfo, int32_t c
 				PParameter currentParameter = parameterGroup->getParameter(i->first);
 				if(!currentParameter) continue;
 				if(currentParameter->physical->memoryIndexOperation == IPhysical::MemoryIndexOperation::Enum::none) continue;
+				//Only send to device when parameter is of type eeprom
+				if(currentParameter->physical->operationType != IPhysical::OperationType::Enum::memory) continue;
 				std::vector<uint8_t> value;
 				currentParameter->convertToPacket(i->second, Role(), value);
-				std::vector<int32_t> result = setConfigParameter(remotePeer->configEEPROMAddress + currentParameter->physical->memoryIndex, currentParameter->physical->size, value);
+				if(!plan.addParameter(i->first, remotePeer->configEEPROMAddress + currentParameter->physical->memoryIndex, currentParameter->physical->size, value)) continue;
 				GD::out.printInfo("Info: Parameter " + i->first + " of peer " + std::to_string(_peerID) + " was set to 0x" + BaseLib::HelperFunctions::getHexString(value) + ".");
-				//Only send to device when parameter is of type eeprom
-				if(currentParameter->physical->operationType != IPhysical::OperationType::Enum::memory) continue;
-				for(std::vector<int32_t>::iterator i = result.begin(); i != result.end(); ++i) changedBlocks[*i] = true;
 			}
 		}
 
-		if(changedBlocks.empty()) return PVariable(new Variable(VariableType::tVoid));
+		if(plan.empty()) return PVariable(new Variable(VariableType::tVoid));
 
-		for(std::map<int32_t, bool>::iterator i = changedBlocks.begin(); i != changedBlocks.end(); ++i)
-		{
-			std::vector<uint8_t> parameterData = binaryConfig[i->first].getBinaryData();
-			if(!central->writeEEPROM(_address, i->first, parameterData))
-			{
-				GD::out.printError("Error: Could not write config to device's eeprom.");
-				return Variable::createError(-32500, "Could not write config to device's eeprom.");
-			}
-		}
+		if(!executeWritePlan(plan)) return Variable::createError(-32500, "Could not write config to device's eeprom.");
 		raiseRPCUpdateDevice(_peerID, channel, _serialNumber + ":" + std::to_string(channel), 0);
 
 		return PVariable(new Variable(VariableType::tVoid));
@@ -2337,19 +3461,41 @@ PVariable HMWiredPeer::setValue(BaseLib::PRpcClientInfo clientInfo, uint32_t cha
 {
 	try
 	{
+		std::chrono::steady_clock::time_point requestStartTime = std::chrono::steady_clock::now();
 		Peer::setValue(clientInfo, channel, valueKey, value, wait);
 		if(_disposing) return Variable::createError(-32500, "Peer is disposing.");
 		if(valueKey.empty()) return Variable::createError(-5, "Value key is empty.");
 		if(channel == 0 && serviceMessages->set(valueKey, value->booleanValue)) return PVariable(new Variable(VariableType::tVoid));
-		if(valuesCentral.find(channel) == valuesCentral.end()) return Variable::createError(-2, "Unknown channel.");
-		if(valuesCentral[channel].find(valueKey) == valuesCentral[channel].end()) return Variable::createError(-5, "Unknown parameter.");
 
-		PParameterGroup parameterGroup = getParameterSet(channel, ParameterGroup::Type::Enum::variables);
-		if(!parameterGroup) return Variable::createError(-3, "Unknown parameter set.");
-		PParameter rpcParameter = parameterGroup->getParameter(valueKey);
-		if(!rpcParameter) return Variable::createError(-5, "Unknown parameter.");
+		PParameterGroup parameterGroup;
+		PParameter rpcParameter;
+		BaseLib::Systems::RpcConfigurationParameter* valueParameter = nullptr;
+		std::shared_ptr<ValueSlots> valueSlots = getValueSlots();
+		std::shared_ptr<FrameDecoder> frameDecoder = std::atomic_load(&_frameDecoder);
+		int32_t slotIndex = frameDecoder ? frameDecoder->getSlot(valueKey) : -1;
+		if(valueSlots && slotIndex > -1 && channel < valueSlots->size() && slotIndex < (signed)valueSlots->at(channel).size())
+		{
+			ValueSlot& slot = valueSlots->at(channel).at(slotIndex);
+			valueParameter = slot.value;
+			rpcParameter = slot.parameter;
+		}
+		if(valueParameter && rpcParameter)
+		{
+			parameterGroup = getParameterSet(channel, ParameterGroup::Type::Enum::variables);
+			if(!parameterGroup) return Variable::createError(-3, "Unknown parameter set.");
+		}
+		else
+		{
+			if(valuesCentral.find(channel) == valuesCentral.end()) return Variable::createError(-2, "Unknown channel.");
+			if(valuesCentral[channel].find(valueKey) == valuesCentral[channel].end()) return Variable::createError(-5, "Unknown parameter.");
+			parameterGroup = getParameterSet(channel, ParameterGroup::Type::Enum::variables);
+			if(!parameterGroup) return Variable::createError(-3, "Unknown parameter set.");
+			rpcParameter = parameterGroup->getParameter(valueKey);
+			if(!rpcParameter) return Variable::createError(-5, "Unknown parameter.");
+			valueParameter = &valuesCentral[channel][valueKey];
+		}
 		if(rpcParameter->logical->type == ILogical::Type::tAction && !value->booleanValue) return Variable::createError(-5, "Parameter of type action cannot be set to \"false\".");
-		BaseLib::Systems::RpcConfigurationParameter& parameter = valuesCentral[channel][valueKey];
+		BaseLib::Systems::RpcConfigurationParameter& parameter = *valueParameter;
 		std::shared_ptr<std::vector<std::string>> valueKeys(new std::vector<std::string>());
 		std::shared_ptr<std::vector<PVariable>> values(new std::vector<PVariable>());
 		if(rpcParameter->readable)
@@ -2362,7 +3508,7 @@ PVariable HMWiredPeer::setValue(BaseLib::PRpcClientInfo clientInfo, uint32_t cha
 			std::vector<uint8_t> parameterData;
 			rpcParameter->convertToPacket(value, parameter.mainRole(), parameterData);
 			parameter.setBinaryData(parameterData);
-			saveParameter(parameter.databaseId, ParameterGroup::Type::Enum::variables, channel, valueKey, parameterData);
+			saveParameterDeferred(parameter.databaseId, ParameterGroup::Type::Enum::variables, channel, valueKey, parameterData);
 			if(!valueKeys->empty())
 			{
                 std::string address(_serialNumber + ":" + std::to_string(channel));
@@ -2408,67 +3554,91 @@ PVariable HMWiredPeer::setValue(BaseLib::PRpcClientInfo clientInfo, uint32_t cha
 		std::vector<uint8_t> data;
 		rpcParameter->convertToPacket(value, parameter.mainRole(), data);
 		parameter.setBinaryData(data);
-		saveParameter(parameter.databaseId, ParameterGroup::Type::Enum::variables, channel, valueKey, data);
+		saveParameterDeferred(parameter.databaseId, ParameterGroup::Type::Enum::variables, channel, valueKey, data);
 		if(_bl->debugLevel > 4) GD::out.printDebug("Debug: " + valueKey + " of peer " + std::to_string(_peerID) + " with serial number " + _serialNumber + ":" + std::to_string(channel) + " was set to " + BaseLib::HelperFunctions::getHexString(data) + ".");
 
-		std::vector<uint8_t> payload({ (uint8_t)frame->type });
-		if(frame->subtype > -1 && frame->subtypeIndex >= 9)
-		{
-			while((signed)payload.size() - 1 < frame->subtypeIndex - 9) payload.push_back(0);
-			payload.at(frame->subtypeIndex - 9) = (uint8_t)frame->subtype;
-		}
-		if(frame->channelIndex >= 9)
+		std::chrono::steady_clock::time_point buildStartTime = std::chrono::steady_clock::now();
+		std::shared_ptr<HMWiredPacket> packet;
+		std::shared_ptr<SetValueFrame> setValueFrame = getSetValueFrame(channel, valueKey, data);
+		if(setValueFrame)
 		{
-			while((signed)payload.size() - 1 < frame->channelIndex - 9) payload.push_back(0);
-			payload.at(frame->channelIndex - 9) = (uint8_t)channel + _rpcDevice->functions.at(channel)->physicalChannelIndexOffset;
+			packet.reset(new HMWiredPacket(HMWiredPacketType::iMessage, getCentral()->getAddress(), _address, false, _messageCounter, 0, 0, setValueFrame->payload));
+			setValueStats.framesReused++;
+			setValueStats.reuseTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - buildStartTime).count();
 		}
-		std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::iMessage, getCentral()->getAddress(), _address, false, _messageCounter, 0, 0, payload));
-		for(BinaryPayloads::iterator i = frame->binaryPayloads.begin(); i != frame->binaryPayloads.end(); ++i)
+		else
 		{
-			if((*i)->constValueInteger > -1)
+			setValueFrame = std::make_shared<SetValueFrame>();
+			bool cacheable = true;
+			std::vector<uint8_t> payload({ (uint8_t)frame->type });
+			if(frame->subtype > -1 && frame->subtypeIndex >= 9)
 			{
-				std::vector<uint8_t> data;
-				_bl->hf.memcpyBigEndian(data, (*i)->constValueInteger);
-				packet->setPosition((*i)->index, (*i)->size, data);
-				continue;
-			}
-			BaseLib::Systems::RpcConfigurationParameter* additionalParameter = nullptr;
-			//We can't just search for param, because it is ambiguous (see for example LEVEL for HM-CC-TC.
-			if((*i)->parameterId == "ON_TIME" && valuesCentral[channel].find((*i)->parameterId) != valuesCentral[channel].end())
-			{
-				additionalParameter = &valuesCentral[channel][(*i)->parameterId];
-				int32_t intValue = 0;
-				std::vector<uint8_t> parameterData = additionalParameter->getBinaryData();
-				_bl->hf.memcpyBigEndian(intValue, parameterData);
-				if(!(*i)->omitIfSet || intValue != (*i)->omitIf)
-				{
-					//Don't set ON_TIME when value is false
-					if((rpcParameter->physical->groupId == "STATE" && value->booleanValue) || (rpcParameter->physical->groupId == "LEVEL" && value->floatValue > 0)) packet->setPosition((*i)->index, (*i)->size, parameterData);
-				}
+				while((signed)payload.size() - 1 < frame->subtypeIndex - 9) payload.push_back(0);
+				payload.at(frame->subtypeIndex - 9) = (uint8_t)frame->subtype;
 			}
-			//param sometimes is ambiguous (e. g. LEVEL of HM-CC-TC), so don't search and use the given parameter when possible
-			else if((*i)->parameterId == rpcParameter->physical->groupId)
+			if(frame->channelIndex >= 9)
 			{
-				std::vector<uint8_t> parameterData = valuesCentral[channel][valueKey].getBinaryData();
-				packet->setPosition((*i)->index, (*i)->size, parameterData);
+				while((signed)payload.size() - 1 < frame->channelIndex - 9) payload.push_back(0);
+				payload.at(frame->channelIndex - 9) = (uint8_t)channel + _rpcDevice->functions.at(channel)->physicalChannelIndexOffset;
 			}
-			//Search for all other parameters
-			else
+			packet.reset(new HMWiredPacket(HMWiredPacketType::iMessage, getCentral()->getAddress(), _address, false, _messageCounter, 0, 0, payload));
+			for(BinaryPayloads::iterator i = frame->binaryPayloads.begin(); i != frame->binaryPayloads.end(); ++i)
 			{
-				bool paramFound = false;
-				for(Parameters::iterator j = parameterGroup->parameters.begin(); j != parameterGroup->parameters.end(); ++j)
+				if((*i)->constValueInteger > -1)
+				{
+					std::vector<uint8_t> data;
+					_bl->hf.memcpyBigEndian(data, (*i)->constValueInteger);
+					packet->setPosition((*i)->index, (*i)->size, data);
+					continue;
+				}
+				BaseLib::Systems::RpcConfigurationParameter* additionalParameter = nullptr;
+				//We can't just search for param, because it is ambiguous (see for example LEVEL for HM-CC-TC.
+				if((*i)->parameterId == "ON_TIME" && valuesCentral[channel].find((*i)->parameterId) != valuesCentral[channel].end())
 				{
-					//Only compare id. Till now looking for value_id was not necessary.
-					if((*i)->parameterId == j->second->physical->groupId)
+					additionalParameter = &valuesCentral[channel][(*i)->parameterId];
+					int32_t intValue = 0;
+					std::vector<uint8_t> parameterData = additionalParameter->getBinaryData();
+					setValueFrame->dependencies.push_back(std::make_pair((*i)->parameterId, parameterData));
+					_bl->hf.memcpyBigEndian(intValue, parameterData);
+					if(!(*i)->omitIfSet || intValue != (*i)->omitIf)
 					{
-						std::vector<uint8_t> parameterData = valuesCentral[channel][j->second->id].getBinaryData();
-						packet->setPosition((*i)->index, (*i)->size, parameterData);
-						paramFound = true;
-						break;
+						//Don't set ON_TIME when value is false
+						if((rpcParameter->physical->groupId == "STATE" && value->booleanValue) || (rpcParameter->physical->groupId == "LEVEL" && value->floatValue > 0)) packet->setPosition((*i)->index, (*i)->size, parameterData);
+					}
+				}
+				//param sometimes is ambiguous (e. g. LEVEL of HM-CC-TC), so don't search and use the given parameter when possible
+				else if((*i)->parameterId == rpcParameter->physical->groupId)
+				{
+					std::vector<uint8_t> parameterData = parameter.getBinaryData();
+					packet->setPosition((*i)->index, (*i)->size, parameterData);
+				}
+				//Search for all other parameters
+				else
+				{
+					bool paramFound = false;
+					for(Parameters::iterator j = parameterGroup->parameters.begin(); j != parameterGroup->parameters.end(); ++j)
+					{
+						//Only compare id. Till now looking for value_id was not necessary.
+						if((*i)->parameterId == j->second->physical->groupId)
+						{
+							std::vector<uint8_t> parameterData = valuesCentral[channel][j->second->id].getBinaryData();
+							setValueFrame->dependencies.push_back(std::make_pair(j->second->id, parameterData));
+							packet->setPosition((*i)->index, (*i)->size, parameterData);
+							paramFound = true;
+							break;
+						}
+					}
+					if(!paramFound)
+					{
+						cacheable = false;
+						GD::out.printError("Error constructing packet. param \"" + (*i)->parameterId + "\" not found. Peer: " + std::to_string(_peerID) + " Serial number: " + _serialNumber + " Frame: " + frame->id);
 					}
 				}
-				if(!paramFound) GD::out.printError("Error constructing packet. param \"" + (*i)->parameterId + "\" not found. Peer: " + std::to_string(_peerID) + " Serial number: " + _serialNumber + " Frame: " + frame->id);
 			}
+			setValueFrame->payload = packet->payload();
+			if(cacheable) addSetValueFrame(channel, valueKey, data, setValueFrame);
+			setValueStats.framesBuilt++;
+			setValueStats.buildTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - buildStartTime).count();
 		}
 		if(!rpcParameter->setPackets.front()->autoReset.empty())
 		{
@@ -2484,7 +3654,7 @@ PVariable HMWiredPeer::setValue(BaseLib::PRpcClientInfo clientInfo, uint32_t cha
 				if(!tempParam.equals(defaultValue))
 				{
 					tempParam.setBinaryData(defaultValue);
-					saveParameter(tempParam.databaseId, ParameterGroup::Type::Enum::variables, channel, *j, defaultValue);
+					saveParameterDeferred(tempParam.databaseId, ParameterGroup::Type::Enum::variables, channel, *j, defaultValue);
 					GD::out.printInfo( "Info: Parameter \"" + *j + "\" was reset to " + BaseLib::HelperFunctions::getHexString(defaultValue) + ". Peer: " + std::to_string(_peerID) + " Serial number: " + _serialNumber + " Frame: " + frame->id);
 					if(rpcParameter->readable)
 					{
@@ -2496,6 +3666,11 @@ PVariable HMWiredPeer::setValue(BaseLib::PRpcClientInfo clientInfo, uint32_t cha
 		}
 		setMessageCounter(_messageCounter + 1);
 		std::shared_ptr<HMWiredPacket> response = getResponse(packet);
+		uint64_t requestTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - requestStartTime).count();
+		setValueStats.requests++;
+		setValueStats.requestTime += requestTime;
+		uint64_t maxRequestTime = setValueStats.maxRequestTime;
+		while(requestTime > maxRequestTime && !setValueStats.maxRequestTime.compare_exchange_weak(maxRequestTime, requestTime));
 		if(!response)
 		{
 			GD::out.printWarning("Error: Error sending packet to peer " + std::to_string(_peerID) + ". Peer did not respond.");
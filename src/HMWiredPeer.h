@@ -32,8 +32,18 @@
 
 #include <homegear-base/BaseLib.h>
 #include "HMWiredPacket.h"
+#include "EEPROMWritePlan.h"
+#include "FrameDecoder.h"
+#include "EventCoalescer.h"
+#include "FirmwareUpdater.h"
+#include "MaintenanceScheduler.h"
+#include "PhysicalInterfaces/IHMWiredInterface.h"
 
+#include <condition_variable>
 #include <list>
+#include <memory>
+#include <set>
+#include <tuple>
 
 using namespace BaseLib;
 using namespace BaseLib::DeviceDescription;
@@ -42,20 +52,98 @@ namespace HMWired
 {
 class HMWiredCentral;
 
-class FrameValue
+/**
+ * A variable of a channel, addressed by its slot number.
+ * @see FrameDecoder::getSlot()
+ */
+class ValueSlot
+{
+public:
+	BaseLib::Systems::RpcConfigurationParameter* value = nullptr;
+	PParameter parameter;
+};
+
+typedef std::vector<std::vector<ValueSlot>> ValueSlots;
+
+/**
+ * The payload of a frame built by setValue(). Message counter, control byte and CRC are added when the frame is sent.
+ */
+class SetValueFrame
 {
 public:
-	std::list<uint32_t> channels;
-	std::vector<uint8_t> value;
+	std::vector<uint8_t> payload;
+
+	/**
+	 * The other variables copied into the payload and their values at build time. The payload is only reused while they are unchanged.
+	 */
+	std::vector<std::pair<std::string, std::vector<uint8_t>>> dependencies;
 };
 
-class FrameValues
+class SetValueStats
 {
 public:
-	std::string frameID;
-	std::list<uint32_t> paramsetChannels;
-	ParameterGroup::Type::Enum parameterSetType;
-	std::map<std::string, FrameValue> values;
+	std::atomic<uint64_t> framesBuilt{0};
+	std::atomic<uint64_t> buildTime{0};
+	std::atomic<uint64_t> framesReused{0};
+	std::atomic<uint64_t> reuseTime{0};
+	std::atomic<uint64_t> requests{0};
+	std::atomic<uint64_t> requestTime{0};
+	std::atomic<uint64_t> maxRequestTime{0};
+};
+
+/**
+ * Requests sent to check the reachability of peers and to poll their values. Times are the milliseconds spent waiting for the
+ * responses, which is roughly the time the bus was busy.
+ */
+class MaintenanceStats
+{
+public:
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	std::atomic<uint64_t> probes{0};
+	std::atomic<uint64_t> probeRequests{0};
+	std::atomic<uint64_t> probeTime{0};
+	std::atomic<uint64_t> polls{0};
+	std::atomic<uint64_t> pollRequests{0};
+	std::atomic<uint64_t> pollTime{0};
+};
+
+class ValueRequestStats
+{
+public:
+	std::atomic<uint64_t> requests{0};
+
+	/**
+	 * Requests answered from valuesCentral, because the device sent the value within "valueMaxAge".
+	 */
+	std::atomic<uint64_t> cached{0};
+
+	/**
+	 * Requests, which waited for an equal request already on the bus.
+	 */
+	std::atomic<uint64_t> merged{0};
+	std::atomic<uint64_t> sent{0};
+};
+
+/**
+ * A value request frame on the bus. Equal requests wait for it instead of sending their own.
+ */
+class ValueRequest
+{
+public:
+	bool done = false;
+	bool success = false;
+};
+
+/**
+ * Index of the used and free slots of a link table in the EEPROM.
+ */
+class LinkSlotTable
+{
+public:
+	int32_t memoryAddressStart = -1;
+	int32_t memoryAddressStep = -1;
+	int32_t freeSlots = 0;
+	std::vector<bool> usedSlots;
 };
 
 class HMWiredPeer : public BaseLib::Systems::Peer
@@ -71,19 +159,70 @@ public:
 
 	//In table variables:
 	int32_t getMessageCounter() { return _messageCounter; }
-	void setMessageCounter(int32_t value) { _messageCounter = value; saveVariable(5, value); }
+	void setMessageCounter(int32_t value) { _messageCounter = value; _messageCounterChanged = BaseLib::HelperFunctions::getTime(); }
 	//End
 
+	/**
+	 * Writes the message counter to the database if it changed since the last call.
+	 */
+	void saveMessageCounter();
+
+	/**
+	 * Returns true, until the peer answered a request sent with the synchronization bit set. The stored message counter might be
+	 * outdated after a crash, so the first requests after loading the peer resynchronize the counter instead.
+	 */
+	bool messageCounterUnsynchronized() { return _messageCounterUnsynchronized; }
+	void messageCounterSynchronized() { _messageCounterUnsynchronized = false; }
+
 	bool ignorePackets = false;
 
 	void worker();
 	virtual std::string handleCliCommand(std::string command);
 	void initializeLinkConfig(int32_t channel, std::shared_ptr<BaseLib::Systems::BasicPeer> peer);
+	bool addLinkToWritePlan(EEPROMWritePlan& plan, int32_t channel, std::shared_ptr<BaseLib::Systems::BasicPeer> peer);
+
+	/**
+	 * Writes the address blocks and default link parameters of several links with one write plan and stores the links with one call to savePeers().
+	 *
+	 * @param links The links to add as pairs of local channel and remote peer. The EEPROM addresses must already be set.
+	 * @return Returns true on success. On failure no link is added.
+	 */
+	bool addLinks(std::vector<std::pair<int32_t, std::shared_ptr<BaseLib::Systems::BasicPeer>>>& links);
 	std::vector<int32_t> setConfigParameter(double index, double size, std::vector<uint8_t>& binaryValue);
 	std::vector<int32_t> setMasterConfigParameter(int32_t channelIndex, double index, double step, double size, std::vector<uint8_t>& binaryValue);
 	std::vector<int32_t> setMasterConfigParameter(int32_t channelIndex, int32_t addressStart, int32_t addressStep, double indexOffset, double size, std::vector<uint8_t>& binaryValue);
 	std::vector<int32_t> setMasterConfigParameter(int32_t channel, PParameterGroup parameterSet, PParameter parameter, std::vector<uint8_t>& binaryValue);
+	double getMasterConfigIndex(int32_t channelIndex, double index, double step);
+	double getMasterConfigIndex(int32_t channel, PParameterGroup parameterGroup, PParameter parameter);
+	bool addToWritePlan(EEPROMWritePlan& plan, int32_t channel, PParameterGroup parameterGroup, PParameter parameter, std::vector<uint8_t>& binaryValue);
+
+	/**
+	 * Reads all blocks of the plan which are not known yet, applies the plan's edits and stores and writes every changed block once.
+	 *
+	 * @param plan The plan to execute.
+	 * @return Returns true on success. When one of the blocks can't be read, nothing is changed and false is returned. When writing
+	 * fails, the blocks already written are restored on the device and the shadow is reset to the previous content.
+	 */
+	bool executeWritePlan(EEPROMWritePlan& plan);
+	std::string explainWritePlan(EEPROMWritePlan& plan);
 	std::vector<uint8_t> getConfigParameter(double index, double size, int32_t mask = -1, bool onlyKnownConfig = false);
+
+	/**
+	 * Reads all blocks which are not known yet back to back. Blocks that can't be read are skipped and read again on access.
+	 *
+	 * @param blocks The start addresses of the blocks to read.
+	 */
+	void prefetchConfigBlocks(const std::set<int32_t>& blocks);
+	std::set<int32_t> getConfigBlocks(int32_t channel, PParameterGroup parameterGroup, std::shared_ptr<BaseLib::Systems::BasicPeer> remotePeer);
+	std::set<int32_t> getLinkTableBlocks(PLinkParameters linkGroup);
+	uint32_t getPrefetchedBlockCount() { return _prefetchedBlocks; }
+
+	/**
+	 * Must be called after an EEPROM block in binaryConfig was changed. Invalidates cached parameter groups depending on the block.
+	 *
+	 * @param configBlockIndex The start address of the changed block.
+	 */
+	void configBlockChanged(int32_t configBlockIndex);
 	std::vector<uint8_t> getMasterConfigParameter(int32_t channelIndex, double index, double step, double size);
 	std::vector<uint8_t> getMasterConfigParameter(int32_t channelIndex, int32_t addressStart, int32_t addressStep, double indexOffset, double size);
 	std::vector<uint8_t> getMasterConfigParameter(int32_t channel, PParameterGroup parameterSet, PParameter parameter);
@@ -93,10 +232,30 @@ public:
     virtual void loadVariables(BaseLib::Systems::ICentral* central, std::shared_ptr<BaseLib::Database::DataTable>& rows);
     virtual void saveVariables();
 	virtual void savePeers();
+
+	/**
+	 * Writes a value queued by saveParameterDeferred() to the database. Called by the persistence queue.
+	 */
+	void writeParameter(uint64_t databaseId, std::vector<uint8_t>& value) { saveParameter(databaseId, value); }
+
+	/**
+	 * Writes a value queued by saveVariableDeferred() to the database. Called by the persistence queue.
+	 */
+	void writeVariable(uint32_t index, int64_t value) { saveVariable(index, value); }
 	bool hasPeers(int32_t channel) { if(_peers.find(channel) == _peers.end() || _peers[channel].empty()) return false; else return true; }
-	void addPeer(int32_t channel, std::shared_ptr<BaseLib::Systems::BasicPeer> peer);
+	void addPeer(int32_t channel, std::shared_ptr<BaseLib::Systems::BasicPeer> peer, bool save = true);
 	void removePeer(int32_t channel, uint64_t id, int32_t remoteChannel);
-	int32_t getFreeEEPROMAddress(int32_t channel, bool isSender);
+
+	/**
+	 * Returns the address of a free slot in the link table of a channel.
+	 *
+	 * @param channel The channel to get the slot for.
+	 * @param isSender Set to true when the channel is the sender of the link.
+	 * @param reserve When true, the slot is marked as used until addLinks() or initializeLinkConfig() wrote it.
+	 * @return Returns the EEPROM address of the slot or -1 when there is no free slot.
+	 */
+	int32_t getFreeEEPROMAddress(int32_t channel, bool isSender, bool reserve = false);
+	void releaseEEPROMAddress(int32_t channel, int32_t address) { updateLinkSlot(std::dynamic_pointer_cast<LinkParameters>(getParameterSet(channel, ParameterGroup::Type::Enum::link)), address); }
 	int32_t getPhysicalIndexOffset(int32_t channel);
 	virtual int32_t getChannelGroupedWith(int32_t channel) { return -1; }
 	virtual int32_t getNewFirmwareVersion();
@@ -107,7 +266,64 @@ public:
 	virtual std::shared_ptr<HMWiredPacket> getResponse(std::shared_ptr<HMWiredPacket> packet);
 	virtual void reset();
 	void getValuesFromPacket(std::shared_ptr<HMWiredPacket> packet, std::vector<FrameValues>& frameValue);
-	void packetReceived(std::shared_ptr<HMWiredPacket> packet);
+
+	/**
+	 * Checks if the parameter group of a channel contains a parameter. Takes the channel's parameter group selector into account.
+	 */
+	bool channelHasParameter(int32_t channel, ParameterGroup::Type::Enum type, const std::string& id);
+
+	/**
+	 * Processes a packet sent by this peer.
+	 *
+	 * @param acknowledged Set to true, when the ACK was already sent. Otherwise it is sent after processing the packet.
+	 */
+	void packetReceived(std::shared_ptr<HMWiredPacket> packet, bool acknowledged = false);
+
+	/**
+	 * Checks if a packet is a retransmission of the last packet received from this peer and remembers it otherwise.
+	 *
+	 * @return Returns true, when the packet has the same message counter and content as the last packet and was received within the duplicate window.
+	 * @see HMWired::duplicateWindow()
+	 */
+	bool isDuplicate(std::shared_ptr<HMWiredPacket> packet);
+
+	/**
+	 * Makes isDuplicate() accept a retransmission of the last packet. Called when the packet was dropped without ACK.
+	 */
+	void forgetLastPacket();
+
+	/**
+	 * Returns the progress of an interrupted firmware update.
+	 */
+	FirmwareCheckpoint getFirmwareCheckpoint();
+
+	/**
+	 * Returns the physical interface this peer is connected to. Returns the default interface, when the peer is not bound to an
+	 * interface or its interface doesn't exist anymore.
+	 */
+	std::shared_ptr<IHMWiredInterface> getPhysicalInterface();
+
+	/**
+	 * Returns the ID of the physical interface this peer is connected to.
+	 * @see getPhysicalInterface()
+	 */
+	std::string getPhysicalInterfaceId();
+
+	/**
+	 * Binds the peer to a physical interface.
+	 */
+	void setPhysicalInterfaceId(const std::string& interfaceId);
+
+	/**
+	 * Saves the progress of a firmware update. Pass an empty checkpoint to delete it.
+	 */
+	void setFirmwareCheckpoint(FirmwareCheckpoint checkpoint);
+
+	/**
+	 * Raises the values of a channel held back by the event coalescer.
+	 * @see EventCoalescer
+	 */
+	void raiseCoalescedEvent(uint32_t channel, std::shared_ptr<std::vector<std::string>> valueKeys, std::shared_ptr<std::vector<PVariable>> values);
 
 	std::string printConfig();
 
@@ -116,11 +332,43 @@ public:
 	 *
 	 * @param packetCount The maximum number of ping packets to send if there is no response.
 	 * @param waitForResponse Wait for the response packet.
-	 * @see _lastPing
 	 * @return Returns true, when the execution was successful. If "waitForResponse" is true, then true is returned when the device sent a response packet and false when there was no response.
+	 * When an unreachable device answers, its values are requested once.
 	 */
 	virtual bool ping(int32_t packetCount, bool waitForResponse);
 
+	/**
+	 * Requests all values, which can be requested from the device.
+	 *
+	 * @param liveness Set to true, when the request is used as reachability check. Only used for the statistics.
+	 * @return Returns true, when all requests were answered.
+	 */
+	bool pollValues(bool waitForResponse, bool liveness);
+
+	/**
+	 * Runs a reachability check or value poll and sets the ServiceMessage "UNREACH" depending on the result. Called by the
+	 * maintenance scheduler.
+	 *
+	 * @param interval The interval of the task in milliseconds. Polls are skipped, when the device sent a packet within the interval.
+	 * @return Returns true, when packets were sent.
+	 */
+	bool runMaintenance(MaintenanceType type, int64_t interval);
+
+	/**
+	 * Statistics of the frames sent by setValue() of all peers. Times are in nanoseconds.
+	 */
+	static SetValueStats setValueStats;
+
+	/**
+	 * Statistics of the reachability checks and value polls of all peers.
+	 */
+	static MaintenanceStats maintenanceStats;
+
+	/**
+	 * Statistics of the values requested from the devices of all peers.
+	 */
+	static ValueRequestStats valueRequestStats;
+
 	//RPC methods
 	virtual PVariable getDeviceInfo(BaseLib::PRpcClientInfo clientInfo, std::map<std::string, bool> fields);
 	virtual PVariable getParamsetDescription(BaseLib::PRpcClientInfo clientInfo, int32_t channel, ParameterGroup::Type::Enum type, uint64_t remoteID, int32_t remoteChannel, bool checkAcls);
@@ -136,28 +384,159 @@ protected:
 	//End
 
 	/**
-	 * The timestamp of the last ping (successful and unsuccessful) is stored in this variable.
-	 * @see _pingThread
-	 * @see pingThread()
-	 * @see _pingThreadMutex
+	 * Time of the last unsaved change of the message counter or 0. The counter is saved by worker() when it didn't change for
+	 * _messageCounterSaveDelay milliseconds or after _messageCounterMaxSaveDelay milliseconds at the latest.
+	 */
+	std::atomic<int64_t> _messageCounterChanged{0};
+
+	/**
+	 * Time the message counter was last saved. Starts at the creation or load time of the peer, so the first change waits
+	 * for the save delay, too.
+	 */
+	std::atomic<int64_t> _lastMessageCounterSave{BaseLib::HelperFunctions::getTime()};
+	const int64_t _messageCounterSaveDelay = 10000;
+	const int64_t _messageCounterMaxSaveDelay = 300000;
+	std::atomic_bool _messageCounterUnsynchronized{true};
+
+	/**
+	 * Message counter, hash and receive time of the last packet sent by this peer.
+	 * @see isDuplicate()
+	 */
+	uint8_t _lastPacketCounter = 0;
+	uint32_t _lastPacketHash = 0;
+	int64_t _lastPacketTime = 0;
+	std::mutex _lastPacketMutex;
+
+	FirmwareCheckpoint _firmwareCheckpoint;
+	std::mutex _firmwareCheckpointMutex;
+
+	/**
+	 * The ID of the interface the peer was found on or last heard from.
+	 */
+	std::string _physicalInterfaceId;
+	std::mutex _physicalInterfaceIdMutex;
+
+	/**
+	 * Start address of the last block read on a cache miss. Used to detect sequential misses.
+	 * @see readConfigBlock()
+	 */
+	int32_t _lastReadBlock = -1;
+
+	/**
+	 * The number of blocks read ahead on the next sequential cache miss. Doubled on every sequential miss up to _maxReadAheadBlocks.
+	 */
+	int32_t _readAheadBlocks = 0;
+	const int32_t _maxReadAheadBlocks = 8;
+	uint32_t _prefetchedBlocks = 0;
+
+	/**
+	 * Parameter groups of channels with a parameter group selector by channel and parameter group type.
+	 * @see getParameterSet()
+	 * @see configBlockChanged()
 	 */
-	int64_t _lastPing = 0;
+	std::unordered_map<int32_t, std::unordered_map<int32_t, PParameterGroup>> _parameterGroupCache;
 
 	/**
-	 * Protects _pingThread
-	 * @see _pingThread
-	 * @see pingThread()
-	 * @see _lastPing
+	 * The EEPROM blocks the cached selectors were read from.
 	 */
-	std::mutex _pingThreadMutex;
+	std::set<int32_t> _parameterGroupSelectorBlocks;
+	uint32_t _parameterGroupCacheGeneration = 0;
+	std::mutex _parameterGroupCacheMutex;
+
+	void readConfigBlock(int32_t configBlockIndex);
+
+	/**
+	 * The decode table of this peer's device description. Replaced when the device description changes while packets are decoded,
+	 * so only access it with std::atomic_load() and std::atomic_store().
+	 * @see getValuesFromPacket()
+	 */
+	std::shared_ptr<FrameDecoder> _frameDecoder;
+
+	/**
+	 * The variables of all channels by channel and slot. Built from valuesCentral on first use and rebuilt when the parameter groups change.
+	 * @see getValueSlots()
+	 */
+	std::shared_ptr<ValueSlots> _valueSlots;
+	uint32_t _valueSlotsGeneration = 0;
+	std::mutex _valueSlotsMutex;
+
+	std::shared_ptr<ValueSlots> getValueSlots();
+	void invalidateValueSlots();
+
+	/**
+	 * Returns the event coalescing mode and window of a channel as set by the configuration parameters EVENT_COALESCE_MODE and EVENT_COALESCE_WINDOW.
+	 */
+	EventCoalescer::Mode getEventCoalescing(uint32_t channel, int32_t& window);
+
+	/**
+	 * Payloads of frames sent by setValue() by channel, parameter and value.
+	 * @see getSetValueFrame()
+	 */
+	std::map<std::tuple<uint32_t, std::string, std::vector<uint8_t>>, std::shared_ptr<SetValueFrame>> _setValueFrames;
+	std::mutex _setValueFramesMutex;
+	const uint32_t _maxSetValueFrames = 64;
+
+	/**
+	 * The time in milliseconds each value was last received from the device by channel and parameter. Only filled when "valueMaxAge"
+	 * is set.
+	 */
+	std::unordered_map<uint32_t, std::unordered_map<std::string, int64_t>> _valueTimes;
+	std::mutex _valueTimesMutex;
+
+	/**
+	 * The value requests on the bus by channel and frame ID.
+	 */
+	std::map<std::pair<uint32_t, std::string>, std::shared_ptr<ValueRequest>> _valueRequests;
+	std::mutex _valueRequestsMutex;
+	std::condition_variable _valueRequestsConditionVariable;
+
+	/**
+	 * Returns the cached payload for a parameter value or nullptr, when there is none or one of its dependencies changed.
+	 */
+	std::shared_ptr<SetValueFrame> getSetValueFrame(uint32_t channel, const std::string& valueKey, const std::vector<uint8_t>& value);
+	void addSetValueFrame(uint32_t channel, const std::string& valueKey, const std::vector<uint8_t>& value, std::shared_ptr<SetValueFrame> frame);
+	void clearSetValueFrames();
 
 	/**
-	 * Stores the pingThread thread object.
-	 * @see pingThread()
-	 * @see _pingThreadMutex
-	 * @see _lastPing
+	 * Saves a parameter through the persistence queue. Parameters without database ID yet and parameters saved while the queue
+	 * is disabled or disposing are written directly.
 	 */
-	std::thread _pingThread;
+	void saveParameterDeferred(uint64_t databaseId, ParameterGroup::Type::Enum parameterSetType, uint32_t channel, const std::string& parameterName, std::vector<uint8_t>& value);
+	void saveVariableDeferred(uint32_t index, int64_t value);
+
+	/**
+	 * Returns after all values of this peer queued by saveParameterDeferred() and saveVariableDeferred() were written to the
+	 * database. Used for values, which need to be durable when the calling method returns.
+	 */
+	void flushDeferredSaves();
+
+	/**
+	 * Link slot tables by memoryAddressStart. Channels sharing a link table share the index.
+	 * @see getLinkSlotTable()
+	 * @see updateLinkSlot()
+	 */
+	std::map<int32_t, std::shared_ptr<LinkSlotTable>> _linkSlotTables;
+	std::mutex _linkSlotTablesMutex;
+
+	/**
+	 * Returns the slot index of a link table. The index is built from the EEPROM shadow on first use.
+	 *
+	 * @param linkGroup The link parameter group describing the table.
+	 * @param onlyKnownConfig When true, no missing blocks are read from the device.
+	 * @return Returns the table or nullptr when the group has no link table.
+	 */
+	std::shared_ptr<LinkSlotTable> getLinkSlotTable(PLinkParameters linkGroup, bool onlyKnownConfig);
+
+	/**
+	 * Updates the state of one slot of an existing index from the EEPROM shadow.
+	 */
+	void updateLinkSlot(PLinkParameters linkGroup, int32_t address);
+
+	/**
+	 * @return Returns 0 for free slots, 1 for used slots and -1 when the slot is unknown.
+	 */
+	int32_t getLinkSlotState(PLinkParameters linkGroup, int32_t address);
+	void getConfigBlocks(double index, double size, std::set<int32_t>& blocks);
 
 	virtual std::shared_ptr<BaseLib::Systems::ICentral> getCentral();
 
@@ -166,16 +545,19 @@ protected:
 	 */
 	virtual PVariable getValueFromDevice(PParameter& parameter, int32_t channel, bool asynchronous);
 
-	virtual PParameterGroup getParameterSet(int32_t channel, ParameterGroup::Type::Enum type);
+	/**
+	 * Builds a value request frame and sends it.
+	 *
+	 * @return Returns the response or nullptr, when the device didn't answer.
+	 */
+	std::shared_ptr<HMWiredPacket> sendValueRequest(PPacket frame, int32_t channel, PParameterGroup parameterGroup);
 
 	/**
-	 * Executes the method "ping" and sets the ServiceMessage "UNREACH" depending on the result.
-	 * @see ping()
-	 * @see _pingThreadMutex
-	 * @see _pingThread
-	 * @see _lastPing
+	 * Returns true, when the device sent the value within the last "maxAge" milliseconds.
 	 */
-	virtual void pingThread();
+	bool valueIsFresh(uint32_t channel, const std::string& parameterId, int64_t maxAge);
+
+	virtual PParameterGroup getParameterSet(int32_t channel, ParameterGroup::Type::Enum type);
 };
 
 }
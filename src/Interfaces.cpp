@@ -48,7 +48,7 @@ void Interfaces::create()
 {
 	try
 	{
-
+		bool defaultFound = false;
 		for(std::map<std::string, Systems::PPhysicalInterfaceSettings>::iterator i = _physicalInterfaceSettings.begin(); i != _physicalInterfaceSettings.end(); ++i)
 		{
 			std::shared_ptr<IHMWiredInterface> device;
@@ -61,7 +61,13 @@ void Interfaces::create()
 			{
 				if(_physicalInterfaces.find(i->second->id) != _physicalInterfaces.end()) GD::out.printError("Error: id used for two devices: " + i->second->id);
 				_physicalInterfaces[i->second->id] = device;
-				GD::physicalInterface = device;
+				GD::physicalInterfaces[i->second->id] = device;
+				//Without "default = true" the last interface is the default one
+				if(!defaultFound)
+				{
+					GD::physicalInterface = device;
+					defaultFound = i->second->isDefault;
+				}
 			}
 		}
 		if(!GD::physicalInterface) GD::physicalInterface = std::make_shared<IHMWiredInterface>(std::make_shared<BaseLib::Systems::PhysicalInterfaceSettings>());
@@ -0,0 +1,281 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "MaintenanceScheduler.h"
+#include "HMWiredCentral.h"
+#include "GD.h"
+
+namespace HMWired
+{
+
+MaintenanceScheduler::MaintenanceScheduler(HMWiredCentral* central, const std::vector<std::string>& interfaceIds, int32_t concurrency, int32_t share)
+{
+	try
+	{
+		_central = central;
+		_concurrency = concurrency < 1 ? 1 : concurrency;
+		_share = share < 1 ? 1 : (share > 100 ? 100 : share);
+		for(std::vector<std::string>::const_iterator i = interfaceIds.begin(); i != interfaceIds.end(); ++i)
+		{
+			std::shared_ptr<Bus> bus = std::make_shared<Bus>();
+			bus->workerThreads.resize(_concurrency);
+			_buses[*i] = bus;
+		}
+		for(std::map<std::string, std::shared_ptr<Bus>>::iterator i = _buses.begin(); i != _buses.end(); ++i)
+		{
+			for(std::vector<std::thread>::iterator j = i->second->workerThreads.begin(); j != i->second->workerThreads.end(); ++j)
+			{
+				GD::bl->threadManager.start(*j, false, &MaintenanceScheduler::worker, this, i->first);
+			}
+		}
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+MaintenanceScheduler::~MaintenanceScheduler()
+{
+	dispose();
+}
+
+void MaintenanceScheduler::dispose()
+{
+	try
+	{
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			if(_disposing) return;
+			_disposing = true;
+			_stopWorkerThreads = true;
+		}
+		_conditionVariable.notify_all();
+		for(std::map<std::string, std::shared_ptr<Bus>>::iterator i = _buses.begin(); i != _buses.end(); ++i)
+		{
+			for(std::vector<std::thread>::iterator j = i->second->workerThreads.begin(); j != i->second->workerThreads.end(); ++j)
+			{
+				GD::bl->threadManager.join(*j);
+			}
+		}
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		_entries.clear();
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void MaintenanceScheduler::schedule(uint64_t peerId, const std::string& interfaceId, MaintenanceType type, int64_t interval)
+{
+	try
+	{
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		if(_disposing || _buses.empty()) return;
+		std::map<uint64_t, Entry>::iterator entryIterator = _entries.find(peerId);
+		if(type == MaintenanceType::none || interval <= 0)
+		{
+			if(entryIterator == _entries.end()) return;
+			//A running entry is removed by the worker
+			if(entryIterator->second.running) entryIterator->second.type = MaintenanceType::none;
+			else _entries.erase(entryIterator);
+			return;
+		}
+
+		std::string busId = _buses.find(interfaceId) != _buses.end() ? interfaceId : _buses.begin()->first;
+		if(entryIterator != _entries.end() && entryIterator->second.type == type && entryIterator->second.interval == interval && entryIterator->second.interfaceId == busId) return;
+
+		Entry& entry = _entries[peerId];
+		entry.interfaceId = busId;
+		entry.type = type;
+		entry.interval = interval;
+		entry.due = BaseLib::HelperFunctions::getTime() + BaseLib::HelperFunctions::getRandomNumber(0, interval > 2147483647 ? 2147483647 : (int32_t)interval - 1);
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    _conditionVariable.notify_all();
+}
+
+void MaintenanceScheduler::postpone(uint64_t peerId)
+{
+	try
+	{
+		std::unique_lock<std::mutex> queueGuard(_queueMutex);
+		_conditionVariable.wait(queueGuard, [&]
+		{
+			std::map<uint64_t, Entry>::iterator entryIterator = _entries.find(peerId);
+			return _stopWorkerThreads || entryIterator == _entries.end() || !entryIterator->second.running;
+		});
+		std::map<uint64_t, Entry>::iterator entryIterator = _entries.find(peerId);
+		if(entryIterator != _entries.end()) entryIterator->second.due = BaseLib::HelperFunctions::getTime() + entryIterator->second.interval;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+std::vector<MaintenanceQueueState> MaintenanceScheduler::getQueueState()
+{
+	std::vector<MaintenanceQueueState> states;
+	try
+	{
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		int64_t time = BaseLib::HelperFunctions::getTime();
+		for(std::map<std::string, std::shared_ptr<Bus>>::iterator i = _buses.begin(); i != _buses.end(); ++i)
+		{
+			MaintenanceQueueState state;
+			state.interfaceId = i->first;
+			state.running = i->second->running;
+			state.throttled = i->second->nextAllowed > time ? i->second->nextAllowed - time : 0;
+			state.tasks = i->second->tasks;
+			state.busyTime = i->second->busyTime;
+			bool first = true;
+			for(std::map<uint64_t, Entry>::iterator j = _entries.begin(); j != _entries.end(); ++j)
+			{
+				if(j->second.interfaceId != i->first || j->second.type == MaintenanceType::none) continue;
+				state.scheduled++;
+				if(j->second.running) continue;
+				if(j->second.due <= time) state.due++;
+				if(first || j->second.due - time < state.nextDue) state.nextDue = j->second.due - time;
+				first = false;
+			}
+			states.push_back(state);
+		}
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return states;
+}
+
+void MaintenanceScheduler::worker(std::string interfaceId)
+{
+	std::shared_ptr<Bus> bus = _buses.at(interfaceId);
+	while(!_stopWorkerThreads)
+	{
+		try
+		{
+			uint64_t peerId = 0;
+			MaintenanceType type = MaintenanceType::none;
+			int64_t interval = 0;
+			{
+				std::unique_lock<std::mutex> queueGuard(_queueMutex);
+				if(_stopWorkerThreads) break;
+				int64_t time = BaseLib::HelperFunctions::getTime();
+				std::map<uint64_t, Entry>::iterator next = _entries.end();
+				for(std::map<uint64_t, Entry>::iterator i = _entries.begin(); i != _entries.end(); ++i)
+				{
+					if(i->second.interfaceId != interfaceId || i->second.running || i->second.type == MaintenanceType::none) continue;
+					if(next == _entries.end() || i->second.due < next->second.due) next = i;
+				}
+				//Wake up at least once a second, so new entries and removed peers are noticed without notification
+				int64_t waitingTime = 1000;
+				if(next != _entries.end() && bus->running < _concurrency)
+				{
+					int64_t start = next->second.due > bus->nextAllowed ? next->second.due : bus->nextAllowed;
+					if(start - time < waitingTime) waitingTime = start - time;
+				}
+				if(waitingTime > 0)
+				{
+					_conditionVariable.wait_for(queueGuard, std::chrono::milliseconds(waitingTime));
+					continue;
+				}
+
+				peerId = next->first;
+				type = next->second.type;
+				interval = next->second.interval;
+				next->second.running = true;
+				//Keep the slot. Missed intervals are skipped.
+				while(next->second.due <= time) next->second.due += interval;
+				bus->running++;
+			}
+
+			int64_t startTime = BaseLib::HelperFunctions::getTime();
+			bool sent = false;
+			std::shared_ptr<HMWiredPeer> peer = _central->getPeer(peerId);
+			if(peer && !peer->deleting) sent = peer->runMaintenance(type, interval);
+			int64_t endTime = BaseLib::HelperFunctions::getTime();
+
+			{
+				std::lock_guard<std::mutex> queueGuard(_queueMutex);
+				bus->running--;
+				if(sent)
+				{
+					int64_t duration = endTime - startTime;
+					bus->tasks++;
+					bus->busyTime += duration;
+					if(bus->nextAllowed < endTime) bus->nextAllowed = endTime;
+					bus->nextAllowed += duration * (100 - _share) / _share;
+				}
+				std::map<uint64_t, Entry>::iterator entryIterator = _entries.find(peerId);
+				if(entryIterator != _entries.end())
+				{
+					entryIterator->second.running = false;
+					if(!peer || entryIterator->second.type == MaintenanceType::none) _entries.erase(entryIterator);
+				}
+			}
+			_conditionVariable.notify_all();
+		}
+		catch(const std::exception& ex)
+		{
+			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+	}
+}
+
+}
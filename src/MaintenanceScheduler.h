@@ -0,0 +1,158 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef MAINTENANCESCHEDULER_H_
+#define MAINTENANCESCHEDULER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace HMWired
+{
+class HMWiredCentral;
+
+enum class MaintenanceType
+{
+	none,
+	/**
+	 * Checks if an unreachable peer is back.
+	 */
+	probe,
+	/**
+	 * Requests the values of a peer with "POLLING" enabled.
+	 */
+	poll
+};
+
+class MaintenanceQueueState
+{
+public:
+	std::string interfaceId;
+	uint32_t scheduled = 0;
+	uint32_t due = 0;
+	uint32_t running = 0;
+
+	/**
+	 * Milliseconds until the next task is due. Negative when tasks are overdue.
+	 */
+	int64_t nextDue = 0;
+
+	/**
+	 * Milliseconds until the airtime limit allows the next task.
+	 */
+	int64_t throttled = 0;
+	uint64_t tasks = 0;
+	uint64_t busyTime = 0;
+};
+
+/**
+ * Runs the reachability checks and value polls of all peers. Every peer gets a random slot within its interval, so peers becoming
+ * due at the same time (e. g. after startup or after a bus outage) are spread over the interval. Every interface has its own workers.
+ * At most "maintenanceConcurrency" tasks run on a bus at the same time and maintenance uses at most "maintenanceShare" percent of the
+ * bus time: after a task, the bus' next task waits until the share is met again.
+ */
+class MaintenanceScheduler
+{
+public:
+	/**
+	 * @param interfaceIds The interfaces to start workers for.
+	 * @param concurrency The maximum number of tasks running on one bus at the same time.
+	 * @param share The maximum share of the bus time in percent.
+	 */
+	MaintenanceScheduler(HMWiredCentral* central, const std::vector<std::string>& interfaceIds, int32_t concurrency, int32_t share);
+	virtual ~MaintenanceScheduler();
+
+	/**
+	 * Stops the workers and waits for running tasks.
+	 */
+	void dispose();
+
+	/**
+	 * Sets the task of a peer. Called by the peer's worker on every run. A new slot is assigned when the task, the interval or the
+	 * interface changes.
+	 *
+	 * @param type The task. "none" removes the peer from the schedule.
+	 * @param interval The interval of the task in milliseconds.
+	 */
+	void schedule(uint64_t peerId, const std::string& interfaceId, MaintenanceType type, int64_t interval);
+
+	/**
+	 * Waits for a running task of the peer and moves its next task one interval into the future.
+	 */
+	void postpone(uint64_t peerId);
+
+	std::vector<MaintenanceQueueState> getQueueState();
+protected:
+	class Entry
+	{
+	public:
+		std::string interfaceId;
+		MaintenanceType type = MaintenanceType::none;
+		int64_t interval = 0;
+		int64_t due = 0;
+		bool running = false;
+	};
+
+	class Bus
+	{
+	public:
+		std::vector<std::thread> workerThreads;
+		int64_t nextAllowed = 0;
+		uint32_t running = 0;
+		uint64_t tasks = 0;
+		uint64_t busyTime = 0;
+	};
+
+	HMWiredCentral* _central = nullptr;
+	uint32_t _concurrency = 1;
+	int32_t _share = 10;
+	std::atomic_bool _disposing{false};
+	std::atomic_bool _stopWorkerThreads{false};
+	std::mutex _queueMutex;
+	std::condition_variable _conditionVariable;
+
+	/**
+	 * The buses mapped by interface ID. Only modified by the constructor.
+	 */
+	std::map<std::string, std::shared_ptr<Bus>> _buses;
+	std::map<uint64_t, Entry> _entries;
+
+	void worker(std::string interfaceId);
+};
+
+}
+
+#endif /* MAINTENANCESCHEDULER_H_ */
@@ -0,0 +1,271 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "PacketDispatcher.h"
+#include "HMWiredCentral.h"
+#include "GD.h"
+
+namespace HMWired
+{
+
+PacketDispatcher::PacketDispatcher(HMWiredCentral* central)
+{
+	try
+	{
+		_central = central;
+		_entries.resize(_capacity);
+		for(std::array<std::atomic<uint64_t>, 10>::iterator i = _depth.begin(); i != _depth.end(); ++i) *i = 0;
+		for(std::array<std::atomic<uint64_t>, 7>::iterator i = _latency.begin(); i != _latency.end(); ++i) *i = 0;
+		GD::bl->threadManager.start(_dispatchThread, true, GD::bl->settings.workerThreadPriority(), GD::bl->settings.workerThreadPolicy(), &PacketDispatcher::dispatch, this);
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+PacketDispatcher::~PacketDispatcher()
+{
+	dispose();
+}
+
+void PacketDispatcher::dispose()
+{
+	try
+	{
+		{
+			std::lock_guard<std::mutex> producerGuard(_producerMutex);
+			_disposing = true;
+		}
+		{
+			std::lock_guard<std::mutex> waitGuard(_waitMutex);
+			_stopThread = true;
+		}
+		_conditionVariable.notify_one();
+		GD::bl->threadManager.join(_dispatchThread);
+		{
+			std::lock_guard<std::mutex> dispatchedGuard(_dispatchedMutex);
+		}
+		_dispatchedConditionVariable.notify_all();
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+bool PacketDispatcher::push(std::shared_ptr<HMWiredPacket> packet, bool acknowledged)
+{
+	try
+	{
+		{
+			std::lock_guard<std::mutex> producerGuard(_producerMutex);
+			if(_disposing) return false;
+			uint32_t tail = _tail.load(std::memory_order_relaxed);
+			uint32_t depth = tail - _head.load(std::memory_order_acquire);
+			if(depth >= _capacity)
+			{
+				//Neither wait nor process the packet here. Waiting would delay the ACK and processing would overtake older packets of
+				//the same peer. The caller doesn't acknowledge the packet, so the device sends it again.
+				_overflows++;
+				return false;
+			}
+			Entry& entry = _entries[tail % _capacity];
+			entry.packet = packet;
+			entry.acknowledged = acknowledged;
+			entry.time = std::chrono::steady_clock::now();
+			_tail.store(tail + 1); //Sequentially consistent, so it can't be reordered with the read of _consumerWaiting below
+
+			uint32_t bucket = 0;
+			while(depth > 0 && bucket < _depth.size() - 1)
+			{
+				depth >>= 1;
+				bucket++;
+			}
+			_depth[bucket]++;
+		}
+
+		//Only take the mutex when the dispatcher might be waiting. See dispatch().
+		if(_consumerWaiting)
+		{
+			{
+				std::lock_guard<std::mutex> waitGuard(_waitMutex);
+			}
+			_conditionVariable.notify_one();
+		}
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+bool PacketDispatcher::pop(Entry& entry)
+{
+	uint32_t head = _head.load(std::memory_order_relaxed);
+	if(head == _tail.load(std::memory_order_acquire)) return false;
+	Entry& queuedEntry = _entries[head % _capacity];
+	entry.packet.swap(queuedEntry.packet);
+	queuedEntry.packet.reset();
+	entry.acknowledged = queuedEntry.acknowledged;
+	entry.time = queuedEntry.time;
+	_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+void PacketDispatcher::waitForDispatch()
+{
+	try
+	{
+		if(std::this_thread::get_id() == _dispatchThread.get_id()) return;
+		uint32_t sequence = _tail;
+		std::unique_lock<std::mutex> dispatchedGuard(_dispatchedMutex);
+		_dispatchWaiters++;
+		//The timeout only protects against a blocked dispatcher
+		_dispatchedConditionVariable.wait_for(dispatchedGuard, std::chrono::milliseconds(1000), [&] { return _stopThread || (int32_t)(_processed - sequence) >= 0; });
+		_dispatchWaiters--;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+uint32_t PacketDispatcher::size()
+{
+	return _tail - _head;
+}
+
+PacketDispatcherStats PacketDispatcher::getStats()
+{
+	PacketDispatcherStats stats;
+	stats.dispatched = _dispatched;
+	stats.overflows = _overflows;
+	for(uint32_t i = 0; i < _depth.size(); i++) stats.depth[i] = _depth[i];
+	for(uint32_t i = 0; i < _latency.size(); i++) stats.latency[i] = _latency[i];
+	stats.maxLatency = _maxLatency;
+	return stats;
+}
+
+void PacketDispatcher::dispatch()
+{
+	Entry entry;
+	while(!_stopThread)
+	{
+		try
+		{
+			if(!pop(entry))
+			{
+				//_consumerWaiting is set while holding _waitMutex and the queue is checked again afterwards. A producer seeing
+				//_consumerWaiting locks the mutex before notifying, so the notification can't get lost.
+				std::unique_lock<std::mutex> waitGuard(_waitMutex);
+				_consumerWaiting = true;
+				_conditionVariable.wait(waitGuard, [&] { return _stopThread || _head != _tail; });
+				_consumerWaiting = false;
+				continue;
+			}
+
+			process(entry);
+		}
+		catch(const std::exception& ex)
+		{
+			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+	}
+
+	//Drain the queue. The packets were acknowledged already, so the devices won't send them again.
+	try
+	{
+		while(pop(entry)) process(entry);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void PacketDispatcher::process(Entry& entry)
+{
+	try
+	{
+		uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - entry.time).count();
+		uint32_t bucket = 0;
+		for(uint64_t bound = 10; bucket < _latency.size() - 1 && latency >= bound; bound *= 10) bucket++;
+		_latency[bucket]++;
+		if(latency > _maxLatency) _maxLatency = latency;
+		_dispatched++;
+
+		_central->dispatchPacket(entry.packet, entry.acknowledged);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	entry.packet.reset();
+	_processed++;
+	if(_dispatchWaiters > 0)
+	{
+		{
+			std::lock_guard<std::mutex> dispatchedGuard(_dispatchedMutex);
+		}
+		_dispatchedConditionVariable.notify_all();
+	}
+}
+
+}
@@ -0,0 +1,158 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef PACKETDISPATCHER_H_
+#define PACKETDISPATCHER_H_
+
+#include "HMWiredPacket.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace HMWired
+{
+class HMWiredCentral;
+
+class PacketDispatcherStats
+{
+public:
+	uint64_t dispatched = 0;
+
+	/**
+	 * Packets dropped, because the queue was full. They weren't acknowledged, so the devices send them again.
+	 */
+	uint64_t overflows = 0;
+
+	/**
+	 * Queue depth seen by the receiving thread when adding a packet. Bucket 0 counts an empty queue, bucket n a depth of 2^(n-1) to 2^n - 1.
+	 */
+	std::array<uint64_t, 10> depth{};
+
+	/**
+	 * Time between adding a packet and the start of its processing. The upper bounds of the buckets are 10 µs, 100 µs, 1 ms, 10 ms, 100 ms and 1 s.
+	 * The last bucket counts everything above.
+	 */
+	std::array<uint64_t, 7> latency{};
+	uint64_t maxLatency = 0;
+};
+
+/**
+ * Decouples the interface's receive thread from the processing of received packets. The receive thread only queues the packet,
+ * stores it for pending requests and sends the ACK. Decoding, database writes and events are handled by the dispatcher's thread.
+ *
+ * The packets are passed through a lock-free single producer single consumer ring buffer. The HMW-LGW also raises responses on
+ * the sending thread, so producers are serialized by a mutex, which is uncontended in normal operation. Packets are always
+ * processed in the order they were received. Packets queued when dispose() is called are still processed.
+ */
+class PacketDispatcher
+{
+public:
+	PacketDispatcher(HMWiredCentral* central);
+	virtual ~PacketDispatcher();
+	void dispose();
+
+	/**
+	 * Adds a packet to the queue. Never waits, so the receiving thread isn't blocked.
+	 *
+	 * @param packet The received packet.
+	 * @param acknowledged Set to true, when the receiving thread sends the ACK.
+	 * @return Returns false, when the queue is full or the dispatcher is disposing. The packet must not be acknowledged then.
+	 */
+	bool push(std::shared_ptr<HMWiredPacket> packet, bool acknowledged);
+
+	/**
+	 * Waits until all packets queued so far are processed. Used by sendPacket(), so the values of a response are stored before the
+	 * response is returned. Returns immediately when called by the dispatcher's thread.
+	 */
+	void waitForDispatch();
+
+	uint32_t size();
+	uint32_t capacity() { return _capacity; }
+	PacketDispatcherStats getStats();
+protected:
+	class Entry
+	{
+	public:
+		std::shared_ptr<HMWiredPacket> packet;
+		bool acknowledged = false;
+		std::chrono::steady_clock::time_point time;
+	};
+
+	static const uint32_t _capacity = 256;
+
+	HMWiredCentral* _central = nullptr;
+	std::vector<Entry> _entries;
+
+	/**
+	 * Next entry to read. Only written by the consumer.
+	 */
+	std::atomic<uint32_t> _head{0};
+
+	/**
+	 * Next entry to write. Only written by the producer.
+	 */
+	std::atomic<uint32_t> _tail{0};
+	std::mutex _producerMutex;
+
+	std::atomic_bool _disposing{false};
+	std::atomic_bool _stopThread{false};
+	std::atomic_bool _consumerWaiting{false};
+	std::mutex _waitMutex;
+	std::condition_variable _conditionVariable;
+	std::thread _dispatchThread;
+
+	/**
+	 * Number of processed packets. Compared to _tail by waitForDispatch().
+	 */
+	std::atomic<uint32_t> _processed{0};
+	std::atomic<uint32_t> _dispatchWaiters{0};
+	std::mutex _dispatchedMutex;
+	std::condition_variable _dispatchedConditionVariable;
+
+	//Statistics. Atomic, so neither thread needs a lock.
+	std::atomic<uint64_t> _dispatched{0};
+	std::atomic<uint64_t> _overflows{0};
+	std::array<std::atomic<uint64_t>, 10> _depth;
+	std::array<std::atomic<uint64_t>, 7> _latency;
+	std::atomic<uint64_t> _maxLatency{0};
+
+	bool pop(Entry& entry);
+	void dispatch();
+	void process(Entry& entry);
+};
+
+}
+
+#endif /* PACKETDISPATCHER_H_ */
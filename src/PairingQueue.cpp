@@ -0,0 +1,188 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "PairingQueue.h"
+#include "HMWiredCentral.h"
+#include "GD.h"
+
+namespace HMWired
+{
+
+PairingQueue::PairingQueue(HMWiredCentral* central, const std::vector<std::string>& interfaceIds)
+{
+	try
+	{
+		_central = central;
+		for(std::vector<std::string>::const_iterator i = interfaceIds.begin(); i != interfaceIds.end(); ++i)
+		{
+			_buses[*i] = std::make_shared<Bus>();
+		}
+		for(std::map<std::string, std::shared_ptr<Bus>>::iterator i = _buses.begin(); i != _buses.end(); ++i)
+		{
+			GD::bl->threadManager.start(i->second->workerThread, false, &PairingQueue::worker, this, i->first);
+		}
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+PairingQueue::~PairingQueue()
+{
+	dispose();
+}
+
+void PairingQueue::dispose()
+{
+	try
+	{
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			if(_disposing) return;
+			_disposing = true;
+			_stopWorkerThreads = true;
+		}
+		_conditionVariable.notify_all();
+		for(std::map<std::string, std::shared_ptr<Bus>>::iterator i = _buses.begin(); i != _buses.end(); ++i)
+		{
+			GD::bl->threadManager.join(i->second->workerThread);
+		}
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		_pending.clear();
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+bool PairingQueue::push(const std::string& interfaceId, std::shared_ptr<HMWiredPacket> packet)
+{
+	try
+	{
+		int32_t address = packet->senderAddress();
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			if(_disposing) return false;
+			_stats.announces++;
+			std::map<int32_t, std::shared_ptr<HMWiredPacket>>::iterator pendingIterator = _pending.find(address);
+			if(pendingIterator != _pending.end())
+			{
+				pendingIterator->second = packet;
+				_stats.duplicates++;
+				return false;
+			}
+			if(_inProgress.find(address) != _inProgress.end())
+			{
+				_stats.duplicates++;
+				return false;
+			}
+			std::map<std::string, std::shared_ptr<Bus>>::iterator busIterator = _buses.find(interfaceId);
+			if(busIterator == _buses.end()) return false;
+			_pending[address] = packet;
+			busIterator->second->addresses.push_back(address);
+			if(_pending.size() > _stats.maxPending) _stats.maxPending = _pending.size();
+		}
+		_conditionVariable.notify_all();
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+uint32_t PairingQueue::size()
+{
+	std::lock_guard<std::mutex> queueGuard(_queueMutex);
+	return _pending.size();
+}
+
+PairingQueueStats PairingQueue::getStats()
+{
+	std::lock_guard<std::mutex> queueGuard(_queueMutex);
+	return _stats;
+}
+
+void PairingQueue::worker(std::string interfaceId)
+{
+	std::shared_ptr<Bus> bus = _buses.at(interfaceId);
+	while(!_stopWorkerThreads)
+	{
+		try
+		{
+			int32_t address = 0;
+			std::shared_ptr<HMWiredPacket> packet;
+			{
+				std::unique_lock<std::mutex> queueGuard(_queueMutex);
+				_conditionVariable.wait(queueGuard, [&] { return _stopWorkerThreads || !bus->addresses.empty(); });
+				if(_stopWorkerThreads) break;
+				address = bus->addresses.front();
+				bus->addresses.pop_front();
+				std::map<int32_t, std::shared_ptr<HMWiredPacket>>::iterator pendingIterator = _pending.find(address);
+				if(pendingIterator == _pending.end()) continue;
+				packet = pendingIterator->second;
+				_pending.erase(pendingIterator);
+				_inProgress.insert(address);
+			}
+
+			AnnounceResult result = _central->handleAnnounce(packet);
+
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			_inProgress.erase(address);
+			if(result == AnnounceResult::paired) _stats.paired++;
+			else if(result == AnnounceResult::skipped) _stats.skipped++;
+			else _stats.failed++;
+		}
+		catch(const std::exception& ex)
+		{
+			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+	}
+}
+
+}
@@ -0,0 +1,141 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef PAIRINGQUEUE_H_
+#define PAIRINGQUEUE_H_
+
+#include "HMWiredPacket.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace HMWired
+{
+class HMWiredCentral;
+
+enum class AnnounceResult
+{
+	paired,
+
+	/**
+	 * The device is already paired or being initialized.
+	 */
+	skipped,
+	failed
+};
+
+class PairingQueueStats
+{
+public:
+	/**
+	 * Announce packets passed to the queue.
+	 */
+	uint64_t announces = 0;
+
+	/**
+	 * Announces of devices already queued or being paired.
+	 */
+	uint64_t duplicates = 0;
+
+	uint64_t paired = 0;
+	uint64_t skipped = 0;
+	uint64_t failed = 0;
+	uint64_t maxPending = 0;
+};
+
+/**
+ * Pairs announced devices in the background, so the receiving thread never waits for a pairing. Announces are deduplicated by
+ * address. Every interface has its own worker, which pairs the devices of its bus one after the other. Devices on different buses
+ * are paired in parallel.
+ */
+class PairingQueue
+{
+public:
+	/**
+	 * @param interfaceIds The interfaces to start a worker for.
+	 */
+	PairingQueue(HMWiredCentral* central, const std::vector<std::string>& interfaceIds);
+	virtual ~PairingQueue();
+
+	/**
+	 * Stops the workers. Queued announces are dropped. The devices announce themselves again.
+	 */
+	void dispose();
+
+	/**
+	 * Queues an announce packet. Only locks the queue, so it can be called from the receiving thread.
+	 *
+	 * @param interfaceId The interface the announce was received on.
+	 * @return Returns false, when the device is already queued or being paired, no worker exists for the interface or the queue is disposing.
+	 */
+	bool push(const std::string& interfaceId, std::shared_ptr<HMWiredPacket> packet);
+
+	uint32_t size();
+	PairingQueueStats getStats();
+protected:
+	class Bus
+	{
+	public:
+		std::deque<int32_t> addresses;
+		std::thread workerThread;
+	};
+
+	HMWiredCentral* _central = nullptr;
+	std::atomic_bool _disposing{false};
+	std::atomic_bool _stopWorkerThreads{false};
+	std::mutex _queueMutex;
+	std::condition_variable _conditionVariable;
+
+	/**
+	 * The buses mapped by interface ID. Only modified by the constructor.
+	 */
+	std::map<std::string, std::shared_ptr<Bus>> _buses;
+
+	/**
+	 * The last announce of every queued device.
+	 */
+	std::map<int32_t, std::shared_ptr<HMWiredPacket>> _pending;
+	std::set<int32_t> _inProgress;
+
+	PairingQueueStats _stats;
+
+	void worker(std::string interfaceId);
+};
+
+}
+
+#endif /* PAIRINGQUEUE_H_ */
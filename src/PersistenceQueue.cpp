@@ -0,0 +1,319 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "PersistenceQueue.h"
+#include "HMWiredPeer.h"
+#include "GD.h"
+
+namespace HMWired
+{
+
+PersistenceQueue::PersistenceQueue(int32_t window)
+{
+	try
+	{
+		_window = window > 0 ? window : 1;
+		_disposing = false;
+		_stopWorkerThread = false;
+		GD::bl->threadManager.start(_workerThread, false, &PersistenceQueue::worker, this);
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+PersistenceQueue::~PersistenceQueue()
+{
+	if(!_disposing) dispose();
+	GD::bl->threadManager.join(_workerThread);
+}
+
+void PersistenceQueue::dispose()
+{
+	try
+	{
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			if(_disposing) return;
+			_disposing = true;
+		}
+		{
+			std::lock_guard<std::mutex> workerGuard(_workerMutex);
+			_stopWorkerThread = true;
+		}
+		_workerConditionVariable.notify_all();
+		GD::bl->threadManager.join(_workerThread);
+		flush();
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+bool PersistenceQueue::enqueueParameter(std::shared_ptr<HMWiredPeer> peer, uint64_t databaseId, std::vector<uint8_t>& value)
+{
+	try
+	{
+		if(!peer || databaseId == 0) return false;
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		if(_disposing) return false;
+		PendingParameter& pendingParameter = _parameters[databaseId];
+		bool coalesced = pendingParameter.peerId != 0;
+		pendingParameter.peerId = peer->getID();
+		pendingParameter.peer = peer;
+		pendingParameter.value = value;
+
+		std::lock_guard<std::mutex> statsGuard(_statsMutex);
+		_stats.enqueued++;
+		if(coalesced) _stats.coalesced++;
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+bool PersistenceQueue::enqueueVariable(std::shared_ptr<HMWiredPeer> peer, uint32_t index, int64_t value)
+{
+	try
+	{
+		if(!peer) return false;
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		if(_disposing) return false;
+		std::pair<std::map<std::pair<uint64_t, uint32_t>, PendingVariable>::iterator, bool> result = _variables.emplace(std::make_pair(peer->getID(), index), PendingVariable());
+		result.first->second.peer = peer;
+		result.first->second.value = value;
+
+		std::lock_guard<std::mutex> statsGuard(_statsMutex);
+		_stats.enqueued++;
+		if(!result.second) _stats.coalesced++;
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
+void PersistenceQueue::flush()
+{
+	try
+	{
+		std::lock_guard<std::mutex> flushGuard(_flushMutex);
+		std::map<uint64_t, PendingParameter> parameters;
+		std::map<std::pair<uint64_t, uint32_t>, PendingVariable> variables;
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			parameters.swap(_parameters);
+			variables.swap(_variables);
+		}
+		write(parameters, variables);
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void PersistenceQueue::flush(uint64_t peerId)
+{
+	try
+	{
+		//Also waits for a batch that is being written, so older values of the peer can't overwrite the ones written here
+		std::lock_guard<std::mutex> flushGuard(_flushMutex);
+		std::map<uint64_t, PendingParameter> parameters;
+		std::map<std::pair<uint64_t, uint32_t>, PendingVariable> variables;
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			for(std::map<uint64_t, PendingParameter>::iterator i = _parameters.begin(); i != _parameters.end();)
+			{
+				if(i->second.peerId == peerId)
+				{
+					parameters.insert(*i);
+					i = _parameters.erase(i);
+				}
+				else ++i;
+			}
+			std::map<std::pair<uint64_t, uint32_t>, PendingVariable>::iterator i = _variables.lower_bound(std::make_pair(peerId, (uint32_t)0));
+			while(i != _variables.end() && i->first.first == peerId)
+			{
+				variables.insert(*i);
+				i = _variables.erase(i);
+			}
+		}
+		write(parameters, variables);
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void PersistenceQueue::write(std::map<uint64_t, PendingParameter>& parameters, std::map<std::pair<uint64_t, uint32_t>, PendingVariable>& variables)
+{
+	try
+	{
+		if(parameters.empty() && variables.empty()) return;
+
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		uint64_t written = 0;
+		//One transaction per batch instead of one per row
+		std::string savepointName("hmwired_persistence");
+		GD::bl->db->createSavepointAsynchronous(savepointName);
+		for(std::map<uint64_t, PendingParameter>::iterator i = parameters.begin(); i != parameters.end(); ++i)
+		{
+			std::shared_ptr<HMWiredPeer> peer = i->second.peer.lock();
+			if(!peer || peer->deleting) continue;
+			peer->writeParameter(i->first, i->second.value);
+			written++;
+		}
+		for(std::map<std::pair<uint64_t, uint32_t>, PendingVariable>::iterator i = variables.begin(); i != variables.end(); ++i)
+		{
+			std::shared_ptr<HMWiredPeer> peer = i->second.peer.lock();
+			if(!peer || peer->deleting) continue;
+			peer->writeVariable(i->first.second, i->second.value);
+			written++;
+		}
+		GD::bl->db->releaseSavepointAsynchronous(savepointName);
+		uint64_t writeTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+		std::lock_guard<std::mutex> statsGuard(_statsMutex);
+		_stats.written += written;
+		_stats.batches++;
+		if(written > _stats.maxBatchSize) _stats.maxBatchSize = written;
+		_stats.writeTime += writeTime;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void PersistenceQueue::discard(uint64_t peerId)
+{
+	try
+	{
+		//Wait for a batch that is being written, so no value of the peer is written after this method returns.
+		std::lock_guard<std::mutex> flushGuard(_flushMutex);
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		for(std::map<uint64_t, PendingParameter>::iterator i = _parameters.begin(); i != _parameters.end();)
+		{
+			if(i->second.peerId == peerId) i = _parameters.erase(i);
+			else ++i;
+		}
+		std::map<std::pair<uint64_t, uint32_t>, PendingVariable>::iterator i = _variables.lower_bound(std::make_pair(peerId, (uint32_t)0));
+		while(i != _variables.end() && i->first.first == peerId) i = _variables.erase(i);
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void PersistenceQueue::addCallerTime(int64_t nanoseconds, bool direct)
+{
+	std::lock_guard<std::mutex> statsGuard(_statsMutex);
+	if(direct) _stats.directWrites++;
+	_stats.callerTime += nanoseconds;
+}
+
+uint32_t PersistenceQueue::size()
+{
+	std::lock_guard<std::mutex> queueGuard(_queueMutex);
+	return _parameters.size() + _variables.size();
+}
+
+PersistenceQueueStats PersistenceQueue::getStats()
+{
+	std::lock_guard<std::mutex> statsGuard(_statsMutex);
+	return _stats;
+}
+
+void PersistenceQueue::worker()
+{
+	try
+	{
+		while(!_stopWorkerThread)
+		{
+			{
+				std::unique_lock<std::mutex> workerGuard(_workerMutex);
+				_workerConditionVariable.wait_for(workerGuard, std::chrono::milliseconds(_window), [&] { return (bool)_stopWorkerThread; });
+			}
+			if(_stopWorkerThread) return;
+			flush();
+		}
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+}
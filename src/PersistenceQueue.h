@@ -0,0 +1,173 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef PERSISTENCEQUEUE_H_
+#define PERSISTENCEQUEUE_H_
+
+#include <homegear-base/BaseLib.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace HMWired
+{
+class HMWiredPeer;
+
+class PersistenceQueueStats
+{
+public:
+	uint64_t enqueued = 0;
+	uint64_t coalesced = 0;
+	uint64_t written = 0;
+	uint64_t directWrites = 0;
+	uint64_t batches = 0;
+	uint64_t maxBatchSize = 0;
+
+	/**
+	 * Time the receive and RPC threads spent persisting values, in nanoseconds. Includes the direct writes.
+	 */
+	uint64_t callerTime = 0;
+
+	/**
+	 * Time spent handing the batches to the database, in nanoseconds.
+	 */
+	uint64_t writeTime = 0;
+};
+
+/**
+ * Write-behind queue for peer parameters and variables. Writes to the same database row within one window are coalesced, so only
+ * the last value is persisted. The batches are handed to the database by a background thread, so the receive and RPC threads
+ * don't wait for the database. Only updates of existing rows are queued. Inserts need the new row's ID and are still
+ * written synchronously by the peer.
+ */
+class PersistenceQueue
+{
+public:
+	/**
+	 * @param window The coalescing window in milliseconds.
+	 */
+	PersistenceQueue(int32_t window);
+	virtual ~PersistenceQueue();
+
+	/**
+	 * Stops the background thread and writes everything still queued. Writes enqueued afterwards are rejected.
+	 */
+	void dispose();
+
+	/**
+	 * Queues the update of a peer parameter.
+	 *
+	 * @return Returns false, when the queue doesn't accept writes anymore. The caller needs to write the value itself then.
+	 */
+	bool enqueueParameter(std::shared_ptr<HMWiredPeer> peer, uint64_t databaseId, std::vector<uint8_t>& value);
+
+	/**
+	 * Queues the update of a peer variable.
+	 *
+	 * @return Returns false, when the queue doesn't accept writes anymore. The caller needs to write the value itself then.
+	 */
+	bool enqueueVariable(std::shared_ptr<HMWiredPeer> peer, uint32_t index, int64_t value);
+
+	/**
+	 * Durability barrier. Returns after all writes queued before the call were handed to the database.
+	 */
+	void flush();
+
+	/**
+	 * Durability barrier for one peer. Returns after all writes of the peer queued before the call were handed to the database. The
+	 * writes of other peers stay queued.
+	 */
+	void flush(uint64_t peerId);
+
+	/**
+	 * Drops all queued writes of a peer. Needs to be called before a peer is deleted from the database.
+	 */
+	void discard(uint64_t peerId);
+
+	/**
+	 * Adds the time a peer spent persisting a value on the calling thread.
+	 *
+	 * @param nanoseconds The time spent.
+	 * @param direct Set to true, when the value bypassed the queue.
+	 */
+	void addCallerTime(int64_t nanoseconds, bool direct);
+
+	int32_t window() { return _window; }
+	uint32_t size();
+	PersistenceQueueStats getStats();
+protected:
+	class PendingParameter
+	{
+	public:
+		uint64_t peerId = 0;
+		std::weak_ptr<HMWiredPeer> peer;
+		std::vector<uint8_t> value;
+	};
+
+	class PendingVariable
+	{
+	public:
+		std::weak_ptr<HMWiredPeer> peer;
+		int64_t value = 0;
+	};
+
+	int32_t _window = 1000;
+	std::atomic_bool _disposing;
+	std::atomic_bool _stopWorkerThread;
+	std::thread _workerThread;
+	std::mutex _workerMutex;
+	std::condition_variable _workerConditionVariable;
+
+	/**
+	 * Serializes the flushes, so a barrier waits for a batch the worker is still writing.
+	 */
+	std::mutex _flushMutex;
+
+	std::mutex _queueMutex;
+	std::map<uint64_t, PendingParameter> _parameters;
+	std::map<std::pair<uint64_t, uint32_t>, PendingVariable> _variables;
+
+	std::mutex _statsMutex;
+	PersistenceQueueStats _stats;
+
+	void worker();
+
+	/**
+	 * Writes a batch within one database transaction. Needs _flushMutex to be locked.
+	 */
+	void write(std::map<uint64_t, PendingParameter>& parameters, std::map<std::pair<uint64_t, uint32_t>, PendingVariable>& variables);
+};
+
+}
+
+#endif /* PERSISTENCEQUEUE_H_ */
@@ -0,0 +1,280 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "DiscoverySearch.h"
+#include "../GD.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <sstream>
+
+namespace HMWired
+{
+
+DiscoverySearch::DiscoverySearch(int64_t responseDelay, bool adaptive)
+{
+	_responseDelay = responseDelay > 0 ? responseDelay : 1;
+	_adaptive = adaptive;
+	_window = _responseDelay;
+}
+
+bool DiscoverySearch::deviceInSubtree(const std::vector<uint32_t>& knownDevices, uint32_t address, int32_t addressMask)
+{
+	uint32_t prefixMask = 0xFFFFFFFF << (31 - addressMask);
+	uint32_t firstAddress = address & prefixMask;
+	std::vector<uint32_t>::const_iterator knownIterator = std::lower_bound(knownDevices.begin(), knownDevices.end(), firstAddress);
+	return knownIterator != knownDevices.end() && (*knownIterator & prefixMask) == firstAddress;
+}
+
+void DiscoverySearch::addLatency(int64_t latency)
+{
+	if(latency < 0) latency = 0;
+	if(latency > _stats.maxLatency) _stats.maxLatency = latency;
+	_latencies.at(std::min(latency, _responseDelay))++;
+	_responses++;
+
+	uint32_t p99Count = (_responses * 99 + 99) / 100;
+	uint32_t count = 0;
+	for(uint32_t i = 0; i < _latencies.size(); i++)
+	{
+		count += _latencies[i];
+		if(count < p99Count) continue;
+		_stats.p99Latency = i;
+		break;
+	}
+	if(_adaptive && _responses >= _windowSamples) _window = std::max(_minWindow, std::min(_responseDelay, _stats.p99Latency * _windowFactor));
+}
+
+void DiscoverySearch::run(const std::set<int32_t>& knownDevices, Probe probe, std::vector<int32_t>& foundDevices)
+{
+	try
+	{
+		int32_t startTime = BaseLib::HelperFunctions::getTimeSeconds();
+		foundDevices.clear();
+		_stats = DiscoveryStats();
+		_latencies.assign(_responseDelay + 1, 0);
+		_responses = 0;
+		_window = _responseDelay;
+		int32_t addressMask = 0;
+		bool backwards = false;
+		uint32_t address = 0;
+		uint32_t address2 = 0;
+		int32_t retries = 0;
+		uint32_t lastAddress = 0;
+		int32_t lastAddressMask = -1;
+		uint32_t repetitions = 0;
+
+		//Known devices always answer probes of their subtrees. Those probes are skipped and only the leaves are probed to verify the
+		//devices are still there. Devices which are gone only cost the probes of their former path, so nothing can be missed.
+		std::vector<uint32_t> sortedKnownDevices(knownDevices.begin(), knownDevices.end());
+		std::sort(sortedKnownDevices.begin(), sortedKnownDevices.end());
+		while(true)
+		{
+			if(BaseLib::HelperFunctions::getTimeSeconds() - startTime > 180)
+			{
+				GD::out.printError("Error: Device search timed out.");
+				break;
+			}
+			if(addressMask == lastAddressMask && address == lastAddress)
+			{
+				if(repetitions < 3) repetitions++;
+				else
+				{
+					GD::out.printError("Error: Prevented deadlock while searching for HomeMatic Wired devices.");
+					address++;
+					backwards = true;
+				}
+			}
+			else repetitions = 0;
+			lastAddress = address;
+			lastAddressMask = addressMask;
+
+			bool responded = false;
+			if(addressMask < 31 && retries == 0 && deviceInSubtree(sortedKnownDevices, address, addressMask))
+			{
+				_stats.probesSkipped++;
+				responded = true;
+			}
+			else
+			{
+				//Only first probes use the measured window. Retries wait for the full response delay in case a device answers slower.
+				int64_t window = (retries > 0) ? _responseDelay : _window;
+				bool carrier = false;
+				int64_t latency = probe(address, addressMask, window, carrier);
+				_stats.probes++;
+				if(retries > 0) _stats.retries++;
+				if(latency > -1)
+				{
+					addLatency(latency);
+					responded = true;
+				}
+				else if(_adaptive && !carrier && retries < 2)
+				{
+					//Retries only help, when responses collided or were garbled. Without any byte on the bus no device is in this subtree.
+					_stats.retriesSkipped += 2 - retries;
+					retries = 2;
+				}
+			}
+			if(responded)
+			{
+				retries = 0;
+				if(addressMask < 31)
+				{
+					backwards = false;
+					addressMask++;
+				}
+				else
+				{
+					if(knownDevices.find(address) != knownDevices.end()) _stats.verified++;
+					if(address > 0) foundDevices.push_back(address);
+					backwards = true;
+					address++;
+					if(address == 0) break; //The last address was found
+					address2 = address;
+					int32_t shifts = 0;
+					while(!(address2 & 1))
+					{
+						address2 >>= 1;
+						addressMask--;
+						shifts++;
+					}
+					address = address2 << shifts;
+				}
+			}
+			else
+			{
+				if(retries < 2) retries++;
+				else
+				{
+					if(addressMask == 0 && (address & 0x80000000)) break;
+					retries = 0;
+					if(addressMask == 0) break;
+					if(backwards)
+					{
+						//Example:
+						//Input:
+						//0x8C      0x00      0d21
+						//10001100  00000000  10101
+						//Output:
+						//90        0x00      0d19
+						//10010000  00000000  10011
+						address2 = address;
+						int32_t shifts = 0;
+						while(!(address2 & 1))
+						{
+							address2 >>= 1;
+							shifts++;
+						}
+						address2++;
+						while(!(address2 & 1))
+						{
+							address2 >>= 1;
+							shifts++;
+							addressMask--;
+						}
+						if(addressMask < 0) break; //Carried past the highest address, so all subtrees were probed
+						address = address2 << shifts;
+					}
+					else address |= (1 << (31 - addressMask));
+				}
+			}
+		}
+		_stats.window = _window;
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+std::string DiscoverySearch::benchmark(uint32_t deviceCount, int64_t responseDelay)
+{
+	try
+	{
+		//Same devices for every run, so results are comparable
+		std::mt19937 generator(deviceCount);
+		std::uniform_int_distribution<uint32_t> addressDistribution(1, 0xFFFFFFFE);
+		std::uniform_int_distribution<int64_t> latencyDistribution(1, 4);
+		std::map<uint32_t, int64_t> devices;
+		while(devices.size() < deviceCount)
+		{
+			devices.emplace(addressDistribution(generator), latencyDistribution(generator));
+		}
+
+		//Sending a discovery frame takes about 4 ms at 19200 baud. The measured latency includes it as sending waits for the echo.
+		const int64_t sendTime = 4;
+		int64_t busTime = 0;
+		DiscoverySearch::Probe probe = [&](uint32_t address, int32_t addressMask, int64_t window, bool& carrier) -> int64_t
+		{
+			uint32_t prefixMask = 0xFFFFFFFF << (31 - addressMask);
+			uint32_t firstAddress = address & prefixMask;
+			int64_t latency = -1;
+			for(std::map<uint32_t, int64_t>::iterator i = devices.lower_bound(firstAddress); i != devices.end() && (i->first & prefixMask) == firstAddress; ++i)
+			{
+				//The first 0xF8 received answers the probe
+				if(latency == -1 || sendTime + i->second < latency) latency = sendTime + i->second;
+			}
+			if(latency > window) latency = -1;
+			carrier = latency > -1;
+			busTime += (latency > -1) ? latency : window;
+			return latency;
+		};
+
+		std::ostringstream stringStream;
+		stringStream << "Mode\t\tFound\tProbes\tRetries\tRetries skipped\tWindow (ms)\tBus time (ms)" << std::endl;
+		for(int32_t i = 0; i < 2; i++)
+		{
+			bool adaptive = (i == 1);
+			busTime = 0;
+			std::vector<int32_t> foundDevices;
+			DiscoverySearch search(responseDelay, adaptive);
+			search.run(std::set<int32_t>(), probe, foundDevices);
+			DiscoveryStats stats = search.getStats();
+			stringStream << (adaptive ? "Adaptive" : "Fixed window") << "\t" << foundDevices.size() << "\t" << stats.probes << "\t" << stats.retries << "\t" << stats.retriesSkipped << "\t\t" << stats.window << "\t\t" << busTime << std::endl;
+		}
+		return stringStream.str();
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return "";
+}
+
+}
@@ -0,0 +1,149 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef DISCOVERYSEARCH_H_
+#define DISCOVERYSEARCH_H_
+
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace HMWired
+{
+
+class DiscoveryStats
+{
+public:
+	uint32_t probes = 0;
+
+	/**
+	 * Probes not sent, because a known device is within the probed subtree.
+	 */
+	uint32_t probesSkipped = 0;
+	uint32_t retries = 0;
+
+	/**
+	 * Retries not sent, because no byte was received after an unanswered probe.
+	 */
+	uint32_t retriesSkipped = 0;
+	uint32_t verified = 0;
+	int64_t maxLatency = 0;
+	int64_t p99Latency = 0;
+
+	/**
+	 * The window in milliseconds unanswered probes were waited for at the end of the search.
+	 */
+	int64_t window = 0;
+};
+
+/**
+ * Walks the 32 bit address space of a bus with discovery probes. A probe with address mask n is answered with 0xF8 by all devices
+ * matching the highest n + 1 bits of the address. Answered probes descend into the subtree, unanswered probes prune it.
+ *
+ * When adaptive, the window to wait for the response of a first probe is shortened to three times the 99th percentile of the
+ * response latencies measured so far, but never below 6 ms. Retries always wait for the full response delay, so a slow device
+ * answering a retry widens the window again. Unanswered probes are only retried, when a byte was received after the probe. Without
+ * any activity on the bus no device answered, so the retries can't help.
+ */
+class DiscoverySearch
+{
+public:
+	/**
+	 * Sends one discovery probe and waits for the response.
+	 *
+	 * @param address The probed address.
+	 * @param addressMask The address mask of the probe.
+	 * @param window The time in milliseconds to wait for the response.
+	 * @param[out] carrier Set to true, when any byte not sent by us was received after the probe.
+	 * @return Returns the time in milliseconds from sending the probe until the response was received or -1 without response.
+	 */
+	typedef std::function<int64_t(uint32_t address, int32_t addressMask, int64_t window, bool& carrier)> Probe;
+
+	/**
+	 * @param responseDelay The response delay of the interface in milliseconds.
+	 * @param adaptive Set to false to wait for the full response delay after every probe and to always retry unanswered probes twice.
+	 */
+	DiscoverySearch(int64_t responseDelay, bool adaptive);
+	virtual ~DiscoverySearch() {}
+
+	/**
+	 * Walks the address space.
+	 *
+	 * @param knownDevices The addresses of devices already paired on this bus. Probes of their subtrees are skipped.
+	 * @param probe Called for every probe to send.
+	 * @param[out] foundDevices The addresses of all devices answering the search including the known devices, which answered.
+	 */
+	void run(const std::set<int32_t>& knownDevices, Probe probe, std::vector<int32_t>& foundDevices);
+
+	DiscoveryStats getStats() { return _stats; }
+
+	/**
+	 * Searches a simulated bus with the fixed and the adaptive window and compares the time the bus is busy.
+	 *
+	 * @param deviceCount The number of devices on the simulated bus.
+	 * @param responseDelay The response delay of the simulated interface in milliseconds.
+	 * @return Returns a printable table of the results.
+	 */
+	static std::string benchmark(uint32_t deviceCount, int64_t responseDelay);
+protected:
+	const int64_t _minWindow = 6;
+	const int64_t _windowFactor = 3;
+
+	/**
+	 * The number of responses to measure before the window is shortened.
+	 */
+	const uint32_t _windowSamples = 8;
+
+	int64_t _responseDelay = 0;
+	bool _adaptive = true;
+	int64_t _window = 0;
+	DiscoveryStats _stats;
+
+	/**
+	 * Number of responses by latency in milliseconds. Latencies above the response delay are counted as the response delay.
+	 */
+	std::vector<uint32_t> _latencies;
+	uint32_t _responses = 0;
+
+	void addLatency(int64_t latency);
+
+	/**
+	 * Checks if a known device is within the addresses matched by a discovery probe.
+	 *
+	 * @param knownDevices The known addresses sorted in ascending order.
+	 * @param addressMask The address mask of the probe. The probe matches the highest addressMask + 1 bits of the address.
+	 */
+	static bool deviceInSubtree(const std::vector<uint32_t>& knownDevices, uint32_t address, int32_t addressMask);
+};
+
+}
+
+#endif /* DISCOVERYSEARCH_H_ */
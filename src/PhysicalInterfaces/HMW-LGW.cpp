@@ -75,8 +75,9 @@ HMW_LGW::~HMW_LGW()
     }
 }
 
-void HMW_LGW::search(std::vector<int32_t>& foundDevices)
+void HMW_LGW::search(std::vector<int32_t>& foundDevices, const std::set<int32_t>& knownDevices)
 {
+	//The gateway runs the search on its own, so known devices can't be skipped
 	try
 	{
 		int32_t startTime = BaseLib::HelperFunctions::getTimeSeconds();
@@ -65,7 +65,7 @@ class HMW_LGW  : public IHMWiredInterface
         virtual bool isOpen() { return _initComplete && _socket->connected(); }
 
         virtual bool autoResend() { return true; }
-        virtual void search(std::vector<int32_t>& foundDevices);
+        virtual void search(std::vector<int32_t>& foundDevices, const std::set<int32_t>& knownDevices);
     protected:
         class Request
         {
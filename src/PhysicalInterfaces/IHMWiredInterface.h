@@ -32,6 +32,8 @@
 
 #include <homegear-base/BaseLib.h>
 
+#include <set>
+
 namespace HMWired {
 
 class IHMWiredInterface : public BaseLib::Systems::IPhysicalInterface
@@ -46,8 +48,10 @@ public:
 	/**
 	 * Search for new devices on the bus.
 	 * @param[out] foundDevices This array will be filled by the method with the found device addresses.
+	 * @param knownDevices The addresses of devices already paired on this bus. Probes, which would be answered by them anyway, can be
+	 * skipped. Pass an empty set for a full search.
 	 */
-	virtual void search(std::vector<int32_t>& foundDevices) {};
+	virtual void search(std::vector<int32_t>& foundDevices, const std::set<int32_t>& knownDevices) {};
 
 	virtual bool autoResend() { return false; }
 
@@ -30,6 +30,7 @@
 #include "RS485.h"
 #include "../HMWiredPacket.h"
 #include "../GD.h"
+#include "DiscoverySearch.h"
 
 namespace HMWired
 {
@@ -284,115 +285,47 @@ void RS485::setupDevice()
     }
 }
 
-void RS485::search(std::vector<int32_t>& foundDevices)
+void RS485::search(std::vector<int32_t>& foundDevices, const std::set<int32_t>& knownDevices)
 {
 	try
 	{
-		int32_t startTime = BaseLib::HelperFunctions::getTimeSeconds();
 		foundDevices.clear();
 		_searchResponse = 0;
 		_searchMode = true;
-		int32_t addressMask = 0;
-		bool backwards = false;
-		uint32_t address = 0;
-		uint32_t address2 = 0;
-		int64_t time = 0;
-		int32_t retries = 0;
-		std::pair<uint32_t, std::shared_ptr<HMWiredPacket>> packet;
-		while(true)
+		std::chrono::steady_clock::time_point searchStartTime = std::chrono::steady_clock::now();
+
+		DiscoverySearch search(_settings->responseDelay, true);
+		search.run(knownDevices, [this](uint32_t address, int32_t addressMask, int64_t window, bool& carrier) -> int64_t
 		{
-			if(BaseLib::HelperFunctions::getTimeSeconds() - startTime > 180)
-			{
-				GD::out.printError("Error: Device search timed out.");
-				break;
-			}
 			std::vector<uint8_t> payload;
-			if(packet.second && packet.second->addressMask() == addressMask && (uint32_t)packet.second->destinationAddress() == address)
-			{
-				if(packet.first < 3) packet.first++;
-				else
-				{
-					GD::out.printError("Error: Prevented deadlock while searching for HomeMatic Wired devices.");
-					address++;
-					backwards = true;
-				}
-			}
-			else
-			{
-				packet.first = 0;
-				packet.second.reset(new HMWiredPacket(HMWiredPacketType::discovery, 0, address, false, 0, 0, addressMask, payload));
-			}
-			time = BaseLib::HelperFunctions::getTime();
-			sendPacket(packet.second);
-
-			int32_t j = 0;
-			while(j * 3 < (signed)_settings->responseDelay)
+			std::shared_ptr<HMWiredPacket> packet(new HMWiredPacket(HMWiredPacketType::discovery, 0, address, false, 0, 0, addressMask, payload));
+			_searchResponse = 0;
+			int64_t time = BaseLib::HelperFunctions::getTime();
+			sendPacket(packet);
+			while(BaseLib::HelperFunctions::getTime() - time < window)
 			{
-				std::this_thread::sleep_for(std::chrono::milliseconds(3));
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
 				if(_searchResponse >= time) break;
-				j++;
-			}
-			if(_searchResponse >= time)
-			{
-				_searchResponse = 0;
-				retries = 0;
-				if(addressMask < 31)
-				{
-					backwards = false;
-					addressMask++;
-				}
-				else
-				{
-					GD::out.printMessage("Peer found with address 0x" + BaseLib::HelperFunctions::getHexString(address, 8));
-					if(address > 0) foundDevices.push_back(address);
-					backwards = true;
-					address++;
-					address2 = address;
-					int32_t shifts = 0;
-					while(!(address2 & 1))
-					{
-						address2 >>= 1;
-						addressMask--;
-						shifts++;
-					}
-					address = address2 << shifts;
-				}
 			}
-			else
+			carrier = _lastForeignByte >= time;
+			if(_searchResponse < time) return -1;
+			int64_t latency = _searchResponse - time;
+			_searchResponse = 0;
+			return latency;
+		}, foundDevices);
+
+		DiscoveryStats stats = search.getStats();
+		int64_t duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - searchStartTime).count();
+		_out.printInfo("Info: Search finished in " + std::to_string(duration) + " ms. Probes sent: " + std::to_string(stats.probes) + ", probes skipped: " + std::to_string(stats.probesSkipped) + ", retries: " + std::to_string(stats.retries) + ", retries skipped: " + std::to_string(stats.retriesSkipped) + ", slowest response: " + std::to_string(stats.maxLatency) + " ms, 99th percentile: " + std::to_string(stats.p99Latency) + " ms, final window: " + std::to_string(stats.window) + " ms.");
+		for(std::vector<int32_t>::iterator i = foundDevices.begin(); i != foundDevices.end(); ++i)
+		{
+			if(knownDevices.find(*i) == knownDevices.end()) GD::out.printMessage("Peer found with address 0x" + BaseLib::HelperFunctions::getHexString(*i, 8));
+		}
+		if(stats.verified < knownDevices.size())
+		{
+			for(std::set<int32_t>::const_iterator i = knownDevices.begin(); i != knownDevices.end(); ++i)
 			{
-				if(retries < 2) retries++;
-				else
-				{
-					if(addressMask == 0 && (address & 0x80000000)) break;
-					retries = 0;
-					if(addressMask == 0) break;
-					if(backwards)
-					{
-						//Example:
-						//Input:
-						//0x8C      0x00      0d21
-						//10001100  00000000  10101
-						//Output:
-						//90        0x00      0d19
-						//10010000  00000000  10011
-						address2 = address;
-						int32_t shifts = 0;
-						while(!(address2 & 1))
-						{
-							address2 >>= 1;
-							shifts++;
-						}
-						address2++;
-						while(!(address2 & 1))
-						{
-							address2 >>= 1;
-							shifts++;
-							addressMask--;
-						}
-						address = address2 << shifts;
-					}
-					else address |= (1 << (31 - addressMask));
-				}
+				if(std::find(foundDevices.begin(), foundDevices.end(), *i) == foundDevices.end()) _out.printWarning("Warning: Known device with address 0x" + BaseLib::HelperFunctions::getHexString(*i, 8) + " didn't answer the search.");
 			}
 		}
 	}
@@ -478,6 +411,8 @@ std::vector<uint8_t> RS485::readFromDevice()
 				_out.printError("Error reading from RS485 serial device: " + _settings->device);
 				break;
 			}
+			//Every byte except our own echo is bus activity, including 0x00 read after a collision
+			if(i > 0 && !_receivingSending) _lastForeignByte = BaseLib::HelperFunctions::getTime();
 			if(i == 0 || (packet.empty() && localBuffer[0] == 0)) break;
 			_lastAction = BaseLib::HelperFunctions::getTime();
 			if(!packet.empty() && (localBuffer[0] == 0xFD || localBuffer[0] == 0xFE))
@@ -41,6 +41,8 @@
 #include <chrono>
 #include <ctime>
 #include <iomanip>
+#include <algorithm>
+#include <atomic>
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -61,10 +63,15 @@ class RS485 : public IHMWiredInterface
         void sendPacket(std::shared_ptr<BaseLib::Systems::Packet> packet);
         int64_t lastAction() { return _lastAction; }
         virtual void setup(int32_t userID, int32_t groupID, bool setPermissions);
-        virtual void search(std::vector<int32_t>& foundDevices);
+        virtual void search(std::vector<int32_t>& foundDevices, const std::set<int32_t>& knownDevices);
     protected:
         bool _searchMode = false;
         int64_t _searchResponse = 0;
+
+        /**
+         * Time the last byte not sent by us was received. Used to detect if there was any activity on the bus after a discovery probe.
+         */
+        std::atomic<int64_t> _lastForeignByte{0};
         uint8_t _firstByte = 0;
         int64_t _lastAction = 0;
         bool _sending = false;